@@ -1,111 +1,143 @@
 #include "api_handler.h"
-#include "boost/json/serialize.hpp"
 #include "model.h"
 
+#include <charconv>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
 
 namespace http_handler {
 
-json::array ApiHandler::AddRoads(const model::Map* map) const {
-	json::array roads_arr;
-	for (const auto& road : map->GetRoads()) {
-		json::object road_obj;
-		road_obj["x0"] = road.GetStart().x;
-		road_obj["y0"] = road.GetStart().y;
+void ApiHandler::CacheMapResponses() {
+	std::string maps;
+	util::JsonWriter maps_writer(maps);
+	maps_writer.StartArray();
+	for (const auto& map : game_.GetMaps()) {
+		maps_writer.StartObject();
+		maps_writer.Key("id").String(*map.GetId());
+		maps_writer.Key("name").String(map.GetName());
+		maps_writer.EndObject();
+
+		std::string body;
+		util::JsonWriter writer(body);
+		writer.StartObject();
+		writer.Key("id").String(*map.GetId());
+		writer.Key("name").String(map.GetName());
+		WriteRoads(writer, map);
+		WriteBuildings(writer, map);
+		WriteOffices(writer, map);
+		WriteLootTypes(writer, map);
+		writer.EndObject();
+		map_responses_[*map.GetId()] = MakeCachedResponse(std::move(body));
+	}
+	maps_writer.EndArray();
+
+	maps_response_ = MakeCachedResponse(std::move(maps));
+}
+
+std::shared_ptr<const ApiHandler::CachedResponse> ApiHandler::MakeCachedResponse(std::string body) {
+	auto cached = std::make_shared<CachedResponse>();
+	cached->body = std::move(body);
+
+	std::stringstream etag;
+	etag << '"' << std::hex << std::setw(16) << std::setfill('0')
+		  << std::hash<std::string>{}(cached->body) << '"';
+	cached->etag = etag.str();
+
+	return cached;
+}
+
+void ApiHandler::WriteRoads(util::JsonWriter& writer, const model::Map& map) {
+	writer.Key("roads").StartArray();
+	for (const auto& road : map.GetRoads()) {
+		writer.StartObject();
+		writer.Key("x0").Int(road.GetStart().x);
+		writer.Key("y0").Int(road.GetStart().y);
 		if (road.IsHorizontal())
-			road_obj["x1"] = road.GetEnd().x;
+			writer.Key("x1").Int(road.GetEnd().x);
 		else
-			road_obj["y1"] = road.GetEnd().y;
-		roads_arr.push_back(road_obj);
+			writer.Key("y1").Int(road.GetEnd().y);
+		writer.EndObject();
 	}
-
-	return roads_arr;
+	writer.EndArray();
 }
 
-json::array ApiHandler::AddBuildings(const model::Map* map) const {
-	json::array buildings_arr;
-	for (const auto& b : map->GetBuildings()) {
+void ApiHandler::WriteBuildings(util::JsonWriter& writer, const model::Map& map) {
+	writer.Key("buildings").StartArray();
+	for (const auto& b : map.GetBuildings()) {
 		const auto& bounds = b.GetBounds();
-		json::object bounds_obj;
-		bounds_obj["x"] = bounds.position.x;
-		bounds_obj["y"] = bounds.position.y;
-		bounds_obj["w"] = bounds.size.width;
-		bounds_obj["h"] = bounds.size.height;
-		buildings_arr.push_back(std::move(bounds_obj));
+		writer.StartObject();
+		writer.Key("x").Int(bounds.position.x);
+		writer.Key("y").Int(bounds.position.y);
+		writer.Key("w").Int(bounds.size.width);
+		writer.Key("h").Int(bounds.size.height);
+		writer.EndObject();
 	}
-
-	return buildings_arr;
+	writer.EndArray();
 }
 
-json::array ApiHandler::AddOffices(const model::Map* map) const {
-	json::array offices_arr;
-	for (const auto& office : map->GetOffices()) {
-		json::object office_obj;
-		office_obj["id"] = *office.GetId();
-		office_obj["x"] = office.GetPosition().x;
-		office_obj["y"] = office.GetPosition().y;
-		office_obj["offsetX"] = office.GetOffset().dx;
-		office_obj["offsetY"] = office.GetOffset().dy;
-		offices_arr.push_back(std::move(office_obj));
+void ApiHandler::WriteOffices(util::JsonWriter& writer, const model::Map& map) {
+	writer.Key("offices").StartArray();
+	for (const auto& office : map.GetOffices()) {
+		writer.StartObject();
+		writer.Key("id").String(*office.GetId());
+		writer.Key("x").Int(office.GetPosition().x);
+		writer.Key("y").Int(office.GetPosition().y);
+		writer.Key("offsetX").Int(office.GetOffset().dx);
+		writer.Key("offsetY").Int(office.GetOffset().dy);
+		writer.EndObject();
 	}
-
-	return offices_arr;
+	writer.EndArray();
 }
 
-json::array ApiHandler::AddLootTypes(const model::Map* map) const {
-	json::array loot_types;
-	for (const auto& loot_type : map->GetLootTypes()) {
-		json::object obj;
-		obj["name"] = loot_type.name;
-		obj["file"] = loot_type.file;
-		obj["type"] = loot_type.type;
-		obj["value"] = loot_type.value;
+void ApiHandler::WriteLootTypes(util::JsonWriter& writer, const model::Map& map) {
+	writer.Key("lootTypes").StartArray();
+	for (const auto& loot_type : map.GetLootTypes()) {
+		writer.StartObject();
+		writer.Key("name").String(loot_type.name);
+		writer.Key("file").String(loot_type.file);
+		writer.Key("type").String(loot_type.type);
+		writer.Key("value").Int(loot_type.value);
 
 		if (loot_type.rotation) {
-			obj["rotation"] = *loot_type.rotation;
+			writer.Key("rotation").Int(*loot_type.rotation);
 		}
 
 		if (loot_type.color) {
-			obj["color"] = *loot_type.color;
+			writer.Key("color").String(*loot_type.color);
 		}
 
-		obj["scale"] = loot_type.scale;
-
-		loot_types.push_back(std::move(obj));
+		writer.Key("scale").Double(loot_type.scale);
+		writer.EndObject();
 	}
-
-	return loot_types;
+	writer.EndArray();
 }
 
-ApiHandler::StringResponse ApiHandler::ErrorRequest(std::string code, std::string message,
+ApiHandler::StringResponse ApiHandler::ErrorRequest(std::string_view code, std::string_view message,
 																	 http::status status, unsigned int ver,
-																	 std::string allowed_method) const {
+																	 std::string_view allowed_method) const {
 	StringResponse response{status, ver};
 	if (status == http::status::method_not_allowed) {
 		if (allowed_method == "GET") {
 			response.set(http::field::allow, "GET");
 			response.insert(http::field::allow, "HEAD");
 		} else {
-			response.set(http::field::allow, allowed_method);
+			response.set(http::field::allow,
+							 beast::string_view{allowed_method.data(), allowed_method.size()});
 		}
 	}
 
-	boost::json::object response_body;
-	response_body["code"] = code;
-	response_body["message"] = message;
-	std::string json_str = boost::json::serialize(response_body);
+	response.body() = ErrorBody(code, message);
 	response.set(http::field::content_type, "application/json");
-	response.set(http::field::content_length, std::to_string(json_str.size()));
 	response.set(http::field::cache_control, "no-cache");
-	response.body() = json_str;
+	response.prepare_payload();
 
 	return response;
 }
 
 ApiHandler::StringResponse ApiHandler::GoodJoinRequest(const model::Map* map, std::string username,
 																		 unsigned int ver) {
-	auto game_session =
-		 game_.AddGameSession(model::GameSession{map, game_.GetPeriod(), game_.GetProbability()});
+	auto game_session = game_.JoinSession(map);
 	auto dog = game_session->AddDog(username);
 	if (randomize_) {
 		dog->SetPosition(map->GetRandomRoadPosition());
@@ -115,17 +147,16 @@ ApiHandler::StringResponse ApiHandler::GoodJoinRequest(const model::Map* map, st
 	}
 	auto player = players_.Add(game_session, dog);
 	app::Token token = players_tokens_.AddPlayer(player);
-
-	boost::json::object response_body;
-	response_body["authToken"] = *token;
-	response_body["playerId"] = player->GetId();
-	std::string json_str = boost::json::serialize(response_body);
+	state_saver_.OnJoin(*player, token);
+	state_view_.UpdatePlayer(*player);
 
 	StringResponse response{http::status::ok, ver};
+	util::JsonWriter writer(response.body());
+	writer.StartObject().Key("authToken").String(*token).Key("playerId").Uint(player->GetId());
+	writer.EndObject();
 	response.set(http::field::content_type, "application/json");
-	response.set(http::field::content_length, std::to_string(json_str.size()));
 	response.set(http::field::cache_control, "no-cache");
-	response.body() = json_str;
+	response.prepare_payload();
 
 	return response;
 }
@@ -154,85 +185,98 @@ std::optional<json::object> ApiHandler::ParseJoinRequest(const StringRequest& re
 	}
 }
 
-std::string ApiHandler::ExtractBearerToken(const beast::string_view auth_header) {
-	const std::string bearer_prefix = "Bearer ";
+std::string_view ApiHandler::ExtractBearerToken(std::string_view auth_header) {
+	constexpr std::string_view bearer_prefix = "Bearer ";
 	if (auth_header.size() > bearer_prefix.size() &&
 		 auth_header.compare(0, bearer_prefix.size(), bearer_prefix) == 0) {
-		std::string str = std::string(auth_header);
-		std::string token_str = str.substr(bearer_prefix.size());
+		std::string_view token_str = auth_header.substr(bearer_prefix.size());
 		if (token_str.size() != 32) {
-			return "";
+			return {};
 		}
 		return token_str;
 	}
-	return "";
+	return {};
 }
 
-std::optional<std::string> ApiHandler::GetAuthToken(const StringRequest& request) {
+std::optional<std::string_view> ApiHandler::GetAuthToken(const StringRequest& request) {
 	auto auth_header = request.find(http::field::authorization);
 	if (auth_header == request.end()) {
 		return std::nullopt;
 	}
-	std::string auth_token = ExtractBearerToken(auth_header->value());
+	std::string_view auth_token =
+		 ExtractBearerToken({auth_header->value().data(), auth_header->value().size()});
 	if (auth_token.empty()) {
 		return std::nullopt;
 	}
 	return auth_token;
 }
 
-ApiHandler::StringResponse ApiHandler::GoodPlayersRequest(const StringRequest& req) {
-	boost::json::object response_body;
-	std::vector<std::string> names = players_.GetNames();
-
-	for (size_t i = 0; i < names.size(); i++) {
-		boost::json::object player_info;
-		player_info["name"] = names[i];
-		response_body[std::to_string(i)] = player_info;
-	}
+ApiHandler::SharedResponse ApiHandler::GoodPlayersRequest(const StringRequest& req,
+																			  const model::GameSession* session) {
+	auto session_snapshot = state_view_.Get()->FindSession(session);
 
-	std::string json_str = boost::json::serialize(response_body);
-	StringResponse response{http::status::ok, req.version()};
+	SharedResponse response{http::status::ok, req.version()};
 	response.set(http::field::content_type, "application/json");
-	response.insert(http::field::content_length, std::to_string(json_str.size()));
 	response.set(http::field::cache_control, "no-cache");
 	response.keep_alive(req.keep_alive());
-	response.body() = json_str;
+	if (session_snapshot) {
+		response.body() = {session_snapshot->players_body, *session_snapshot->players_body};
+	} else {
+		response.body().data = "{}";
+	}
 
 	response.prepare_payload();
 	return response;
 }
 
-ApiHandler::StringResponse ApiHandler::GoodStateRequest(const StringRequest& req) {
-	json::object obj;
-	obj["players"] = players_.GetPlayersInfo();
-	json::object lost_objects;
-
-	int count = 0;
-	for (const model::GameSession& session : game_.GetGameSessions()) {
-		for (const model::LostObject& loot : session.GetLostObjects()) {
-			json::object lost_obj;
-			lost_obj["type"] = loot.type;
-			lost_obj["pos"] = {loot.pos.x, loot.pos.y};
-			std::string key = std::to_string(count++);
-			lost_objects[key] = std::move(lost_obj);
-		}
+ApiHandler::SharedResponse ApiHandler::GoodStateRequest(const StringRequest& req,
+																			const model::GameSession* session) {
+	auto session_snapshot = state_view_.Get()->FindSession(session);
+
+	SharedResponse response{http::status::ok, req.version()};
+	response.set(http::field::content_type, "application/json");
+	response.set(http::field::cache_control, "no-cache");
+	response.keep_alive(req.keep_alive());
+	if (session_snapshot) {
+		response.body() = {session_snapshot, session_snapshot->state_body};
+	} else {
+		response.body().data = R"({"players":{},"lostObjects":{}})";
 	}
 
-	obj["lostObjects"] = std::move(lost_objects);
+	response.prepare_payload();
+	return response;
+}
 
-	std::string json_str = json::serialize(obj);
+ApiHandler::StringResponse ApiHandler::DeltaStateRequest(const StringRequest& req,
+																			  const model::GameSession* session,
+																			  uint64_t since) {
+	auto session_snapshot = state_view_.Get()->FindSession(session);
 
 	StringResponse response{http::status::ok, req.version()};
 	response.set(http::field::content_type, "application/json");
-	response.insert(http::field::content_length, std::to_string(json_str.size()));
 	response.set(http::field::cache_control, "no-cache");
 	response.keep_alive(req.keep_alive());
-	response.body() = json_str;
+	// Игрок мог присоединиться после публикации снимка
+	if (session_snapshot) {
+		session_snapshot->WriteDelta(since, response.body());
+	} else {
+		app::SessionSnapshot{}.WriteDelta(since, response.body());
+	}
 
 	response.prepare_payload();
 	return response;
 }
 
+std::optional<uint64_t> ApiHandler::ParseTickNumber(std::string_view str) {
+	uint64_t value = 0;
+	auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), value);
+	if (ec != std::errc{} || ptr != str.data() + str.size()) {
+		return std::nullopt;
+	}
+
+	return value;
+}
+
 std::optional<json::object> ApiHandler::ParseMoveRequest(const StringRequest& request) {
 	auto it = request.find(http::field::content_type);
 	if (it == request.end() || it->value() != "application/json") {
@@ -259,16 +303,12 @@ std::optional<json::object> ApiHandler::ParseMoveRequest(const StringRequest& re
 	}
 }
 
-ApiHandler::StringResponse ApiHandler::GoogMoveRequest(const StringRequest& req) {
-	json::object obj;
-	std::string json_str = json::serialize(obj);
-
+ApiHandler::StringResponse ApiHandler::EmptyObjectResponse(const StringRequest& req) const {
 	StringResponse response{http::status::ok, req.version()};
 	response.set(http::field::content_type, "application/json");
-	response.insert(http::field::content_length, std::to_string(json_str.size()));
 	response.set(http::field::cache_control, "no-cache");
 	response.keep_alive(req.keep_alive());
-	response.body() = json_str;
+	response.body() = "{}";
 
 	response.prepare_payload();
 	return response;
@@ -300,20 +340,5 @@ std::optional<json::object> ApiHandler::ParseTickRequest(const StringRequest& re
 	}
 }
 
-ApiHandler::StringResponse ApiHandler::GoodTickRequest(const StringRequest& req) {
-	json::object obj;
-	std::string json_str = json::serialize(obj);
-
-	StringResponse response{http::status::ok, req.version()};
-	response.set(http::field::content_type, "application/json");
-	response.insert(http::field::content_length, std::to_string(json_str.size()));
-	response.set(http::field::cache_control, "no-cache");
-	response.keep_alive(req.keep_alive());
-	response.body() = json_str;
-
-	response.prepare_payload();
-	return response;
-}
-
 } // namespace http_handler
 
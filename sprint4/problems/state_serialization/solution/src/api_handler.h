@@ -1,10 +1,15 @@
 #pragma once
 
 #include "endpoint.h"
+#include "json_writer.h"
 // #include "http_server.h"
 #include "model.h"
 #include "player.h"
+#include "recycling_allocator.h"
+#include "shared_buffer_body.h"
 #include "state_saver.h"
+#include "state_view.h"
+#include "static_files.h"
 
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/asio/strand.hpp>
@@ -14,19 +19,34 @@
 #include <boost/beast/http/status.hpp>
 #include <boost/beast/http/string_body.hpp>
 #include <boost/json.hpp>
+#include <memory>
 #include <optional>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 
 namespace http_handler {
 namespace beast = boost::beast;
 namespace http = beast::http;
 namespace json = boost::json;
 
+// Заголовки запросов и ответов берут память из кэша блоков потока, как и в http_server
+using Fields = http::basic_fields<util::RecyclingAllocator<char>>;
+
+// Тело ответа об ошибке вида {"code": ..., "message": ...}
+inline std::string ErrorBody(std::string_view code, std::string_view message) {
+	std::string body;
+	util::JsonWriter writer(body);
+	writer.StartObject().Key("code").String(code).Key("message").String(message).EndObject();
+	return body;
+}
+
 template <typename Body, typename Allocator>
-inline http::response<http::string_body>
+inline http::response<http::string_body, http::basic_fields<Allocator>>
 BadRequest(const http::request<Body, http::basic_fields<Allocator>>& req, beast::string_view err,
-			  const std::string& content_type, std::string cache_control = "") {
-	http::response<http::string_body> res{http::status::bad_request, req.version()};
+			  beast::string_view content_type, beast::string_view cache_control = {}) {
+	http::response<http::string_body, http::basic_fields<Allocator>> res{http::status::bad_request,
+																					  req.version()};
 	res.set(http::field::content_type, content_type);
 	res.keep_alive(req.keep_alive());
 	res.body() = std::string(err);
@@ -38,10 +58,11 @@ BadRequest(const http::request<Body, http::basic_fields<Allocator>>& req, beast:
 }
 
 template <typename Body, typename Allocator>
-inline http::response<http::string_body>
+inline http::response<http::string_body, http::basic_fields<Allocator>>
 NotFound(const http::request<Body, http::basic_fields<Allocator>>& req, beast::string_view err,
-			const std::string& content_type, std::string cache_control = "") {
-	http::response<http::string_body> res{http::status::not_found, req.version()};
+			beast::string_view content_type, beast::string_view cache_control = {}) {
+	http::response<http::string_body, http::basic_fields<Allocator>> res{http::status::not_found,
+																					  req.version()};
 	res.set(http::field::content_type, content_type);
 	res.keep_alive(req.keep_alive());
 	res.body() = std::string(err);
@@ -53,10 +74,11 @@ NotFound(const http::request<Body, http::basic_fields<Allocator>>& req, beast::s
 };
 
 template <typename Body, typename Allocator>
-inline http::response<http::string_body>
+inline http::response<http::string_body, http::basic_fields<Allocator>>
 ServerError(const http::request<Body, http::basic_fields<Allocator>>& req, beast::string_view err,
-				const std::string& content_type, std::string cache_control = "") {
-	http::response<http::string_body> res{http::status::internal_server_error, req.version()};
+				beast::string_view content_type, beast::string_view cache_control = {}) {
+	http::response<http::string_body, http::basic_fields<Allocator>> res{http::status::internal_server_error,
+																					  req.version()};
 	res.set(http::field::content_type, content_type);
 	res.keep_alive(req.keep_alive());
 	res.body() = std::string(err);
@@ -68,11 +90,12 @@ ServerError(const http::request<Body, http::basic_fields<Allocator>>& req, beast
 }
 
 template <typename Body, typename Allocator>
-inline http::response<http::string_body>
+inline http::response<http::string_body, http::basic_fields<Allocator>>
 MethodNotAllowed(const http::request<Body, http::basic_fields<Allocator>>& req,
-					  beast::string_view err, const std::string& content_type,
-					  std::string cache_control = "") {
-	http::response<http::string_body> res{http::status::method_not_allowed, req.version()};
+					  beast::string_view err, beast::string_view content_type,
+					  beast::string_view cache_control = {}) {
+	http::response<http::string_body, http::basic_fields<Allocator>> res{http::status::method_not_allowed,
+																					  req.version()};
 	res.set(http::field::content_type, content_type);
 	res.keep_alive(req.keep_alive());
 	res.body() = std::string(err);
@@ -85,13 +108,24 @@ MethodNotAllowed(const http::request<Body, http::basic_fields<Allocator>>& req,
 
 class ApiHandler {
  public:
-	using StringRequest = http::request<http::string_body>;
-	using StringResponse = http::response<http::string_body>;
+	using StringRequest = http::request<http::string_body, Fields>;
+	using StringResponse = http::response<http::string_body, Fields>;
+	using SharedResponse = http::response<SharedBufferBody, Fields>;
 
 	explicit ApiHandler(model::Game& game, bool randomize, bool auto_tick, StateSaver& saver,
-							  app::Players& players, app::PlayerTokens& tokens)
+							  app::Players& players, app::PlayerTokens& tokens,
+							  app::StateView& state_view)
 		 : game_(game), randomize_(randomize), auto_tick_(auto_tick), state_saver_(saver),
-			players_(players), players_tokens_(tokens) {}
+			players_(players), players_tokens_(tokens), state_view_(state_view) {
+		CacheMapResponses();
+	}
+
+	// Эти запросы не меняют мир: карты неизменны, а состояние читается из
+	// опубликованного снимка, поэтому их можно обслуживать вне api_strand
+	static bool IsReadOnly(const EndPoint& endpoint) {
+		return endpoint.IsMapsReq() || endpoint.IsSpecificMapReq() || endpoint.IsPlayersReq() ||
+				 endpoint.IsStateReq();
+	}
 
 	template <typename Body, typename Allocator, typename Send>
 	void operator()(const EndPoint& endpoint,
@@ -113,7 +147,7 @@ class ApiHandler {
 		}
 
 		if (endpoint.IsStateReq()) {
-			return StateRequest(req, std::move(send));
+			return StateRequest(endpoint, req, std::move(send));
 		}
 
 		if (endpoint.IsActionReq()) {
@@ -124,41 +158,49 @@ class ApiHandler {
 			return TickRequest(req, std::move(send));
 		}
 
-		return send(BadRequest(
-			 std::move(req),
-			 json::serialize(json::object{{"code", "badRequest"}, {"message", "Bad request"}}),
-			 "application/json"));
+		return send(BadRequest(req, ErrorBody("badRequest", "Bad request"), "application/json"));
 	}
 
  private:
+	// Карты не меняются после загрузки, поэтому ответы о них сериализуются один раз
+	struct CachedResponse {
+		std::string body;
+		std::string etag;
+	};
+
+	// Если метод не подходит, отправляет 405 и возвращает false. На запрос отвечают
+	// ровно один раз, поэтому после false обработчик должен сразу вернуться
 	template <typename Body, typename Allocator, typename Send>
-	void CheckMethod(const http::request<Body, http::basic_fields<Allocator>>& req, Send& send,
-						  std::string method) const {
+	bool CheckMethod(const http::request<Body, http::basic_fields<Allocator>>& req, Send& send,
+						  std::string_view method) const {
 		if (method == "GET") {
 			if (req.method() != http::verb::get && req.method() != http::verb::head) {
-				return send(ErrorRequest("invalidMethod", "Only GET and HEAD method are expected",
-												 http::status::method_not_allowed, req.version(), "GET"));
+				send(ErrorRequest("invalidMethod", "Only GET and HEAD method are expected",
+										http::status::method_not_allowed, req.version(), "GET"));
+				return false;
 			}
 		} else if (method == "POST") {
 			if (req.method() != http::verb::post) {
-				return send(ErrorRequest("invalidMethod", "Only POST method are expected",
-												 http::status::method_not_allowed, req.version(), "POST"));
+				send(ErrorRequest("invalidMethod", "Only POST method are expected",
+										http::status::method_not_allowed, req.version(), "POST"));
+				return false;
 			}
 		}
+		return true;
 	}
 
 	template <typename Body, typename Allocator, typename Send>
 	app::Player* CheckTokenAndPlayer(const http::request<Body, http::basic_fields<Allocator>>& req,
 												Send& send) {
 		auto ver = req.version();
-		std::optional<std::string> token_str = GetAuthToken(req);
+		std::optional<std::string_view> token_str = GetAuthToken(req);
 		if (!token_str) {
 			send(ErrorRequest("invalidToken", "Authorization header is missing",
 									http::status::unauthorized, ver));
 			return nullptr;
 		}
 
-		app::Token token{*token_str};
+		app::Token token{std::string(*token_str)};
 		auto player = players_tokens_.FindPlayerByToken(token);
 		if (!player) {
 			send(ErrorRequest("unknownToken", "Player token has not been found",
@@ -172,50 +214,49 @@ class ApiHandler {
 	template <typename Body, typename Allocator, typename Send>
 	void MapsRequest(const http::request<Body, http::basic_fields<Allocator>>& req,
 						  Send&& send) const {
-		json::array arr;
-		for (const auto& map : game_.GetMaps()) {
-			json::object obj;
-			obj["id"] = *map.GetId();
-			obj["name"] = map.GetName();
-			arr.push_back(std::move(obj));
-		}
-
-		http::response<http::string_body> resp{http::status::ok, req.version()};
-		resp.set(http::field::content_type, "application/json");
-		resp.body() = json::serialize(arr);
-		resp.keep_alive(req.keep_alive());
-		resp.prepare_payload();
-
-		return send(std::move(resp));
+		return SendCachedResponse(req, maps_response_, std::move(send));
 	}
 
 	template <typename Body, typename Allocator, typename Send>
-	void SpecificMapRequest(const std::string& target,
+	void SpecificMapRequest(std::string_view target,
 									const http::request<Body, http::basic_fields<Allocator>>& req,
 									Send&& send) const {
-		CheckMethod(req, send, "GET");
-		std::string id = target.substr(13);
+		if (!CheckMethod(req, send, "GET")) {
+			return;
+		}
+		std::string_view id = target.substr(13);
 		if (!id.empty() && id.back() == '/') {
-			id.pop_back();
+			id.remove_suffix(1);
 		}
 
-		const auto* map = game_.FindMap(model::Map::Id(id));
-		if (!map) {
+		auto it = map_responses_.find(std::string(id));
+		if (it == map_responses_.end()) {
 			return send(
 				 ErrorRequest("mapNotFound", "Map not found", http::status::not_found, req.version()));
 		}
 
-		json::object obj;
-		obj["id"] = *map->GetId();
-		obj["name"] = map->GetName();
-		obj["roads"] = AddRoads(map);
-		obj["buildings"] = AddBuildings(map);
-		obj["offices"] = AddOffices(map);
-		obj["lootTypes"] = AddLootTypes(map);
+		return SendCachedResponse(req, it->second, std::move(send));
+	}
+
+	// Отдаёт заранее сериализованное тело без копирования либо 304, если у клиента
+	// уже есть актуальная версия (заголовок If-None-Match)
+	template <typename Body, typename Allocator, typename Send>
+	void SendCachedResponse(const http::request<Body, http::basic_fields<Allocator>>& req,
+									const std::shared_ptr<const CachedResponse>& cached, Send&& send) const {
+		if (auto it = req.find(http::field::if_none_match);
+			 it != req.end() &&
+			 MatchesETag({it->value().data(), it->value().size()}, cached->etag)) {
+			http::response<http::empty_body, Fields> resp{http::status::not_modified, req.version()};
+			resp.set(http::field::etag, cached->etag);
+			resp.keep_alive(req.keep_alive());
+
+			return send(std::move(resp));
+		}
 
-		http::response<http::string_body> resp{http::status::ok, req.version()};
+		SharedResponse resp{http::status::ok, req.version()};
 		resp.set(http::field::content_type, "application/json");
-		resp.body() = json::serialize(obj);
+		resp.set(http::field::etag, cached->etag);
+		resp.body() = {cached, cached->body};
 		resp.keep_alive(req.keep_alive());
 		resp.prepare_payload();
 
@@ -225,7 +266,9 @@ class ApiHandler {
 	template <typename Body, typename Allocator, typename Send>
 	void JoinRequest(const http::request<Body, http::basic_fields<Allocator>>& req, Send&& send) {
 		auto ver = req.version();
-		CheckMethod(req, send, "POST");
+		if (!CheckMethod(req, send, "POST")) {
+			return;
+		}
 
 		std::optional<boost::json::object> obj = ParseJoinRequest(req);
 
@@ -253,31 +296,51 @@ class ApiHandler {
 	template <typename Body, typename Allocator, typename Send>
 	void PlayersRequest(const http::request<Body, http::basic_fields<Allocator>>& req, Send&& send) {
 		auto ver = req.version();
-		CheckMethod(req, send, "GET");
+		if (!CheckMethod(req, send, "GET")) {
+			return;
+		}
 
-		if (!CheckTokenAndPlayer(req, send)) {
+		const app::Player* player = CheckTokenAndPlayer(req, send);
+		if (!player) {
 			return;
 		}
 
-		return send(GoodPlayersRequest(req));
+		return send(GoodPlayersRequest(req, player->GetSession()));
 	}
 
 	template <typename Body, typename Allocator, typename Send>
-	void StateRequest(const http::request<Body, http::basic_fields<Allocator>>& req, Send&& send) {
+	void StateRequest(const EndPoint& endpoint,
+							const http::request<Body, http::basic_fields<Allocator>>& req, Send&& send) {
 		auto ver = req.version();
-		CheckMethod(req, send, "GET");
+		if (!CheckMethod(req, send, "GET")) {
+			return;
+		}
 
-		if (!CheckTokenAndPlayer(req, send)) {
+		const app::Player* player = CheckTokenAndPlayer(req, send);
+		if (!player) {
 			return;
 		}
 
-		return send(GoodStateRequest(req));
+		// ?since=N - только изменения сессии игрока после тика N
+		if (auto since_str = endpoint.GetQueryParam("since")) {
+			std::optional<uint64_t> since = ParseTickNumber(*since_str);
+			if (!since) {
+				return send(ErrorRequest("invalidArgument", "Invalid since parameter",
+												 http::status::bad_request, ver));
+			}
+
+			return send(DeltaStateRequest(req, player->GetSession(), *since));
+		}
+
+		return send(GoodStateRequest(req, player->GetSession()));
 	}
 
 	template <typename Body, typename Allocator, typename Send>
 	void MoveRequest(const http::request<Body, http::basic_fields<Allocator>>& req, Send&& send) {
 		auto ver = req.version();
-		CheckMethod(req, send, "POST");
+		if (!CheckMethod(req, send, "POST")) {
+			return;
+		}
 		app::Player* player = CheckTokenAndPlayer(req, send);
 		if (!player) {
 			return;
@@ -290,31 +353,15 @@ class ApiHandler {
 		}
 
 		std::string dir((*obj).at("move").as_string());
-
-		if (dir == "U") {
-			double def_speed = player->GetDefaultSpeed();
-			player->SetDirection(model::Direction::NORTH);
-			player->SetSpeed({0, -def_speed});
-		} else if (dir == "D") {
-			double def_speed = player->GetDefaultSpeed();
-			player->SetDirection(model::Direction::SOUTH);
-			player->SetSpeed({0, def_speed});
-		} else if (dir == "L") {
-			double def_speed = player->GetDefaultSpeed();
-			player->SetDirection(model::Direction::WEST);
-			player->SetSpeed({-def_speed, 0});
-		} else if (dir == "R") {
-			double def_speed = player->GetDefaultSpeed();
-			player->SetDirection(model::Direction::EAST);
-			player->SetSpeed({def_speed, 0});
-		} else if (dir.empty()) {
-			player->SetSpeed({0, 0});
-		} else {
+		if (!player->Move(dir)) {
 			return send(ErrorRequest("invalidArgument", "Failed to parse action",
 											 http::status::bad_request, ver));
 		}
 
-		return send(GoogMoveRequest(req));
+		state_saver_.OnMove(*player, dir);
+		state_view_.UpdatePlayer(*player);
+
+		return send(EmptyObjectResponse(req));
 	}
 
 	template <typename Body, typename Allocator, typename Send>
@@ -324,7 +371,9 @@ class ApiHandler {
 			return send(
 				 ErrorRequest("badRequest", "Invalid endpoint", http::status::bad_request, ver));
 		}
-		CheckMethod(req, send, "POST");
+		if (!CheckMethod(req, send, "POST")) {
+			return;
+		}
 
 		std::optional<json::object> obj = ParseTickRequest(req);
 		if (!obj) {
@@ -335,26 +384,32 @@ class ApiHandler {
 		int time_delta = static_cast<int>((*obj).at("timeDelta").as_int64());
 
 		state_saver_.Tick(time_delta);
+		state_view_.Publish();
 
-		return send(GoodTickRequest(req));
+		return send(EmptyObjectResponse(req));
 	}
 
-	json::array AddRoads(const model::Map* map) const;
-	json::array AddBuildings(const model::Map* map) const;
-	json::array AddOffices(const model::Map* map) const;
-	json::array AddLootTypes(const model::Map* map) const;
-	StringResponse ErrorRequest(std::string code, std::string message, http::status status,
-										 unsigned int ver, std::string allowed_method = "") const;
+	void CacheMapResponses();
+	static std::shared_ptr<const CachedResponse> MakeCachedResponse(std::string body);
+	static void WriteRoads(util::JsonWriter& writer, const model::Map& map);
+	static void WriteBuildings(util::JsonWriter& writer, const model::Map& map);
+	static void WriteOffices(util::JsonWriter& writer, const model::Map& map);
+	static void WriteLootTypes(util::JsonWriter& writer, const model::Map& map);
+	StringResponse ErrorRequest(std::string_view code, std::string_view message, http::status status,
+										 unsigned int ver, std::string_view allowed_method = {}) const;
 	StringResponse GoodJoinRequest(const model::Map* map, std::string username, unsigned int ver);
 	std::optional<json::object> ParseJoinRequest(const StringRequest& request);
-	std::string ExtractBearerToken(const beast::string_view auth_header);
-	std::optional<std::string> GetAuthToken(const StringRequest& request);
-	StringResponse GoodPlayersRequest(const StringRequest& req);
-	StringResponse GoodStateRequest(const StringRequest& req);
+	// Токен указывает внутрь заголовка и действителен, пока жив запрос
+	static std::string_view ExtractBearerToken(std::string_view auth_header);
+	static std::optional<std::string_view> GetAuthToken(const StringRequest& request);
+	SharedResponse GoodPlayersRequest(const StringRequest& req, const model::GameSession* session);
+	SharedResponse GoodStateRequest(const StringRequest& req, const model::GameSession* session);
+	StringResponse DeltaStateRequest(const StringRequest& req, const model::GameSession* session,
+												uint64_t since);
+	static std::optional<uint64_t> ParseTickNumber(std::string_view str);
 	std::optional<json::object> ParseMoveRequest(const StringRequest& request);
-	StringResponse GoogMoveRequest(const StringRequest& req);
+	StringResponse EmptyObjectResponse(const StringRequest& req) const;
 	std::optional<json::object> ParseTickRequest(const StringRequest& request);
-	StringResponse GoodTickRequest(const StringRequest& req);
 
 	model::Game& game_;
 	app::Players& players_;
@@ -362,6 +417,9 @@ class ApiHandler {
 	bool randomize_;
 	bool auto_tick_;
 	StateSaver& state_saver_;
+	app::StateView& state_view_;
+	std::shared_ptr<const CachedResponse> maps_response_;
+	std::unordered_map<std::string, std::shared_ptr<const CachedResponse>> map_responses_;
 };
 
 } // namespace http_handler
@@ -0,0 +1,140 @@
+#include "async_log.h"
+
+#include "logger.h"
+
+#include <boost/log/core/core.hpp>
+#include <boost/make_shared.hpp>
+
+#include <algorithm>
+#include <bit>
+
+namespace logger {
+
+RecordQueue::RecordQueue(size_t capacity)
+	 : cells_(std::bit_ceil(std::max<size_t>(capacity, 2))), mask_(cells_.size() - 1) {
+	for (size_t i = 0; i < cells_.size(); ++i) {
+		cells_[i].sequence.store(i, std::memory_order_relaxed);
+	}
+}
+
+bool RecordQueue::TryPush(std::string&& record) noexcept {
+	size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+	for (;;) {
+		Cell& cell = cells_[pos & mask_];
+		const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+		const auto diff = static_cast<std::ptrdiff_t>(sequence - pos);
+		if (diff == 0) {
+			// Ячейка свободна: занимаем её, сдвигая позицию записи
+			if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+				cell.data = std::move(record);
+				cell.sequence.store(pos + 1, std::memory_order_release);
+				return true;
+			}
+		} else if (diff < 0) {
+			// Читатель ещё не освободил ячейку с прошлого круга - очередь полна
+			return false;
+		} else {
+			pos = enqueue_pos_.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+bool RecordQueue::TryPop(std::string& record) noexcept {
+	Cell& cell = cells_[dequeue_pos_ & mask_];
+	const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+	if (static_cast<std::ptrdiff_t>(sequence - (dequeue_pos_ + 1)) < 0) {
+		return false;
+	}
+	record = std::move(cell.data);
+	cell.sequence.store(dequeue_pos_ + cells_.size(), std::memory_order_release);
+	++dequeue_pos_;
+	return true;
+}
+
+AsyncJsonBackend::AsyncJsonBackend(std::ostream& out, size_t capacity)
+	 : out_(out), queue_(capacity), writer_([this] { WriteLoop(); }) {}
+
+AsyncJsonBackend::~AsyncJsonBackend() { Stop(); }
+
+void AsyncJsonBackend::consume(const boost::log::record_view& rec) {
+	std::string line;
+	line.reserve(256);
+	WriteJsonRecord(rec, line);
+	line += '\n';
+
+	if (stopped_.load(std::memory_order_relaxed) || !queue_.TryPush(std::move(line))) {
+		dropped_.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	pushed_.fetch_add(1, std::memory_order_release);
+	pushed_.notify_one();
+}
+
+void AsyncJsonBackend::flush() {
+	const uint64_t target = pushed_.load(std::memory_order_acquire);
+	for (uint64_t written = written_.load(std::memory_order_acquire);
+		  written < target && !stopped_.load(std::memory_order_acquire);
+		  written = written_.load(std::memory_order_acquire)) {
+		written_.wait(written, std::memory_order_acquire);
+	}
+}
+
+void AsyncJsonBackend::Stop() {
+	if (stopped_.exchange(true)) {
+		return;
+	}
+	// Будим поток записи, даже если новых записей нет
+	pushed_.fetch_add(1, std::memory_order_release);
+	pushed_.notify_one();
+	written_.notify_all();
+	writer_.join();
+}
+
+void AsyncJsonBackend::WriteLoop() {
+	std::string batch;
+	batch.reserve(MAX_BATCH_BYTES);
+	std::string record;
+	for (;;) {
+		const uint64_t seen = pushed_.load(std::memory_order_acquire);
+		if (WriteBatch(batch, record)) {
+			continue;
+		}
+		if (stopped_.load(std::memory_order_acquire)) {
+			break;
+		}
+		pushed_.wait(seen, std::memory_order_acquire);
+	}
+	while (WriteBatch(batch, record)) {
+	}
+}
+
+bool AsyncJsonBackend::WriteBatch(std::string& batch, std::string& record) {
+	uint64_t count = 0;
+	while (batch.size() < MAX_BATCH_BYTES && queue_.TryPop(record)) {
+		batch += record;
+		++count;
+	}
+	if (count == 0) {
+		return false;
+	}
+
+	out_.write(batch.data(), static_cast<std::streamsize>(batch.size()));
+	out_.flush();
+	batch.clear();
+
+	written_.fetch_add(count, std::memory_order_release);
+	written_.notify_all();
+	return true;
+}
+
+AsyncLogSink::AsyncLogSink(std::ostream& out, size_t capacity)
+	 : sink_(boost::make_shared<Sink>(boost::make_shared<AsyncJsonBackend>(out, capacity))) {
+	boost::log::core::get()->add_sink(sink_);
+}
+
+AsyncLogSink::~AsyncLogSink() {
+	boost::log::core::get()->remove_sink(sink_);
+	sink_->locked_backend()->Stop();
+}
+
+} // namespace logger
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <boost/log/core/record_view.hpp>
+#include <boost/log/sinks/basic_sink_backend.hpp>
+#include <boost/log/sinks/frontend_requirements.hpp>
+#include <boost/log/sinks/unlocked_frontend.hpp>
+#include <boost/smart_ptr/shared_ptr.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace logger {
+
+/*
+ * Ограниченная очередь строк для многих писателей и одного читателя
+ * (кольцевой буфер Вьюкова). Писатель занимает ячейку одним CAS и не ждёт
+ * читателя: если очередь полна, TryPush сразу возвращает false.
+ */
+class RecordQueue {
+ public:
+	// capacity округляется вверх до степени двойки
+	explicit RecordQueue(size_t capacity);
+
+	RecordQueue(const RecordQueue&) = delete;
+	RecordQueue& operator=(const RecordQueue&) = delete;
+
+	bool TryPush(std::string&& record) noexcept;
+	// Вызывается только из одного потока
+	bool TryPop(std::string& record) noexcept;
+
+	size_t GetCapacity() const noexcept { return cells_.size(); }
+
+ private:
+	struct alignas(64) Cell {
+		std::atomic<size_t> sequence = 0;
+		std::string data;
+	};
+
+	std::vector<Cell> cells_;
+	size_t mask_;
+	alignas(64) std::atomic<size_t> enqueue_pos_ = 0;
+	alignas(64) size_t dequeue_pos_ = 0;
+};
+
+/*
+ * Приёмник Boost.Log, который кодирует запись в JSON в потоке, где она создана,
+ * и кладёт готовую строку в RecordQueue. Отдельный поток забирает строки пачками
+ * и пишет каждую пачку в out одним вызовом. При переполнении очереди запись
+ * отбрасывается, а не задерживает поток, который её создал.
+ */
+class AsyncJsonBackend
+	 : public boost::log::sinks::basic_sink_backend<boost::log::sinks::combine_requirements<
+			 boost::log::sinks::concurrent_feeding, boost::log::sinks::flushing>::type> {
+ public:
+	static constexpr size_t MAX_BATCH_BYTES = 64 * 1024;
+
+	AsyncJsonBackend(std::ostream& out, size_t capacity);
+	~AsyncJsonBackend();
+
+	void consume(const boost::log::record_view& rec);
+	// Ждёт, пока всё, что попало в очередь до вызова, будет записано
+	void flush();
+	// Дописывает очередь и останавливает поток записи. Последующие записи отбрасываются
+	void Stop();
+
+	uint64_t GetWrittenCount() const noexcept { return written_.load(std::memory_order_relaxed); }
+	uint64_t GetDroppedCount() const noexcept { return dropped_.load(std::memory_order_relaxed); }
+
+ private:
+	void WriteLoop();
+	// Забирает из очереди и записывает одну пачку. false - очередь была пуста
+	bool WriteBatch(std::string& batch, std::string& record);
+
+	std::ostream& out_;
+	RecordQueue queue_;
+	std::atomic<uint64_t> pushed_ = 0;
+	std::atomic<uint64_t> written_ = 0;
+	std::atomic<uint64_t> dropped_ = 0;
+	std::atomic<bool> stopped_ = false;
+	std::thread writer_;
+};
+
+/*
+ * Подключает AsyncJsonBackend к ядру Boost.Log вместо синхронного вывода в консоль.
+ * Деструктор отключает приёмник и дописывает всё, что осталось в очереди.
+ */
+class AsyncLogSink {
+ public:
+	AsyncLogSink(std::ostream& out, size_t capacity);
+	~AsyncLogSink();
+
+	AsyncLogSink(const AsyncLogSink&) = delete;
+	AsyncLogSink& operator=(const AsyncLogSink&) = delete;
+
+	const AsyncJsonBackend& GetBackend() const { return *sink_->locked_backend(); }
+
+ private:
+	using Sink = boost::log::sinks::unlocked_sink<AsyncJsonBackend>;
+
+	boost::shared_ptr<Sink> sink_;
+};
+
+} // namespace logger
@@ -0,0 +1,328 @@
+#pragma once
+
+#include <boost/crc.hpp>
+#include <boost/serialization/version.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+/*
+ * Компактный двоичный формат для тех же методов serialize(ar, version), что
+ * используются с текстовым архивом boost. Числа пишутся в little-endian фиксированной
+ * ширины, строки и контейнеры - с префиксом длины, версия класса - один раз на тип,
+ * как это делает boost.
+ */
+namespace serialization {
+
+namespace detail {
+
+template <typename T, template <typename...> typename Template>
+constexpr bool IS_SPECIALIZATION = false;
+
+template <template <typename...> typename Template, typename... Args>
+constexpr bool IS_SPECIALIZATION<Template<Args...>, Template> = true;
+
+// Номер типа в пределах процесса, по которому архив помнит уже записанные версии классов
+inline size_t NextTypeSlot() {
+	static std::atomic<size_t> next{0};
+	return next++;
+}
+
+template <typename T>
+size_t TypeSlot() {
+	static const size_t slot = NextTypeSlot();
+	return slot;
+}
+
+template <typename T>
+T ToLittleEndian(T value) {
+	if constexpr (std::endian::native == std::endian::big && sizeof(T) > 1) {
+		char bytes[sizeof(T)];
+		std::memcpy(bytes, &value, sizeof(T));
+		std::reverse(bytes, bytes + sizeof(T));
+		std::memcpy(&value, bytes, sizeof(T));
+	}
+	return value;
+}
+
+template <typename Archive, typename T>
+void SerializeObject(Archive& ar, T& value, unsigned version) {
+	if constexpr (requires { value.serialize(ar, version); }) {
+		value.serialize(ar, version);
+	} else {
+		serialize(ar, value, version);
+	}
+}
+
+} // namespace detail
+
+class BinaryOArchive {
+ public:
+	explicit BinaryOArchive(std::string& out) : out_(out) {}
+
+	template <typename T>
+	BinaryOArchive& operator&(const T& value) {
+		Save(value);
+		return *this;
+	}
+
+	template <typename T>
+	BinaryOArchive& operator<<(const T& value) {
+		Save(value);
+		return *this;
+	}
+
+ private:
+	template <typename T>
+	void Save(const T& value) {
+		if constexpr (std::is_arithmetic_v<T>) {
+			T le = detail::ToLittleEndian(value);
+			out_.append(reinterpret_cast<const char*>(&le), sizeof(T));
+		} else if constexpr (std::is_enum_v<T>) {
+			Save(static_cast<std::underlying_type_t<T>>(value));
+		} else if constexpr (std::is_same_v<T, std::string>) {
+			SaveSize(value.size());
+			out_ += value;
+		} else if constexpr (detail::IS_SPECIALIZATION<T, std::vector>) {
+			SaveSize(value.size());
+			using Item = typename T::value_type;
+			if constexpr (std::is_arithmetic_v<Item> && !std::is_same_v<Item, bool> &&
+							  std::endian::native == std::endian::little) {
+				out_.append(reinterpret_cast<const char*>(value.data()), value.size() * sizeof(Item));
+			} else {
+				for (const auto& item : value) {
+					Save(item);
+				}
+			}
+		} else if constexpr (detail::IS_SPECIALIZATION<T, std::deque>) {
+			SaveSize(value.size());
+			for (const auto& item : value) {
+				Save(item);
+			}
+		} else if constexpr (detail::IS_SPECIALIZATION<T, std::optional>) {
+			Save(value.has_value());
+			if (value) {
+				Save(*value);
+			}
+		} else {
+			const unsigned version = boost::serialization::version<T>::value;
+			const size_t slot = detail::TypeSlot<T>();
+			if (slot >= versions_saved_.size()) {
+				versions_saved_.resize(slot + 1, false);
+			}
+			if (!versions_saved_[slot]) {
+				SaveSize(version);
+				versions_saved_[slot] = true;
+			}
+			detail::SerializeObject(*this, const_cast<T&>(value), version);
+		}
+	}
+
+	// Длины и версии пишутся как LEB128: обычно это один байт
+	void SaveSize(uint64_t size) {
+		do {
+			char byte = static_cast<char>(size & 0x7F);
+			size >>= 7;
+			if (size != 0) {
+				byte |= static_cast<char>(0x80);
+			}
+			out_ += byte;
+		} while (size != 0);
+	}
+
+	std::string& out_;
+	std::vector<bool> versions_saved_;
+};
+
+class BinaryIArchive {
+ public:
+	// data должна жить, пока архив читается. Подходит и отображённый в память файл
+	explicit BinaryIArchive(std::string_view data) : data_(data) {}
+
+	template <typename T>
+	BinaryIArchive& operator&(T& value) {
+		Load(value);
+		return *this;
+	}
+
+	template <typename T>
+	BinaryIArchive& operator>>(T& value) {
+		Load(value);
+		return *this;
+	}
+
+	bool AtEnd() const noexcept { return pos_ == data_.size(); }
+
+ private:
+	template <typename T>
+	void Load(T& value) {
+		if constexpr (std::is_arithmetic_v<T>) {
+			std::memcpy(&value, Take(sizeof(T)), sizeof(T));
+			value = detail::ToLittleEndian(value);
+		} else if constexpr (std::is_enum_v<T>) {
+			std::underlying_type_t<T> underlying;
+			Load(underlying);
+			value = static_cast<T>(underlying);
+		} else if constexpr (std::is_same_v<T, std::string>) {
+			const size_t size = LoadSize(1);
+			value.assign(Take(size), size);
+		} else if constexpr (detail::IS_SPECIALIZATION<T, std::vector>) {
+			using Item = typename T::value_type;
+			if constexpr (std::is_arithmetic_v<Item> && !std::is_same_v<Item, bool> &&
+							  std::endian::native == std::endian::little) {
+				const size_t size = LoadSize(sizeof(Item));
+				value.resize(size);
+				std::memcpy(value.data(), Take(size * sizeof(Item)), size * sizeof(Item));
+			} else {
+				const size_t size = LoadSize(1);
+				value.clear();
+				value.reserve(size);
+				for (size_t i = 0; i < size; ++i) {
+					Load(value.emplace_back());
+				}
+			}
+		} else if constexpr (detail::IS_SPECIALIZATION<T, std::deque>) {
+			const size_t size = LoadSize(1);
+			value.clear();
+			for (size_t i = 0; i < size; ++i) {
+				Load(value.emplace_back());
+			}
+		} else if constexpr (detail::IS_SPECIALIZATION<T, std::optional>) {
+			bool has_value = false;
+			Load(has_value);
+			if (has_value) {
+				Load(value.emplace());
+			} else {
+				value.reset();
+			}
+		} else {
+			const size_t slot = detail::TypeSlot<T>();
+			if (slot >= versions_loaded_.size()) {
+				versions_loaded_.resize(slot + 1);
+			}
+			if (!versions_loaded_[slot]) {
+				versions_loaded_[slot] = static_cast<unsigned>(LoadSize(0));
+			}
+			detail::SerializeObject(*this, value, *versions_loaded_[slot]);
+		}
+	}
+
+	// item_size - минимальный размер элемента, чтобы повреждённая длина
+	// не приводила к огромному выделению памяти
+	uint64_t LoadSize(size_t item_size) {
+		uint64_t size = 0;
+		for (int shift = 0;; shift += 7) {
+			if (shift > 63) {
+				throw std::runtime_error("Invalid length in binary state");
+			}
+			const auto byte = static_cast<unsigned char>(*Take(1));
+			size |= static_cast<uint64_t>(byte & 0x7F) << shift;
+			if (!(byte & 0x80)) {
+				break;
+			}
+		}
+		if (item_size != 0 && size > (data_.size() - pos_) / item_size) {
+			throw std::runtime_error("Invalid length in binary state");
+		}
+		return size;
+	}
+
+	const char* Take(size_t size) {
+		if (size > data_.size() - pos_) {
+			throw std::runtime_error("Unexpected end of binary state");
+		}
+		const char* ptr = data_.data() + pos_;
+		pos_ += size;
+		return ptr;
+	}
+
+	std::string_view data_;
+	size_t pos_ = 0;
+	std::vector<std::optional<unsigned>> versions_loaded_;
+};
+
+/*
+ * Файл состояния: заголовок BINARY_STATE_HEADER_SIZE байт и данные архива.
+ * Заголовок: сигнатура, версия формата, флаги, размер данных и CRC32 данных.
+ */
+constexpr std::string_view BINARY_STATE_MAGIC{"DOGSTATE", 8};
+constexpr uint32_t BINARY_STATE_FORMAT_VERSION = 1;
+constexpr size_t BINARY_STATE_HEADER_SIZE = 32;
+constexpr uint32_t BINARY_STATE_CHECKSUM_FLAG = 1;
+
+inline bool IsBinaryState(std::string_view data) {
+	return data.substr(0, BINARY_STATE_MAGIC.size()) == BINARY_STATE_MAGIC;
+}
+
+template <typename T>
+std::string SaveBinaryState(const T& value, bool checksum = true, size_t size_hint = 0) {
+	std::string out;
+	out.reserve(BINARY_STATE_HEADER_SIZE + size_hint);
+	out.resize(BINARY_STATE_HEADER_SIZE);
+	BinaryOArchive{out} << value;
+
+	const std::string_view payload = std::string_view(out).substr(BINARY_STATE_HEADER_SIZE);
+	uint32_t crc = 0;
+	if (checksum) {
+		boost::crc_32_type crc32;
+		crc32.process_bytes(payload.data(), payload.size());
+		crc = crc32.checksum();
+	}
+
+	std::string header;
+	BinaryOArchive header_archive{header};
+	header.append(BINARY_STATE_MAGIC);
+	header_archive << BINARY_STATE_FORMAT_VERSION
+						<< (checksum ? BINARY_STATE_CHECKSUM_FLAG : uint32_t{0})
+						<< static_cast<uint64_t>(payload.size()) << crc << uint32_t{0};
+	out.replace(0, BINARY_STATE_HEADER_SIZE, header);
+
+	return out;
+}
+
+template <typename T>
+void LoadBinaryState(std::string_view data, T& value) {
+	if (data.size() < BINARY_STATE_HEADER_SIZE || !IsBinaryState(data)) {
+		throw std::runtime_error("Not a binary state file");
+	}
+
+	uint32_t format_version = 0;
+	uint32_t flags = 0;
+	uint64_t payload_size = 0;
+	uint32_t crc = 0;
+	BinaryIArchive header{data.substr(BINARY_STATE_MAGIC.size(), BINARY_STATE_HEADER_SIZE)};
+	header >> format_version >> flags >> payload_size >> crc;
+
+	if (format_version > BINARY_STATE_FORMAT_VERSION) {
+		throw std::runtime_error("Unsupported binary state version");
+	}
+	const std::string_view payload = data.substr(BINARY_STATE_HEADER_SIZE);
+	if (payload.size() != payload_size) {
+		throw std::runtime_error("Binary state is truncated");
+	}
+	if (flags & BINARY_STATE_CHECKSUM_FLAG) {
+		boost::crc_32_type crc32;
+		crc32.process_bytes(payload.data(), payload.size());
+		if (crc32.checksum() != crc) {
+			throw std::runtime_error("Binary state checksum mismatch");
+		}
+	}
+
+	BinaryIArchive archive{payload};
+	archive >> value;
+	if (!archive.AtEnd()) {
+		throw std::runtime_error("Unexpected data after binary state");
+	}
+}
+
+} // namespace serialization
@@ -1,8 +1,202 @@
 #include "collision_detector.h"
 #include <cassert>
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 namespace collision_detector {
 
+namespace {
+
+// При количестве пар "собиратель-предмет" не больше этого порога сетка не окупает
+// своё построение, и события ищутся полным перебором
+constexpr size_t BRUTE_FORCE_PAIRS_THRESHOLD = 256;
+
+// Запас, на который расширяется область поиска вокруг отрезка собирателя,
+// чтобы погрешность вычисления sq_distance не отбросила собираемый предмет
+constexpr double SEARCH_MARGIN = 1e-6;
+
+bool IsStaying(const Gatherer& gatherer) {
+	return gatherer.start_pos.x == gatherer.end_pos.x && gatherer.start_pos.y == gatherer.end_pos.y;
+}
+
+// Предметы, координаты и ширины которых лежат подряд
+struct ItemsBlock {
+	const double* xs;
+	const double* ys;
+	const double* widths;
+	size_t count;
+};
+
+/*
+ * Проверяет собирателя с блоком предметов и добавляет найденные события в result.
+ * id_of(i) возвращает номер i-го предмета блока в ItemGathererProvider.
+ */
+class BlockGatherer {
+ public:
+	explicit BlockGatherer(size_t max_block_size)
+		 : sq_distances_(max_block_size), proj_ratios_(max_block_size) {}
+
+	template <typename IdOf>
+	void Gather(const Gatherer& gatherer, size_t g_id, ItemsBlock block, IdOf&& id_of,
+					std::vector<GatheringEvent>& result) {
+		assert(block.count <= sq_distances_.size());
+		TryCollectPoints(gatherer.start_pos, gatherer.end_pos, block.xs, block.ys, block.count,
+							  sq_distances_.data(), proj_ratios_.data());
+
+		for (size_t i = 0; i < block.count; ++i) {
+			const CollectionResult res{sq_distances_[i], proj_ratios_[i]};
+			if (res.IsCollected(block.widths[i] + gatherer.width)) {
+				result.push_back(GatheringEvent{/*item_id*/ id_of(i),
+														  /*gatherer_id*/ g_id,
+														  /*sq_distance*/ res.sq_distance,
+														  /*time*/ res.proj_ratio});
+			}
+		}
+	}
+
+ private:
+	std::vector<double> sq_distances_;
+	std::vector<double> proj_ratios_;
+};
+
+void SortEvents(std::vector<GatheringEvent>& events) {
+	std::sort(events.begin(), events.end(),
+				 [](const GatheringEvent& lhs, const GatheringEvent& rhs) {
+					 if (lhs.time != rhs.time) {
+						 return lhs.time < rhs.time;
+					 }
+					 if (lhs.sq_distance != rhs.sq_distance) {
+						 return lhs.sq_distance < rhs.sq_distance;
+					 }
+					 if (lhs.gatherer_id != rhs.gatherer_id) {
+						 return lhs.gatherer_id < rhs.gatherer_id;
+					 }
+					 return lhs.item_id < rhs.item_id;
+				 });
+}
+
+/*
+ * Равномерная сетка поверх предметов. Каждый предмет попадает ровно в одну ячейку,
+ * поэтому обход ячеек, покрытых прямоугольником, не даёт повторов.
+ * Размер ячейки подбирается так, чтобы ячеек было порядка количества предметов.
+ * Координаты предметов переупорядочены по ячейкам, так что ячейки одного ряда
+ * образуют непрерывный блок для пакетной проверки.
+ */
+class ItemGrid {
+ public:
+	explicit ItemGrid(const ItemGathererProvider& provider) {
+		const size_t items_count = provider.ItemsCount();
+		assert(items_count > 0);
+		const double* xs = provider.ItemsX();
+		const double* ys = provider.ItemsY();
+		const double* widths = provider.ItemsWidth();
+
+		min_x_ = max_x_ = xs[0];
+		min_y_ = max_y_ = ys[0];
+		for (size_t i_id = 0; i_id < items_count; ++i_id) {
+			min_x_ = std::min(min_x_, xs[i_id]);
+			max_x_ = std::max(max_x_, xs[i_id]);
+			min_y_ = std::min(min_y_, ys[i_id]);
+			max_y_ = std::max(max_y_, ys[i_id]);
+			max_item_width_ = std::max(max_item_width_, widths[i_id]);
+		}
+
+		const double width = max_x_ - min_x_;
+		const double height = max_y_ - min_y_;
+		cell_size_ = std::max(std::sqrt(width * height / items_count),
+									 std::max(width, height) / items_count);
+		if (!(cell_size_ > 0)) {
+			cell_size_ = 1.0;
+		}
+		cols_ = static_cast<size_t>(width / cell_size_) + 1;
+		rows_ = static_cast<size_t>(height / cell_size_) + 1;
+
+		std::vector<size_t> cells(items_count);
+		cell_start_.assign(cols_ * rows_ + 1, 0);
+		for (size_t i_id = 0; i_id < items_count; ++i_id) {
+			cells[i_id] = ToRow(ys[i_id]) * cols_ + ToCol(xs[i_id]);
+			++cell_start_[cells[i_id] + 1];
+		}
+		for (size_t cell = 1; cell < cell_start_.size(); ++cell) {
+			cell_start_[cell] += cell_start_[cell - 1];
+		}
+
+		item_ids_.resize(items_count);
+		xs_.resize(items_count);
+		ys_.resize(items_count);
+		widths_.resize(items_count);
+		std::vector<size_t> fill(cell_start_.begin(), cell_start_.end() - 1);
+		for (size_t i_id = 0; i_id < items_count; ++i_id) {
+			const size_t idx = fill[cells[i_id]]++;
+			item_ids_[idx] = i_id;
+			xs_[idx] = xs[i_id];
+			ys_[idx] = ys[i_id];
+			widths_[idx] = widths[i_id];
+		}
+	}
+
+	double GetMaxItemWidth() const { return max_item_width_; }
+
+	size_t GetItemId(size_t idx) const { return item_ids_[idx]; }
+
+	// Вызывает fn(first, block) для каждого ряда ячеек, пересекающих прямоугольник.
+	// first - позиция начала блока, по которой GetItemId находит номера его предметов
+	template <typename Fn>
+	void ForEachCandidateBlock(geom::Point2D min, geom::Point2D max, Fn&& fn) const {
+		if (max.x < min_x_ || min.x > max_x_ || max.y < min_y_ || min.y > max_y_) {
+			return;
+		}
+
+		const size_t col_begin = ToCol(min.x);
+		const size_t col_end = ToCol(max.x);
+		const size_t row_begin = ToRow(min.y);
+		const size_t row_end = ToRow(max.y);
+
+		for (size_t row = row_begin; row <= row_end; ++row) {
+			const size_t first = cell_start_[row * cols_ + col_begin];
+			const size_t last = cell_start_[row * cols_ + col_end + 1];
+			if (first != last) {
+				fn(first, ItemsBlock{xs_.data() + first, ys_.data() + first, widths_.data() + first,
+											last - first});
+			}
+		}
+	}
+
+ private:
+	size_t ToCell(double offset, size_t count) const {
+		if (!(offset > 0)) {
+			return 0;
+		}
+		return std::min(static_cast<size_t>(offset / cell_size_), count - 1);
+	}
+
+	size_t ToCol(double x) const { return ToCell(x - min_x_, cols_); }
+
+	size_t ToRow(double y) const { return ToCell(y - min_y_, rows_); }
+
+	double min_x_ = 0;
+	double min_y_ = 0;
+	double max_x_ = 0;
+	double max_y_ = 0;
+	double max_item_width_ = 0;
+	double cell_size_ = 1.0;
+	size_t cols_ = 1;
+	size_t rows_ = 1;
+	// Предметы ячейки cell лежат на позициях [cell_start_[cell], cell_start_[cell + 1])
+	std::vector<size_t> cell_start_;
+	std::vector<size_t> item_ids_;
+	std::vector<double> xs_;
+	std::vector<double> ys_;
+	std::vector<double> widths_;
+};
+
+} // namespace
+
 CollectionResult TryCollectPoint(geom::Point2D a, geom::Point2D b, geom::Point2D c) {
 	assert(b.x != a.x || b.y != a.y);
 	const double u_x = c.x - a.x;
@@ -18,50 +212,114 @@ CollectionResult TryCollectPoint(geom::Point2D a, geom::Point2D b, geom::Point2D
 	return CollectionResult(sq_distance, proj_ratio);
 }
 
-std::vector<GatheringEvent> FindGatherEvents(const ItemGathererProvider& provider) {
+// Векторные ветки повторяют порядок операций TryCollectPoint, поэтому без FMA
+// результаты получаются побитово такими же
+void TryCollectPoints(geom::Point2D a, geom::Point2D b, const double* xs, const double* ys,
+							 size_t count, double* sq_distances, double* proj_ratios) {
+	assert(b.x != a.x || b.y != a.y);
+	size_t i = 0;
+
+#if defined(__AVX__)
+	const double v_x = b.x - a.x;
+	const double v_y = b.y - a.y;
+	const __m256d a_x4 = _mm256_set1_pd(a.x);
+	const __m256d a_y4 = _mm256_set1_pd(a.y);
+	const __m256d v_x4 = _mm256_set1_pd(v_x);
+	const __m256d v_y4 = _mm256_set1_pd(v_y);
+	const __m256d v_len2 = _mm256_set1_pd(v_x * v_x + v_y * v_y);
+
+	for (; i + 4 <= count; i += 4) {
+		const __m256d u_x = _mm256_sub_pd(_mm256_loadu_pd(xs + i), a_x4);
+		const __m256d u_y = _mm256_sub_pd(_mm256_loadu_pd(ys + i), a_y4);
+		const __m256d u_dot_v = _mm256_add_pd(_mm256_mul_pd(u_x, v_x4), _mm256_mul_pd(u_y, v_y4));
+		const __m256d u_len2 = _mm256_add_pd(_mm256_mul_pd(u_x, u_x), _mm256_mul_pd(u_y, u_y));
+		_mm256_storeu_pd(proj_ratios + i, _mm256_div_pd(u_dot_v, v_len2));
+		_mm256_storeu_pd(sq_distances + i,
+							  _mm256_sub_pd(u_len2, _mm256_div_pd(_mm256_mul_pd(u_dot_v, u_dot_v), v_len2)));
+	}
+#elif defined(__SSE2__)
+	const double v_x = b.x - a.x;
+	const double v_y = b.y - a.y;
+	const __m128d a_x2 = _mm_set1_pd(a.x);
+	const __m128d a_y2 = _mm_set1_pd(a.y);
+	const __m128d v_x2 = _mm_set1_pd(v_x);
+	const __m128d v_y2 = _mm_set1_pd(v_y);
+	const __m128d v_len2 = _mm_set1_pd(v_x * v_x + v_y * v_y);
+
+	for (; i + 2 <= count; i += 2) {
+		const __m128d u_x = _mm_sub_pd(_mm_loadu_pd(xs + i), a_x2);
+		const __m128d u_y = _mm_sub_pd(_mm_loadu_pd(ys + i), a_y2);
+		const __m128d u_dot_v = _mm_add_pd(_mm_mul_pd(u_x, v_x2), _mm_mul_pd(u_y, v_y2));
+		const __m128d u_len2 = _mm_add_pd(_mm_mul_pd(u_x, u_x), _mm_mul_pd(u_y, u_y));
+		_mm_storeu_pd(proj_ratios + i, _mm_div_pd(u_dot_v, v_len2));
+		_mm_storeu_pd(sq_distances + i,
+						  _mm_sub_pd(u_len2, _mm_div_pd(_mm_mul_pd(u_dot_v, u_dot_v), v_len2)));
+	}
+#endif
+
+	for (; i < count; ++i) {
+		const CollectionResult res = TryCollectPoint(a, b, {xs[i], ys[i]});
+		sq_distances[i] = res.sq_distance;
+		proj_ratios[i] = res.proj_ratio;
+	}
+}
+
+std::vector<GatheringEvent> FindGatherEventsBruteForce(const ItemGathererProvider& provider) {
 	std::vector<GatheringEvent> result;
 
 	const size_t gatherers_count = provider.GatherersCount();
 	const size_t items_count = provider.ItemsCount();
+	const ItemsBlock items{provider.ItemsX(), provider.ItemsY(), provider.ItemsWidth(), items_count};
+	BlockGatherer block_gatherer{items_count};
 
 	for (size_t g_id = 0; g_id < gatherers_count; ++g_id) {
-		const auto gatherer = provider.GetGatherer(g_id);
+		const Gatherer& gatherer = provider.GetGatherer(g_id);
 
-		if (gatherer.start_pos.x == gatherer.end_pos.x &&
-			 gatherer.start_pos.y == gatherer.end_pos.y) {
+		if (IsStaying(gatherer)) {
 			continue;
 		}
 
-		for (size_t i_id = 0; i_id < items_count; ++i_id) {
-			const auto item = provider.GetItem(i_id);
+		block_gatherer.Gather(gatherer, g_id, items, [](size_t i) { return i; }, result);
+	}
 
-			const double collect_radius = item.width + gatherer.width;
+	SortEvents(result);
 
-			const CollectionResult res =
-				 TryCollectPoint(gatherer.start_pos, gatherer.end_pos, item.position);
+	return result;
+}
 
-			if (res.IsCollected(collect_radius)) {
-				result.push_back(GatheringEvent{/*item_id*/ i_id,
-														  /*gatherer_id*/ g_id,
-														  /*sq_distance*/ res.sq_distance,
-														  /*time*/ res.proj_ratio});
-			}
+std::vector<GatheringEvent> FindGatherEvents(const ItemGathererProvider& provider) {
+	const size_t gatherers_count = provider.GatherersCount();
+	const size_t items_count = provider.ItemsCount();
+
+	if (items_count == 0 || gatherers_count * items_count <= BRUTE_FORCE_PAIRS_THRESHOLD) {
+		return FindGatherEventsBruteForce(provider);
+	}
+
+	std::vector<GatheringEvent> result;
+	const ItemGrid grid{provider};
+	BlockGatherer block_gatherer{items_count};
+
+	for (size_t g_id = 0; g_id < gatherers_count; ++g_id) {
+		const Gatherer& gatherer = provider.GetGatherer(g_id);
+
+		if (IsStaying(gatherer)) {
+			continue;
 		}
+
+		const double reach = gatherer.width + grid.GetMaxItemWidth() + SEARCH_MARGIN;
+		const geom::Point2D min{std::min(gatherer.start_pos.x, gatherer.end_pos.x) - reach,
+										std::min(gatherer.start_pos.y, gatherer.end_pos.y) - reach};
+		const geom::Point2D max{std::max(gatherer.start_pos.x, gatherer.end_pos.x) + reach,
+										std::max(gatherer.start_pos.y, gatherer.end_pos.y) + reach};
+
+		grid.ForEachCandidateBlock(min, max, [&](size_t first, ItemsBlock block) {
+			block_gatherer.Gather(
+				 gatherer, g_id, block, [&grid, first](size_t i) { return grid.GetItemId(first + i); },
+				 result);
+		});
 	}
 
-	std::sort(result.begin(), result.end(),
-				 [](const GatheringEvent& lhs, const GatheringEvent& rhs) {
-					 if (lhs.time != rhs.time) {
-						 return lhs.time < rhs.time;
-					 }
-					 if (lhs.sq_distance != rhs.sq_distance) {
-						 return lhs.sq_distance < rhs.sq_distance;
-					 }
-					 if (lhs.gatherer_id != rhs.gatherer_id) {
-						 return lhs.gatherer_id < rhs.gatherer_id;
-					 }
-					 return lhs.item_id < rhs.item_id;
-				 });
+	SortEvents(result);
 
 	return result;
 }
@@ -3,6 +3,7 @@
 #include "geom.h"
 
 #include <algorithm>
+#include <cassert>
 #include <vector>
 
 namespace collision_detector {
@@ -19,6 +20,12 @@ struct CollectionResult {
 
 CollectionResult TryCollectPoint(geom::Point2D a, geom::Point2D b, geom::Point2D c);
 
+// Пакетный вариант TryCollectPoint для точек {xs[i], ys[i]}, i из [0, count).
+// Результаты побитово совпадают с TryCollectPoint. Набор SIMD-инструкций (AVX или SSE2)
+// выбирается при компиляции, при их отсутствии используется скалярный код
+void TryCollectPoints(geom::Point2D a, geom::Point2D b, const double* xs, const double* ys,
+							 size_t count, double* sq_distances, double* proj_ratios);
+
 struct Item {
 	geom::Point2D position;
 	double width;
@@ -35,18 +42,39 @@ class ItemGathererProvider {
  public:
 	size_t ItemsCount() const { return items_.size(); }
 
-	Item GetItem(size_t idx) const { return items_.at(idx); }
+	const Item& GetItem(size_t idx) const {
+		assert(idx < items_.size());
+		return items_[idx];
+	}
+
+	// Координаты и ширины предметов, хранящиеся подряд для пакетной обработки
+	const double* ItemsX() const { return items_x_.data(); }
+
+	const double* ItemsY() const { return items_y_.data(); }
+
+	const double* ItemsWidth() const { return items_width_.data(); }
 
 	size_t GatherersCount() const { return gatherers_.size(); }
 
-	Gatherer GetGatherer(size_t idx) const { return gatherers_.at(idx); }
+	const Gatherer& GetGatherer(size_t idx) const {
+		assert(idx < gatherers_.size());
+		return gatherers_[idx];
+	}
 
-	void AddItem(Item item) { items_.push_back(item); }
+	void AddItem(Item item) {
+		items_.push_back(item);
+		items_x_.push_back(item.position.x);
+		items_y_.push_back(item.position.y);
+		items_width_.push_back(item.width);
+	}
 
 	void AddGatherer(Gatherer gatherer) { gatherers_.push_back(gatherer); }
 
  private:
 	std::vector<Item> items_;
+	std::vector<double> items_x_;
+	std::vector<double> items_y_;
+	std::vector<double> items_width_;
 	std::vector<Gatherer> gatherers_;
 };
 
@@ -57,7 +85,11 @@ struct GatheringEvent {
 	double time;
 };
 
+// Находит события сбора, отсекая заведомо далёкие предметы по равномерной сетке
 std::vector<GatheringEvent> FindGatherEvents(const ItemGathererProvider& provider);
 
+// Эталонная реализация: проверяет каждого собирателя с каждым предметом
+std::vector<GatheringEvent> FindGatherEventsBruteForce(const ItemGathererProvider& provider);
+
 } // namespace collision_detector
 
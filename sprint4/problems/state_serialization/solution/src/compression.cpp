@@ -0,0 +1,45 @@
+#include "compression.h"
+
+#include <brotli/encode.h>
+#include <zlib.h>
+
+#include <stdexcept>
+
+namespace util {
+
+std::string GzipCompress(std::string_view data, int level) {
+	z_stream stream{};
+	// 16 + MAX_WBITS - формат gzip с заголовком и контрольной суммой, а не голый deflate
+	if (deflateInit2(&stream, level, Z_DEFLATED, 16 + MAX_WBITS, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+		throw std::runtime_error("Failed to initialize gzip compression");
+	}
+
+	std::string out(deflateBound(&stream, data.size()), '\0');
+	stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+	stream.avail_in = static_cast<uInt>(data.size());
+	stream.next_out = reinterpret_cast<Bytef*>(out.data());
+	stream.avail_out = static_cast<uInt>(out.size());
+
+	const int result = deflate(&stream, Z_FINISH);
+	const size_t size = stream.total_out;
+	deflateEnd(&stream);
+	if (result != Z_STREAM_END) {
+		throw std::runtime_error("Failed to gzip data");
+	}
+	out.resize(size);
+	return out;
+}
+
+std::string BrotliCompress(std::string_view data, int quality) {
+	size_t size = BrotliEncoderMaxCompressedSize(data.size());
+	std::string out(size, '\0');
+	if (!BrotliEncoderCompress(quality, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_GENERIC, data.size(),
+										reinterpret_cast<const uint8_t*>(data.data()), &size,
+										reinterpret_cast<uint8_t*>(out.data()))) {
+		throw std::runtime_error("Failed to compress data with brotli");
+	}
+	out.resize(size);
+	return out;
+}
+
+} // namespace util
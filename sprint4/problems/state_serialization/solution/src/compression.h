@@ -0,0 +1,12 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+namespace util {
+
+// Сжатие заранее, при загрузке статики, поэтому уровни выбраны ближе к максимальным
+std::string GzipCompress(std::string_view data, int level = 9);
+std::string BrotliCompress(std::string_view data, int quality = 9);
+
+} // namespace util
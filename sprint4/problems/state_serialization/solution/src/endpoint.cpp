@@ -1,5 +1,13 @@
 #include "endpoint.h"
 
+EndPoint::EndPoint(std::string_view endpoint) {
+	size_t question = endpoint.find('?');
+	endpoint_ = endpoint.substr(0, question);
+	if (question != std::string_view::npos) {
+		query_ = endpoint.substr(question + 1);
+	}
+}
+
 bool EndPoint::IsApiReq() const {
 	return endpoint_.starts_with("/api");
 }
@@ -32,7 +40,33 @@ bool EndPoint::IsTickReq() const {
 	return endpoint_ == "/api/v1/game/tick";
 }
 
-const std::string& EndPoint::GetEndPoint() const {
+bool EndPoint::IsMetricsReq() const {
+	return endpoint_ == "/metrics";
+}
+
+std::string_view EndPoint::GetEndPoint() const {
 	return endpoint_;
 }
 
+
+std::string_view EndPoint::GetQuery() const {
+	return query_;
+}
+
+std::optional<std::string_view> EndPoint::GetQueryParam(std::string_view name) const {
+	std::string_view query = query_;
+	while (!query.empty()) {
+		size_t amp = query.find('&');
+		std::string_view param = query.substr(0, amp);
+		size_t eq = param.find('=');
+		if (param.substr(0, eq) == name) {
+			return eq == std::string_view::npos ? std::string_view{} : param.substr(eq + 1);
+		}
+		if (amp == std::string_view::npos) {
+			break;
+		}
+		query.remove_prefix(amp + 1);
+	}
+
+	return std::nullopt;
+}
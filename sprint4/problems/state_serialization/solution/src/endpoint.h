@@ -1,11 +1,14 @@
 #pragma once
 
-#include <string>
+#include <optional>
+#include <string_view>
 
+// Разбирает target запроса, не копируя его: target должен жить дольше EndPoint
 class EndPoint {
  public:
-	explicit EndPoint(const std::string& endpoint) : endpoint_(endpoint) {}
-	
+	// Строка запроса после '?' отделяется от пути и доступна через GetQuery
+	explicit EndPoint(std::string_view endpoint);
+
 	bool IsApiReq() const;
 	bool IsMapsReq() const;
 	bool IsSpecificMapReq() const;
@@ -14,9 +17,13 @@ class EndPoint {
 	bool IsStateReq() const;
 	bool IsActionReq() const;
 	bool IsTickReq() const;
-	const std::string& GetEndPoint() const;
+	bool IsMetricsReq() const;
+	std::string_view GetEndPoint() const;
+	std::string_view GetQuery() const;
+	std::optional<std::string_view> GetQueryParam(std::string_view name) const;
 
  private:
-	std::string endpoint_;
+	std::string_view endpoint_;
+	std::string_view query_;
 };
 
@@ -0,0 +1,33 @@
+#include "file_util.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <stdexcept>
+
+namespace util {
+
+void WriteAll(int fd, std::string_view data) {
+	while (!data.empty()) {
+		ssize_t written = ::write(fd, data.data(), data.size());
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			throw std::runtime_error("Failed to write file");
+		}
+		data.remove_prefix(static_cast<size_t>(written));
+	}
+}
+
+void SyncDirectory(const std::filesystem::path& dir) {
+	const std::filesystem::path& path = dir.empty() ? std::filesystem::path{"."} : dir;
+	int fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd >= 0) {
+		::fsync(fd);
+		::close(fd);
+	}
+}
+
+} // namespace util
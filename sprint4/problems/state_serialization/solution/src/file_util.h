@@ -0,0 +1,14 @@
+#pragma once
+
+#include <filesystem>
+#include <string_view>
+
+namespace util {
+
+// Пишет data в fd целиком, повторяя прерванные вызовы write
+void WriteAll(int fd, std::string_view data);
+
+// Созданные и переименованные в каталоге файлы переживают сбой питания только после fsync каталога
+void SyncDirectory(const std::filesystem::path& dir);
+
+} // namespace util
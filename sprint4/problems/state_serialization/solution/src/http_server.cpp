@@ -2,15 +2,44 @@
 
 #include <boost/asio/dispatch.hpp>
 
+#include <algorithm>
+#include <stdexcept>
+
 using namespace std::literals;
 
 namespace http_server {
 
-SessionBase::SessionBase(tcp::socket&& socket) : stream_(std::move(socket)) {}
+namespace {
+
+// Безопасные методы ничего не меняют, и порядок их выполнения неважен (RFC 9110, 9.2.1)
+bool IsSafeMethod(http::verb method) {
+	return method == http::verb::get || method == http::verb::head ||
+			 method == http::verb::options || method == http::verb::trace;
+}
+
+} // namespace
+
+void SetReusePort(tcp::acceptor& acceptor) {
+#ifdef SO_REUSEPORT
+	using ReusePort = net::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+	acceptor.set_option(ReusePort(true));
+#else
+	throw std::runtime_error("SO_REUSEPORT is not supported on this platform"s);
+#endif
+}
+
+SessionBase::SessionBase(StrandSocket&& socket, size_t pipeline_limit)
+	 : socket_(std::move(socket)), timer_(socket_.get_executor()),
+		slots_(std::max<size_t>(pipeline_limit, 1)) {
+	// Ответы на конвейер запросов уходят несколькими записями подряд. С алгоритмом Нейгла
+	// каждая следующая ждала бы отложенного подтверждения клиента
+	beast::error_code ec;
+	socket_.set_option(tcp::no_delay(true), ec);
+}
 
 std::string SessionBase::GetRemoteAddress() const {
 	beast::error_code ec;
-	auto endpoint = stream_.socket().remote_endpoint(ec);
+	auto endpoint = socket_.remote_endpoint(ec);
 	if (ec) {
 		return "";
 	}
@@ -18,47 +47,125 @@ std::string SessionBase::GetRemoteAddress() const {
 }
 
 void SessionBase::Run() {
-	net::dispatch(stream_.get_executor(),
-					  beast::bind_front_handler(&SessionBase::Read, GetSharedThis()));
+	net::dispatch(socket_.get_executor(), [self = GetSharedThis()] {
+		self->deadline_ = Clock::now() + IO_TIMEOUT;
+		self->StartTimer();
+		self->Read();
+	});
 }
 
 void SessionBase::Read() {
-	using namespace std::literals;
+	if (reading_ || read_closed_ || next_request_ - next_response_ >= slots_.size() ||
+		 next_response_ < unsafe_request_end_) {
+		return;
+	}
+	reading_ = true;
+	// Объект запроса не переиспользуется: обработчик забирает его вместе с телом и полями,
+	// и у перемещённого запроса не остаётся памяти, которую можно было бы сохранить.
+	// Память полей берётся из кэша блоков потока (Fields), так что новый запрос обходится
+	// без malloc, а ёмкость buffer_ сохраняется между запросами
 	request_ = {};
-	stream_.expires_after(30s);
-	http::async_read(stream_, buffer_, request_,
-						  beast::bind_front_handler(&SessionBase::OnRead, GetSharedThis()));
+	deadline_ = Clock::now() + IO_TIMEOUT;
+	http::async_read(socket_, buffer_, request_,
+						  RecyclingHandler{beast::bind_front_handler(&SessionBase::OnRead, GetSharedThis())});
 }
 
 void SessionBase::OnRead(beast::error_code ec, [[maybe_unused]] std::size_t bytes_read) {
+	reading_ = false;
 	if (ec == http::error::end_of_stream) {
-		return Close();
+		read_closed_ = true;
+		// Соединение закрывается, когда будут отправлены ответы на уже прочитанные запросы
+		if (next_request_ == next_response_) {
+			Close();
+		}
+		return;
 	}
 	if (ec) {
-		return ReportError(ec, "read"s);
+		read_closed_ = true;
+		if (next_request_ == next_response_) {
+			timer_.cancel();
+		}
+		return ReportError(timed_out_ ? beast::error::timeout : ec, "read"s);
+	}
+
+	if (!request_.keep_alive()) {
+		read_closed_ = true;
+	}
+	const uint64_t sequence = next_request_++;
+	if (!IsSafeMethod(request_.method())) {
+		unsafe_request_end_ = next_request_;
 	}
-	HandleRequest(std::move(request_));
+	HandleRequest(std::move(request_), sequence);
+	Read();
+}
+
+void SessionBase::WriteNext() {
+	ResponseSlot& slot = slots_[next_response_ % slots_.size()];
+	if (writing_ || slot.IsEmpty() || !socket_.is_open()) {
+		return;
+	}
+	writing_ = true;
+	deadline_ = Clock::now() + IO_TIMEOUT;
+	slot.AsyncWrite(*this);
 }
 
 void SessionBase::OnWrite(bool close, beast::error_code ec,
 								  [[maybe_unused]] std::size_t bytes_written) {
+	writing_ = false;
+	slots_[next_response_ % slots_.size()].Reset();
+	++next_response_;
+
 	if (ec) {
-		return ReportError(ec, "write"s);
+		read_closed_ = true;
+		timer_.cancel();
+		// Соединение неисправно: прерываем и ожидающее чтение
+		socket_.close(ec);
+		return ReportError(timed_out_ ? beast::error::timeout : ec, "write"s);
 	}
 
 	if (close) {
+		read_closed_ = true;
+		return Close();
+	}
+
+	if (read_closed_ && next_request_ == next_response_ && !reading_) {
 		return Close();
 	}
 
+	WriteNext();
 	Read();
 }
 
 void SessionBase::Close() {
+	timer_.cancel();
 	try {
-		stream_.socket().shutdown(tcp::socket::shutdown_send);
+		socket_.shutdown(tcp::socket::shutdown_send);
 	} catch (...) {
 	}
 }
 
+void SessionBase::StartTimer() {
+	timer_.expires_at(deadline_);
+	timer_.async_wait(RecyclingHandler{beast::bind_front_handler(&SessionBase::OnTimer, GetSharedThis())});
+}
+
+void SessionBase::OnTimer(beast::error_code ec) {
+	// Таймер мог сработать до отмены: завершённую сессию он не должен продлевать
+	const bool finished =
+		 read_closed_ && !reading_ && !writing_ && next_request_ == next_response_;
+	if (ec == net::error::operation_aborted || finished || !socket_.is_open()) {
+		return;
+	}
+	if (!reading_ && !writing_) {
+		// Сессия ждёт ответа обработчика: на это время таймаут не распространяется
+		deadline_ = Clock::now() + IO_TIMEOUT;
+	} else if (Clock::now() >= deadline_) {
+		timed_out_ = true;
+		socket_.close(ec);
+		return;
+	}
+	StartTimer();
+}
+
 } // namespace http_server
 
@@ -6,7 +6,16 @@
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
 
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+#include "io_context_pool.h"
 #include "logger.h"
+#include "recycling_allocator.h"
 
 namespace http_server {
 
@@ -16,6 +25,39 @@ namespace beast = boost::beast;
 namespace http = beast::http;
 namespace sys = boost::system;
 
+// Сессия работает со strand конкретного типа, а не с any_io_executor: стёртый исполнитель
+// копируется в каждой асинхронной операции и при этом выделяет память
+using Strand = net::strand<net::io_context::executor_type>;
+using StrandSocket = tcp::socket::rebind_executor<Strand>::other;
+
+// Поля заголовков запросов и ответов берут память из кэша блоков потока, а не из malloc
+using Fields = http::basic_fields<util::RecyclingAllocator<char>>;
+
+/*
+ * Обработчик завершения с аллокатором из кэша блоков потока. Через него Beast и Asio
+ * размещают состояние асинхронных операций: парсер при чтении, сериализатор при записи.
+ */
+template <typename Handler>
+class RecyclingHandler {
+ public:
+	using allocator_type = util::RecyclingAllocator<void>;
+
+	explicit RecyclingHandler(Handler handler) : handler_(std::move(handler)) {}
+
+	allocator_type get_allocator() const noexcept { return {}; }
+
+	template <typename... Args>
+	void operator()(Args&&... args) {
+		handler_(std::forward<Args>(args)...);
+	}
+
+ private:
+	Handler handler_;
+};
+
+// Включает SO_REUSEPORT. Бросает исключение, если система его не поддерживает
+void SetReusePort(tcp::acceptor& acceptor);
+
 inline void ReportError(beast::error_code ec, const std::string& where) {
 	BOOST_LOG_TRIVIAL(info) << boost::log::add_value(error_code, ec.value())
 									<< boost::log::add_value(text, ec.message())
@@ -23,6 +65,16 @@ inline void ReportError(beast::error_code ec, const std::string& where) {
 	std::cerr << where << ": " << ec.message() << std::endl;
 }
 
+/*
+ * Сессия обслуживает запросы одного соединения. Следующий запрос читается, не дожидаясь
+ * ответа на предыдущий, пока ответов в работе меньше pipeline_limit. Ответы могут быть
+ * готовы в любом порядке и в любом потоке, но пишутся в сокет в порядке запросов.
+ * pipeline_limit = 1 - запросы обслуживаются строго по одному.
+ * Обработчик может выполнять запросы не в порядке поступления, например, отправляя
+ * изменения мира в отдельный strand. Поэтому после небезопасного запроса (POST и т.п.)
+ * следующий читается только когда на него отправлен ответ: запрос, пришедший за ним
+ * в том же соединении, видит результат его выполнения.
+ */
 class SessionBase {
  public:
 	SessionBase(const SessionBase&) = delete;
@@ -31,55 +83,152 @@ class SessionBase {
 	std::string GetRemoteAddress() const;
 
  protected:
-	using HttpRequest = http::request<http::string_body>;
+	using HttpRequest = http::request<http::string_body, Fields>;
 
-	explicit SessionBase(tcp::socket&& socket);
+	SessionBase(StrandSocket&& socket, size_t pipeline_limit);
 	~SessionBase() = default;
 
+	// sequence - номер запроса, на который отвечает response
 	template <typename Body, typename Fields>
-	void Write(http::response<Body, Fields>&& response) {
-		auto safe_response = std::make_shared<http::response<Body, Fields>>(std::move(response));
-
-		auto self = GetSharedThis();
-		http::async_write(stream_, *safe_response,
-								[safe_response, self](beast::error_code ec, std::size_t bytes_written) {
-									self->OnWrite(safe_response->need_eof(), ec, bytes_written);
-								});
+	void Write(http::response<Body, Fields>&& response, uint64_t sequence) {
+		using Response = http::response<Body, Fields>;
+		// Ответ может прийти из другого потока, а состояние сессии меняется только в её strand
+		net::dispatch(socket_.get_executor(),
+						  [self = GetSharedThis(), response = std::move(response), sequence]() mutable {
+							  self->Enqueue<Response>(std::move(response), sequence);
+						  });
 	}
 
  private:
+	/*
+	 * Место под ответ, ждущий отправки. Ответ любого типа размещается прямо в слоте,
+	 * если помещается в INLINE_SIZE байт, поэтому слоты сессии служат пулом ответов
+	 * и не требуют выделения памяти на каждый запрос.
+	 */
+	class ResponseSlot {
+	 public:
+		static constexpr size_t INLINE_SIZE = 256;
+
+		ResponseSlot() = default;
+		ResponseSlot(const ResponseSlot&) = delete;
+		ResponseSlot& operator=(const ResponseSlot&) = delete;
+		~ResponseSlot() { Reset(); }
+
+		template <typename Response>
+		void Emplace(Response&& response) {
+			using Type = std::decay_t<Response>;
+			if constexpr (sizeof(Type) <= INLINE_SIZE && alignof(Type) <= alignof(std::max_align_t)) {
+				response_ = new (storage_) Type(std::move(response));
+				destroy_ = [](void* ptr) { static_cast<Type*>(ptr)->~Type(); };
+			} else {
+				response_ = new Type(std::move(response));
+				destroy_ = [](void* ptr) { delete static_cast<Type*>(ptr); };
+			}
+			write_ = &SessionBase::AsyncWriteResponse<Type>;
+		}
+
+		bool IsEmpty() const noexcept { return response_ == nullptr; }
+
+		void AsyncWrite(SessionBase& session) { write_(session, response_); }
+
+		void Reset() noexcept {
+			if (response_) {
+				destroy_(response_);
+				response_ = nullptr;
+			}
+		}
+
+	 private:
+		alignas(std::max_align_t) std::byte storage_[INLINE_SIZE];
+		void* response_ = nullptr;
+		void (*destroy_)(void*) = nullptr;
+		void (*write_)(SessionBase&, void*) = nullptr;
+	};
+
+	template <typename Response>
+	void Enqueue(Response&& response, uint64_t sequence) {
+		ResponseSlot& slot = slots_[sequence % slots_.size()];
+		// На каждый запрос отвечают один раз. Повторный ответ затёр бы в слоте тот,
+		// что, возможно, уже пишется в сокет, поэтому он отбрасывается
+		const bool valid =
+			 sequence >= next_response_ && sequence < next_request_ && slot.IsEmpty();
+		assert(valid && "response has already been sent for this request");
+		if (!valid) {
+			return;
+		}
+		slot.Emplace(std::move(response));
+		WriteNext();
+	}
+
+	template <typename Response>
+	static void AsyncWriteResponse(SessionBase& session, void* response) {
+		auto& message = *static_cast<Response*>(response);
+		http::async_write(session.socket_, message,
+								RecyclingHandler{beast::bind_front_handler(
+									 &SessionBase::OnWrite, session.GetSharedThis(), message.need_eof())});
+	}
+
+	using Clock = std::chrono::steady_clock;
+	using Timer = net::basic_waitable_timer<Clock, net::wait_traits<Clock>, Strand>;
+
+	static constexpr Clock::duration IO_TIMEOUT = std::chrono::seconds{30};
+
 	void Read();
 	void OnRead(beast::error_code ec, [[maybe_unused]] std::size_t bytes_read);
+	void WriteNext();
 	void Close();
 	void OnWrite(bool close, beast::error_code ec, [[maybe_unused]] std::size_t bytes_written);
+	void StartTimer();
+	void OnTimer(beast::error_code ec);
 
 	virtual std::shared_ptr<SessionBase> GetSharedThis() = 0;
-	virtual void HandleRequest(HttpRequest&& request) = 0;
+	virtual void HandleRequest(HttpRequest&& request, uint64_t sequence) = 0;
 
-	// tcp_stream содержит внутри себя сокет и добавляет поддержку таймаутов
-	beast::tcp_stream stream_;
+	StrandSocket socket_;
+	/*
+	 * Таймаут чтения и записи. Чтение и запись только сдвигают deadline_, а таймер
+	 * перезапускается, лишь когда срабатывает, поэтому запросы не тратят время на таймер.
+	 * beast::tcp_stream взводит таймер на каждую операцию и выделяет при этом память.
+	 */
+	Timer timer_;
+	Clock::time_point deadline_;
+	bool timed_out_ = false;
+	// Буфер живёт всю сессию, и его ёмкость переиспользуется всеми запросами соединения
 	beast::flat_buffer buffer_;
 	HttpRequest request_;
+	// Слот ответа на запрос с номером n - slots_[n % slots_.size()]
+	std::vector<ResponseSlot> slots_;
+	uint64_t next_request_ = 0;
+	uint64_t next_response_ = 0;
+	// Номер, следующий за последним небезопасным запросом. Пока ответы не дошли
+	// до него, новые запросы не читаются
+	uint64_t unsafe_request_end_ = 0;
+	bool reading_ = false;
+	bool writing_ = false;
+	// Клиент закрыл соединение или попросил его закрыть: новых запросов не будет
+	bool read_closed_ = false;
 };
 
 template <typename RequestHandler>
 class Session : public SessionBase, public std::enable_shared_from_this<Session<RequestHandler>> {
  public:
 	template <typename Handler>
-	Session(tcp::socket&& socket, Handler&& request_handler)
-		 : SessionBase(std::move(socket)), request_handler_(std::forward<Handler>(request_handler)) {}
+	Session(StrandSocket&& socket, Handler&& request_handler, size_t pipeline_limit = 1)
+		 : SessionBase(std::move(socket), pipeline_limit),
+			request_handler_(std::forward<Handler>(request_handler)) {}
 
  private:
 	std::shared_ptr<SessionBase> GetSharedThis() override { return this->shared_from_this(); }
 
-	void HandleRequest(HttpRequest&& request) override {
+	void HandleRequest(HttpRequest&& request, uint64_t sequence) override {
 		std::string ip = GetRemoteAddress();
 		// Захватываем умный указатель на текущий объект Session в лямбде,
 		// чтобы продлить время жизни сессии до вызова лямбды.
 		// Используется generic-лямбда функция, способная принять response произвольного типа
-		request_handler_(std::move(request), ip, [self = this->shared_from_this()](auto&& response) {
-			self->Write(std::move(response));
-		});
+		request_handler_(std::move(request), ip,
+							  [self = this->shared_from_this(), sequence](auto&& response) {
+								  self->Write(std::move(response), sequence);
+							  });
 	}
 
 	RequestHandler request_handler_;
@@ -88,10 +237,13 @@ class Session : public SessionBase, public std::enable_shared_from_this<Session<
 template <typename RequestHandler>
 class Listener : public std::enable_shared_from_this<Listener<RequestHandler>> {
  public:
+	// reuse_port - разрешить другим Listener слушать тот же порт. Ядро само распределяет
+	// между ними входящие соединения
 	template <typename Handler>
-	Listener(net::io_context& io, const tcp::endpoint& endpoint, Handler&& request_handler)
+	Listener(net::io_context& io, const tcp::endpoint& endpoint, Handler&& request_handler,
+				size_t pipeline_limit = 1, bool reuse_port = false)
 		 : io_(io), acceptor_(net::make_strand(io)),
-			request_handler_(std::forward<Handler>(request_handler)) {
+			request_handler_(std::forward<Handler>(request_handler)), pipeline_limit_(pipeline_limit) {
 		// Открываем acceptor, используя протокол (IPv4 или IPv6), указанный в endpoint
 		acceptor_.open(endpoint.protocol());
 
@@ -100,6 +252,9 @@ class Listener : public std::enable_shared_from_this<Listener<RequestHandler>> {
 		// Однако это может помешать повторно открыть сокет в полузакрытом состоянии.
 		// Флаг reuse_address разрешает открыть сокет, когда он "наполовину закрыт"
 		acceptor_.set_option(net::socket_base::reuse_address(true));
+		if (reuse_port) {
+			SetReusePort(acceptor_);
+		}
 		// Привязываем acceptor к адресу и порту endpoint
 		acceptor_.bind(endpoint);
 		// Переводим acceptor в состояние, в котором он способен принимать новые соединения
@@ -109,6 +264,8 @@ class Listener : public std::enable_shared_from_this<Listener<RequestHandler>> {
 
 	void Run() { DoAccept(); }
 
+	tcp::endpoint GetLocalEndpoint() const { return acceptor_.local_endpoint(); }
+
  private:
 	void DoAccept() {
 		acceptor_.async_accept(
@@ -126,7 +283,7 @@ class Listener : public std::enable_shared_from_this<Listener<RequestHandler>> {
 			 beast::bind_front_handler(&Listener::OnAccept, this->shared_from_this()));
 	}
 
-	void OnAccept(sys::error_code ec, tcp::socket socket) {
+	void OnAccept(sys::error_code ec, StrandSocket socket) {
 		using namespace std::literals;
 
 		if (ec) {
@@ -140,23 +297,46 @@ class Listener : public std::enable_shared_from_this<Listener<RequestHandler>> {
 		DoAccept();
 	}
 
-	void AsyncRunSession(tcp::socket&& socket) {
-		std::make_shared<Session<RequestHandler>>(std::move(socket), request_handler_)->Run();
+	void AsyncRunSession(StrandSocket&& socket) {
+		std::make_shared<Session<RequestHandler>>(std::move(socket), request_handler_, pipeline_limit_)
+			 ->Run();
 	}
 
 	net::io_context& io_;
 	tcp::acceptor acceptor_;
 	RequestHandler request_handler_;
+	size_t pipeline_limit_;
 };
 
 template <typename RequestHandler>
-inline void ServeHttp(net::io_context& ioc, const tcp::endpoint& endpoint,
-							 RequestHandler&& handler) {
+inline void ServeHttp(net::io_context& ioc, const tcp::endpoint& endpoint, RequestHandler&& handler,
+							 size_t pipeline_limit = 1) {
 	// При помощи decay_t исключим ссылки из типа RequestHandler,
 	// чтобы Listener хранил RequestHandler по значению
 	using MyListener = Listener<std::decay_t<RequestHandler>>;
 
-	std::make_shared<MyListener>(ioc, endpoint, std::forward<RequestHandler>(handler))->Run();
+	std::make_shared<MyListener>(ioc, endpoint, std::forward<RequestHandler>(handler), pipeline_limit)
+		 ->Run();
+}
+
+/*
+ * Запускает по Listener в каждом io_context пула на одном порту (SO_REUSEPORT).
+ * Соединение обслуживается в том io_context, который его принял, поэтому копии handler
+ * вызываются из разных потоков одновременно. Если в endpoint порт 0, все Listener
+ * слушают порт, выбранный системой для первого. Возвращает фактический адрес
+ */
+template <typename RequestHandler>
+inline tcp::endpoint ServeHttp(IoContextPool& pool, tcp::endpoint endpoint, RequestHandler&& handler,
+										 size_t pipeline_limit = 1) {
+	using MyListener = Listener<std::decay_t<RequestHandler>>;
+
+	for (size_t i = 0; i < pool.GetSize(); ++i) {
+		auto listener =
+			 std::make_shared<MyListener>(pool.Get(i), endpoint, handler, pipeline_limit, true);
+		endpoint = listener->GetLocalEndpoint();
+		listener->Run();
+	}
+	return endpoint;
 }
 
 } // namespace http_server
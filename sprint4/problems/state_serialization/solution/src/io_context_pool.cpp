@@ -0,0 +1,60 @@
+#include "io_context_pool.h"
+
+#include <algorithm>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace http_server {
+
+IoContextPool::IoContextPool(unsigned size, bool pin_threads) : pin_threads_(pin_threads) {
+	size = std::max(1u, size);
+	contexts_.reserve(size);
+	work_.reserve(size);
+	for (unsigned i = 0; i < size; ++i) {
+		// Подсказка 1: io_context запускает один поток, и будить другие потоки ему незачем
+		contexts_.push_back(std::make_unique<net::io_context>(1));
+		work_.push_back(net::make_work_guard(*contexts_.back()));
+	}
+}
+
+IoContextPool::~IoContextPool() {
+	Stop();
+}
+
+void IoContextPool::Start() {
+	const unsigned cpus = std::max(1u, std::thread::hardware_concurrency());
+	threads_.reserve(contexts_.size());
+	for (size_t i = 0; i < contexts_.size(); ++i) {
+		threads_.emplace_back([&ioc = *contexts_[i]] { ioc.run(); });
+		if (pin_threads_ && PinThreadToCpu(threads_.back(), static_cast<unsigned>(i % cpus))) {
+			++pinned_;
+		}
+	}
+}
+
+void IoContextPool::Stop() {
+	work_.clear();
+	for (auto& ioc : contexts_) {
+		ioc->stop();
+	}
+	for (std::thread& thread : threads_) {
+		thread.join();
+	}
+	threads_.clear();
+}
+
+bool PinThreadToCpu(std::thread& thread, unsigned cpu) {
+#ifdef __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set) == 0;
+#else
+	return false;
+#endif
+}
+
+} // namespace http_server
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
+
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace http_server {
+
+namespace net = boost::asio;
+
+/*
+ * Набор io_context, каждый из которых обслуживается ровно одним своим потоком.
+ * В отличие от общего io_context, потоки не делят очередь обработчиков и её блокировку:
+ * соединение живёт в одном io_context от приёма до закрытия, а работа для других
+ * io_context (например, для api_strand игры) передаётся им явным post.
+ */
+class IoContextPool {
+ public:
+	// pin_threads - закрепить i-й поток за i-м процессором, чтобы кэши ядра не остывали
+	IoContextPool(unsigned size, bool pin_threads);
+	~IoContextPool();
+
+	IoContextPool(const IoContextPool&) = delete;
+	IoContextPool& operator=(const IoContextPool&) = delete;
+
+	size_t GetSize() const noexcept { return contexts_.size(); }
+	net::io_context& Get(size_t index) { return *contexts_[index]; }
+
+	// Запускает потоки. io_context не завершается, когда у него кончается работа, до вызова Stop
+	void Start();
+	// Останавливает все io_context и дожидается завершения потоков
+	void Stop();
+
+	// Сколько потоков удалось закрепить за процессорами
+	size_t GetPinnedCount() const noexcept { return pinned_; }
+
+ private:
+	using WorkGuard = net::executor_work_guard<net::io_context::executor_type>;
+
+	std::vector<std::unique_ptr<net::io_context>> contexts_;
+	std::vector<WorkGuard> work_;
+	std::vector<std::thread> threads_;
+	bool pin_threads_;
+	size_t pinned_ = 0;
+};
+
+// Закрепляет поток за процессором cpu. false - если ОС этого не позволила или не умеет
+bool PinThreadToCpu(std::thread& thread, unsigned cpu);
+
+} // namespace http_server
@@ -0,0 +1,407 @@
+#include "journal.h"
+#include "binary_archive.h"
+#include "file_util.h"
+#include "logger.h"
+#include "model_serialization.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <charconv>
+#include <fstream>
+#include <iterator>
+#include <limits>
+
+namespace fs = std::filesystem;
+
+namespace serialization {
+
+// Записи первой версии не знают номера сессии: на каждой карте тогда была одна сессия
+constexpr uint64_t UNKNOWN_SESSION = std::numeric_limits<uint64_t>::max();
+
+struct JournalLoot {
+	// Версия 0
+	std::string map_id;
+	// Версия 1
+	uint64_t session_index = UNKNOWN_SESSION;
+	int type = 0;
+	geom::Point2D pos;
+
+	template <typename Archive>
+	void serialize(Archive& ar, const unsigned version) {
+		if (version >= 1) {
+			ar & session_index;
+		} else {
+			ar & map_id;
+		}
+		ar & type;
+		ar & pos;
+	}
+};
+
+struct JournalRecord {
+	enum class Type : uint8_t { JOIN, MOVE, TICK };
+
+	Type type = Type::TICK;
+	uint64_t seq = 0;
+	// JOIN, MOVE
+	uint64_t player_id = 0;
+	// JOIN
+	std::string map_id;
+	uint64_t session_index = UNKNOWN_SESSION;
+	std::string name;
+	geom::Point2D pos;
+	std::string token;
+	// MOVE
+	std::string move;
+	// TICK
+	double time_delta = 0;
+	std::vector<JournalLoot> loot;
+
+	template <typename Archive>
+	void serialize(Archive& ar, const unsigned version) {
+		ar & type;
+		ar & seq;
+		switch (type) {
+		case Type::JOIN:
+			ar & player_id;
+			ar & map_id;
+			if (version >= 1) {
+				ar & session_index;
+			}
+			ar & name;
+			ar & pos;
+			ar & token;
+			break;
+		case Type::MOVE:
+			ar & player_id;
+			ar & move;
+			break;
+		case Type::TICK:
+			ar & time_delta;
+			ar & loot;
+			break;
+		default:
+			throw std::runtime_error("Unknown journal record type");
+		}
+	}
+};
+
+} // namespace serialization
+
+BOOST_CLASS_VERSION(::serialization::JournalLoot, 1)
+BOOST_CLASS_VERSION(::serialization::JournalRecord, 1)
+
+namespace serialization {
+
+namespace {
+
+// Запись в файле: размер данных, CRC32 данных и сами данные
+constexpr size_t RECORD_HEADER_SIZE = 8;
+// При таком объёме накопленных записей сброс начинается раньше срока
+constexpr size_t FLUSH_THRESHOLD = 1 << 20;
+constexpr std::string_view SEGMENT_SUFFIX = ".journal.";
+
+fs::path SegmentPath(const fs::path& state_file, uint64_t segment) {
+	return state_file.string() + std::string(SEGMENT_SUFFIX) + std::to_string(segment);
+}
+
+// Сегменты журнала в порядке номеров первых записей
+std::vector<std::pair<uint64_t, fs::path>> ListSegments(const fs::path& state_file) {
+	std::vector<std::pair<uint64_t, fs::path>> segments;
+	const fs::path dir = state_file.parent_path().empty() ? fs::path{"."} : state_file.parent_path();
+	const std::string prefix = state_file.filename().string() + std::string(SEGMENT_SUFFIX);
+	if (!fs::is_directory(dir)) {
+		return segments;
+	}
+
+	for (const fs::directory_entry& entry : fs::directory_iterator(dir)) {
+		const std::string name = entry.path().filename().string();
+		if (!entry.is_regular_file() || name.compare(0, prefix.size(), prefix) != 0) {
+			continue;
+		}
+		uint64_t segment = 0;
+		const char* begin = name.data() + prefix.size();
+		const char* end = name.data() + name.size();
+		auto [ptr, ec] = std::from_chars(begin, end, segment);
+		if (ec == std::errc{} && ptr == end && begin != end) {
+			segments.emplace_back(segment, entry.path());
+		}
+	}
+	std::sort(segments.begin(), segments.end());
+
+	return segments;
+}
+
+uint32_t Checksum(std::string_view data) {
+	boost::crc_32_type crc32;
+	crc32.process_bytes(data.data(), data.size());
+	return crc32.checksum();
+}
+
+// Сессия, в которую попал игрок. Она могла открыться этим же присоединением
+model::GameSession* FindJoinedSession(const JournalRecord& record, const model::Map* map,
+												  model::Game& game) {
+	if (record.session_index == UNKNOWN_SESSION) {
+		return game.JoinSession(map);
+	}
+
+	model::GameSession* session = game.GetGameSession(record.session_index);
+	if (!session) {
+		session = game.AddGameSession(model::GameSession{map, game.GetPeriod(), game.GetProbability()});
+	}
+	if (session->GetIndex() != record.session_index || session->GetMap() != map) {
+		throw std::runtime_error("Journal does not match restored state");
+	}
+	return session;
+}
+
+void ApplyRecord(const JournalRecord& record, model::Game& game, app::Players& players,
+					  app::PlayerTokens& tokens) {
+	switch (record.type) {
+	case JournalRecord::Type::JOIN: {
+		const model::Map* map = game.FindMap(model::Map::Id{record.map_id});
+		if (!map) {
+			throw std::runtime_error("Unknown map in journal");
+		}
+		model::GameSession* session = FindJoinedSession(record, map, game);
+		model::Dog* dog = session->AddDog(record.name);
+		dog->SetPosition(record.pos);
+		app::Player* player = players.Add(session, dog);
+		if (player->GetId() != record.player_id) {
+			throw std::runtime_error("Journal does not match restored state");
+		}
+		tokens.SetTokenForPlayer(app::Token{record.token}, player);
+		break;
+	}
+	case JournalRecord::Type::MOVE: {
+		app::Player* player = players.FindById(record.player_id);
+		if (!player || !player->Move(record.move)) {
+			throw std::runtime_error("Journal does not match restored state");
+		}
+		break;
+	}
+	case JournalRecord::Type::TICK: {
+		const size_t session_count = game.GetGameSessions().size();
+		std::vector<std::vector<model::LostObject>> loot_by_session(session_count);
+		for (const JournalLoot& loot : record.loot) {
+			uint64_t index = loot.session_index;
+			if (index == UNKNOWN_SESSION) {
+				const model::Map* map = game.FindMap(model::Map::Id{loot.map_id});
+				const model::GameSession* session = map ? game.FindSessionByMap(map) : nullptr;
+				index = session ? session->GetIndex() : session_count;
+			}
+			if (index >= session_count) {
+				throw std::runtime_error("Journal does not match restored state");
+			}
+			loot_by_session[index].push_back({loot.type, loot.pos});
+		}
+		for (size_t i = 0; i < session_count; ++i) {
+			game.GetGameSession(i)->Tick(record.time_delta, loot_by_session[i]);
+		}
+		break;
+	}
+	}
+}
+
+} // namespace
+
+Journal::Journal(const std::string& state_file, uint64_t next_seq,
+					  std::chrono::milliseconds flush_period)
+	 : state_file_(state_file), flush_period_(flush_period), next_seq_(next_seq),
+		segment_(next_seq), flusher_([this](std::stop_token stop) { FlushLoop(stop); }) {}
+
+Journal::~Journal() {
+	flusher_.request_stop();
+	flusher_.join();
+
+	if (fd_ >= 0) {
+		::close(fd_);
+	}
+}
+
+void Journal::AppendJoin(const app::Player& player, const app::Token& token) {
+	JournalRecord record;
+	record.type = JournalRecord::Type::JOIN;
+	record.player_id = player.GetId();
+	record.map_id = *player.GetSession()->GetMap()->GetId();
+	record.session_index = player.GetSession()->GetIndex();
+	record.name = player.GetName();
+	record.pos = player.GetDog()->GetPosition();
+	record.token = *token;
+	Append(record);
+}
+
+void Journal::AppendMove(const app::Player& player, std::string_view move) {
+	JournalRecord record;
+	record.type = JournalRecord::Type::MOVE;
+	record.player_id = player.GetId();
+	record.move = move;
+	Append(record);
+}
+
+void Journal::AppendTick(double ms, const model::Game& game) {
+	JournalRecord record;
+	record.type = JournalRecord::Type::TICK;
+	record.time_delta = ms;
+	for (const model::GameSession& session : game.GetGameSessions()) {
+		for (const model::LostObject& loot : session.GetSpawnedLoot()) {
+			record.loot.push_back({{}, session.GetIndex(), loot.type, loot.pos});
+		}
+	}
+	Append(record);
+}
+
+void Journal::Append(JournalRecord& record) {
+	bool flush_now = false;
+	{
+		std::lock_guard lock(mutex_);
+		record.seq = next_seq_++;
+		if (pending_.empty() || pending_.back().segment != segment_) {
+			pending_.push_back({segment_, {}});
+		}
+
+		std::string& data = pending_.back().data;
+		const size_t header_pos = data.size();
+		data.resize(header_pos + RECORD_HEADER_SIZE);
+		BinaryOArchive{data} << record;
+
+		const std::string_view payload = std::string_view(data).substr(header_pos + RECORD_HEADER_SIZE);
+		std::string header;
+		BinaryOArchive{header} << static_cast<uint32_t>(payload.size()) << Checksum(payload);
+		data.replace(header_pos, RECORD_HEADER_SIZE, header);
+
+		pending_size_ += data.size() - header_pos;
+		flush_now = pending_size_ >= FLUSH_THRESHOLD;
+	}
+	if (flush_now) {
+		flush_cv_.notify_one();
+	}
+}
+
+uint64_t Journal::Rotate() {
+	std::lock_guard lock(mutex_);
+	segment_ = next_seq_;
+	return segment_;
+}
+
+void Journal::DropBefore(uint64_t seq) {
+	// Ещё не записанные записи этих сегментов тоже вошли в снимок
+	{
+		std::lock_guard lock(mutex_);
+		std::erase_if(pending_, [seq](const Chunk& chunk) { return chunk.segment < seq; });
+	}
+
+	std::lock_guard io_lock(io_mutex_);
+	if (fd_ >= 0 && open_segment_ < seq) {
+		::close(fd_);
+		fd_ = -1;
+	}
+
+	// Сегмент начинается при снимке, поэтому в сегментах до seq нет записей после seq
+	for (const auto& [segment, path] : ListSegments(state_file_)) {
+		if (segment < seq) {
+			std::error_code ec;
+			fs::remove(path, ec);
+		}
+	}
+}
+
+void Journal::Flush() {
+	std::vector<Chunk> chunks;
+	{
+		std::lock_guard lock(mutex_);
+		chunks.swap(pending_);
+		pending_size_ = 0;
+	}
+	WriteChunks(chunks);
+}
+
+void Journal::FlushLoop(std::stop_token stop) {
+	while (!stop.stop_requested()) {
+		{
+			std::unique_lock lock(mutex_);
+			flush_cv_.wait_for(lock, stop, flush_period_,
+									 [this] { return pending_size_ >= FLUSH_THRESHOLD; });
+		}
+		Flush();
+	}
+	// При остановке дописывается всё накопленное
+	Flush();
+}
+
+void Journal::WriteChunks(std::vector<Chunk>& chunks) {
+	if (chunks.empty()) {
+		return;
+	}
+
+	std::lock_guard io_lock(io_mutex_);
+	try {
+		for (const Chunk& chunk : chunks) {
+			if (fd_ < 0 || chunk.segment != open_segment_) {
+				if (fd_ >= 0) {
+					::fdatasync(fd_);
+					::close(fd_);
+				}
+				const fs::path path = SegmentPath(state_file_, chunk.segment);
+				fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+				if (fd_ < 0) {
+					throw std::runtime_error("Failed to open journal segment");
+				}
+				open_segment_ = chunk.segment;
+				util::SyncDirectory(path.parent_path());
+			}
+			util::WriteAll(fd_, chunk.data);
+		}
+		if (::fdatasync(fd_) != 0) {
+			throw std::runtime_error("Failed to sync journal segment");
+		}
+	} catch (const std::exception& ex) {
+		BOOST_LOG_TRIVIAL(error) << boost::log::add_value(exception_c, ex.what())
+										 << "failed to write journal";
+	}
+}
+
+uint64_t ReplayJournal(const std::string& state_file, uint64_t from_seq, model::Game& game,
+							  app::Players& players, app::PlayerTokens& tokens) {
+	uint64_t next_seq = from_seq;
+	for (const auto& [segment, path] : ListSegments(state_file)) {
+		// Записи должны идти подряд, иначе после пропуска повторять нечего
+		if (segment > next_seq) {
+			break;
+		}
+
+		std::ifstream in(path, std::ios::binary);
+		const std::string data{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+		std::string_view rest = data;
+		// Хвост сегмента мог не дописаться при сбое, такие записи отбрасываются
+		while (rest.size() >= RECORD_HEADER_SIZE) {
+			uint32_t size = 0;
+			uint32_t crc = 0;
+			BinaryIArchive{rest.substr(0, RECORD_HEADER_SIZE)} >> size >> crc;
+			if (size > rest.size() - RECORD_HEADER_SIZE) {
+				break;
+			}
+			const std::string_view payload = rest.substr(RECORD_HEADER_SIZE, size);
+			if (Checksum(payload) != crc) {
+				break;
+			}
+			rest.remove_prefix(RECORD_HEADER_SIZE + size);
+
+			JournalRecord record;
+			BinaryIArchive{payload} >> record;
+			if (record.seq < next_seq) {
+				continue;
+			}
+			if (record.seq > next_seq) {
+				break;
+			}
+			ApplyRecord(record, game, players, tokens);
+			++next_seq;
+		}
+	}
+
+	return next_seq;
+}
+
+} // namespace serialization
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "model.h"
+#include "player.h"
+
+namespace serialization {
+
+struct JournalRecord;
+
+/*
+ * Журнал изменений после последнего снимка: присоединения игроков, команды движения
+ * и тики вместе с появившимися в них трофеями, поэтому повтор журнала детерминирован.
+ * Записи копятся в памяти и раз в flush_period дописываются на диск одной пачкой
+ * с одним fdatasync.
+ *
+ * Журнал состоит из сегментов <файл состояния>.journal.<номер первой записи>.
+ * При каждом снимке начинается новый сегмент, а вошедшие в снимок сегменты удаляются.
+ */
+class Journal {
+ public:
+	Journal(const std::string& state_file, uint64_t next_seq, std::chrono::milliseconds flush_period);
+	~Journal();
+
+	Journal(const Journal&) = delete;
+	Journal& operator=(const Journal&) = delete;
+
+	void AppendJoin(const app::Player& player, const app::Token& token);
+	void AppendMove(const app::Player& player, std::string_view move);
+	// Вызывается сразу после тика game
+	void AppendTick(double ms, const model::Game& game);
+
+	// Начинает новый сегмент и возвращает номер его первой записи
+	uint64_t Rotate();
+
+	// Удаляет сегменты, все записи которых идут раньше seq
+	void DropBefore(uint64_t seq);
+
+	// Записывает накопленные записи, не дожидаясь очередного сброса
+	void Flush();
+
+ private:
+	struct Chunk {
+		uint64_t segment;
+		std::string data;
+	};
+
+	void Append(JournalRecord& record);
+	void FlushLoop(std::stop_token stop);
+	void WriteChunks(std::vector<Chunk>& chunks);
+
+	std::filesystem::path state_file_;
+	std::chrono::milliseconds flush_period_;
+
+	std::mutex mutex_;
+	std::condition_variable_any flush_cv_;
+	std::vector<Chunk> pending_;
+	size_t pending_size_ = 0;
+	uint64_t next_seq_;
+	uint64_t segment_;
+
+	// Файловые операции выполняются по одной
+	std::mutex io_mutex_;
+	int fd_ = -1;
+	uint64_t open_segment_ = 0;
+
+	std::jthread flusher_;
+};
+
+// Повторяет записи журнала начиная с from_seq. Возвращает номер следующей записи
+uint64_t ReplayJournal(const std::string& state_file, uint64_t from_seq, model::Game& game,
+							  app::Players& players, app::PlayerTokens& tokens);
+
+} // namespace serialization
@@ -1,6 +1,7 @@
 #include "json_loader.h"
 
 #include <fstream>
+#include <optional>
 #include <sstream>
 #include <string>
 
@@ -60,6 +61,14 @@ model::Office LoadOffice(const json::value& office_json_not) {
 	return office;
 }
 
+static size_t LoadMaxPlayers(const json::value& value) {
+	const int64_t max_players = value.as_int64();
+	if (max_players <= 0) {
+		throw std::invalid_argument("maxPlayersPerSession must be positive");
+	}
+	return static_cast<size_t>(max_players);
+}
+
 model::Game LoadGame(const std::filesystem::path& json_path) {
 	std::string json_str = LoadJsonFile(json_path);
 	auto value = json::parse(json_str);
@@ -73,6 +82,11 @@ model::Game LoadGame(const std::filesystem::path& json_path) {
 		def_speed = value.as_object().at("defaultBagCapacity").as_int64();
 	}
 
+	std::optional<size_t> def_max_players;
+	if (value.as_object().contains("maxPlayersPerSession")) {
+		def_max_players = LoadMaxPlayers(value.as_object().at("maxPlayersPerSession"));
+	}
+
 	const auto maps = value.at("maps").as_array();
 	model::Game game;
 	for (const auto& map_json : maps) {
@@ -83,6 +97,7 @@ model::Game LoadGame(const std::filesystem::path& json_path) {
 			model::Road road = LoadRoad(road_json);
 			map.AddRoad(road);
 		}
+		map.BuildRoadIndex();
 
 		const auto buildings = map_json.at("buildings").as_array();
 		for (const auto& building_json : buildings) {
@@ -108,6 +123,12 @@ model::Game LoadGame(const std::filesystem::path& json_path) {
 			map.SetBagCapacity(def_capacity);
 		}
 
+		if (map_json.as_object().contains("maxPlayersPerSession")) {
+			map.SetMaxPlayers(LoadMaxPlayers(map_json.as_object().at("maxPlayersPerSession")));
+		} else {
+			map.SetMaxPlayers(def_max_players);
+		}
+
 		const auto loot_types = map_json.at("lootTypes").as_array();
 		for (const auto& loot_type : loot_types) {
 			json::object obj = loot_type.as_object();
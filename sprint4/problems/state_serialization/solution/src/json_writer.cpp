@@ -0,0 +1,186 @@
+#include "json_writer.h"
+
+#include <cassert>
+#include <charconv>
+#include <cmath>
+
+namespace util {
+
+JsonWriter& JsonWriter::StartObject() {
+	Open('{');
+	return *this;
+}
+
+JsonWriter& JsonWriter::EndObject() {
+	Close('}');
+	return *this;
+}
+
+JsonWriter& JsonWriter::StartArray() {
+	Open('[');
+	return *this;
+}
+
+JsonWriter& JsonWriter::EndArray() {
+	Close(']');
+	return *this;
+}
+
+JsonWriter& JsonWriter::Key(std::string_view key) {
+	assert(!after_key_);
+	BeforeValue();
+	AppendEscaped(key);
+	out_ += ':';
+	after_key_ = true;
+	return *this;
+}
+
+JsonWriter& JsonWriter::Key(uint64_t key) {
+	assert(!after_key_);
+	BeforeValue();
+	char buf[24];
+	auto [end, ec] = std::to_chars(buf, buf + sizeof(buf), key);
+	out_ += '"';
+	out_.append(buf, end);
+	out_ += "\":";
+	after_key_ = true;
+	return *this;
+}
+
+JsonWriter& JsonWriter::String(std::string_view value) {
+	BeforeValue();
+	AppendEscaped(value);
+	return *this;
+}
+
+JsonWriter& JsonWriter::Int(int64_t value) {
+	BeforeValue();
+	char buf[24];
+	auto [end, ec] = std::to_chars(buf, buf + sizeof(buf), value);
+	out_.append(buf, end);
+	return *this;
+}
+
+JsonWriter& JsonWriter::Uint(uint64_t value) {
+	BeforeValue();
+	char buf[24];
+	auto [end, ec] = std::to_chars(buf, buf + sizeof(buf), value);
+	out_.append(buf, end);
+	return *this;
+}
+
+JsonWriter& JsonWriter::Double(double value) {
+	// В JSON нет бесконечностей и NaN
+	if (!std::isfinite(value)) {
+		return Null();
+	}
+
+	BeforeValue();
+	char buf[32];
+	auto [end, ec] = std::to_chars(buf, buf + sizeof(buf), value);
+	out_.append(buf, end);
+	// Кратчайшая запись целого числа не отличается от int, а клиент должен получить double
+	if (std::string_view(buf, end - buf).find_first_of(".e") == std::string_view::npos) {
+		out_ += ".0";
+	}
+	return *this;
+}
+
+JsonWriter& JsonWriter::Bool(bool value) {
+	BeforeValue();
+	out_ += value ? "true" : "false";
+	return *this;
+}
+
+JsonWriter& JsonWriter::Null() {
+	BeforeValue();
+	out_ += "null";
+	return *this;
+}
+
+JsonWriter& JsonWriter::RawValue(std::string_view json) {
+	BeforeValue();
+	out_ += json;
+	return *this;
+}
+
+JsonWriter& JsonWriter::RawMember(std::string_view json) {
+	assert(!after_key_);
+	BeforeValue();
+	out_ += json;
+	return *this;
+}
+
+void JsonWriter::BeforeValue() {
+	if (after_key_) {
+		after_key_ = false;
+		return;
+	}
+
+	if (depth_ > 0) {
+		if (has_items_[depth_ - 1]) {
+			out_ += ',';
+		}
+		has_items_[depth_ - 1] = true;
+	}
+}
+
+void JsonWriter::Open(char bracket) {
+	assert(depth_ < MAX_DEPTH);
+	BeforeValue();
+	out_ += bracket;
+	has_items_[depth_++] = false;
+}
+
+void JsonWriter::Close(char bracket) {
+	assert(depth_ > 0 && !after_key_);
+	--depth_;
+	out_ += bracket;
+}
+
+void JsonWriter::AppendEscaped(std::string_view str) {
+	constexpr char HEX[] = "0123456789abcdef";
+
+	out_ += '"';
+	size_t plain_from = 0;
+	for (size_t i = 0; i < str.size(); ++i) {
+		unsigned char c = static_cast<unsigned char>(str[i]);
+		if (c >= 0x20 && c != '"' && c != '\\') {
+			continue;
+		}
+
+		out_.append(str.data() + plain_from, i - plain_from);
+		plain_from = i + 1;
+		switch (c) {
+		case '"':
+			out_ += "\\\"";
+			break;
+		case '\\':
+			out_ += "\\\\";
+			break;
+		case '\n':
+			out_ += "\\n";
+			break;
+		case '\r':
+			out_ += "\\r";
+			break;
+		case '\t':
+			out_ += "\\t";
+			break;
+		case '\b':
+			out_ += "\\b";
+			break;
+		case '\f':
+			out_ += "\\f";
+			break;
+		default:
+			out_ += "\\u00";
+			out_ += HEX[c >> 4];
+			out_ += HEX[c & 0xF];
+		}
+	}
+	out_.append(str.data() + plain_from, str.size() - plain_from);
+	out_ += '"';
+}
+
+} // namespace util
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace util {
+
+/*
+ * Потоковая запись JSON прямо в строку-приёмник, без промежуточного дерева.
+ * Запятые между элементами расставляются автоматически. Строка не очищается,
+ * поэтому её можно переиспользовать между ответами, сохраняя ёмкость.
+ */
+class JsonWriter {
+ public:
+	constexpr static size_t MAX_DEPTH = 32;
+
+	explicit JsonWriter(std::string& out) : out_(out) {}
+
+	JsonWriter(const JsonWriter&) = delete;
+	JsonWriter& operator=(const JsonWriter&) = delete;
+
+	JsonWriter& StartObject();
+	JsonWriter& EndObject();
+	JsonWriter& StartArray();
+	JsonWriter& EndArray();
+
+	JsonWriter& Key(std::string_view key);
+	JsonWriter& Key(uint64_t key);
+
+	JsonWriter& String(std::string_view value);
+	JsonWriter& Int(int64_t value);
+	JsonWriter& Uint(uint64_t value);
+	JsonWriter& Double(double value);
+	JsonWriter& Bool(bool value);
+	JsonWriter& Null();
+
+	// Вставляет готовое значение как есть
+	JsonWriter& RawValue(std::string_view json);
+	// Вставляет в текущий объект готовую пару вида "key":value как есть
+	JsonWriter& RawMember(std::string_view json);
+
+ private:
+	void BeforeValue();
+	void Open(char bracket);
+	void Close(char bracket);
+	void AppendEscaped(std::string_view str);
+
+	std::string& out_;
+	// Есть ли уже элементы в каждом из открытых объектов и массивов
+	std::array<bool, MAX_DEPTH> has_items_{};
+	size_t depth_ = 0;
+	bool after_key_ = false;
+};
+
+} // namespace util
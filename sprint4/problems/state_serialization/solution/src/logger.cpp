@@ -0,0 +1,80 @@
+#include "logger.h"
+
+#include "json_writer.h"
+
+namespace {
+
+template <typename Keyword>
+void WriteString(util::JsonWriter& writer, logging::record_view const& rec, Keyword keyword,
+					  std::string_view key) {
+	if (auto value = rec[keyword]) {
+		writer.Key(key).String(*value);
+	}
+}
+
+template <typename Keyword>
+void WriteInt(util::JsonWriter& writer, logging::record_view const& rec, Keyword keyword,
+				  std::string_view key) {
+	if (auto value = rec[keyword]) {
+		writer.Key(key).Int(*value);
+	}
+}
+
+} // namespace
+
+void WriteJsonRecord(logging::record_view const& rec, std::string& out) {
+	util::JsonWriter writer(out);
+	writer.StartObject();
+
+	if (auto ts = rec[timestamp]) {
+		writer.Key("timestamp").String(boost::posix_time::to_iso_extended_string(*ts));
+	}
+
+	writer.Key("data").StartObject();
+	WriteString(writer, rec, ip_address, "ip");
+	WriteString(writer, rec, uri, "URI");
+	WriteString(writer, rec, http_method, "method");
+	// response
+	WriteInt(writer, rec, response_time, "response_time");
+	WriteInt(writer, rec, status_code, "code");
+	WriteString(writer, rec, content_type, "content_type");
+	// start
+	WriteInt(writer, rec, port_p, "port");
+	WriteString(writer, rec, ip_add, "address");
+	// end
+	WriteString(writer, rec, status_c, "code");
+	WriteString(writer, rec, exception_c, "exception");
+	// error
+	WriteString(writer, rec, text, "text");
+	WriteString(writer, rec, where, "where");
+	WriteInt(writer, rec, error_code, "code");
+	// state saved
+	WriteInt(writer, rec, capture_time, "capture_time_us");
+	WriteInt(writer, rec, write_time_attr, "write_time_us");
+	WriteInt(writer, rec, sessions_written_attr, "sessions_written");
+	// tick stats
+	WriteInt(writer, rec, tick_count_attr, "ticks");
+	WriteInt(writer, rec, tick_steps_attr, "steps");
+	WriteInt(writer, rec, tick_overruns_attr, "overruns");
+	WriteInt(writer, rec, missed_deadlines_attr, "missed_deadlines");
+	WriteInt(writer, rec, dropped_time_attr, "dropped_time_ms");
+	WriteInt(writer, rec, max_tick_time_attr, "max_tick_time_us");
+	if (auto histogram = rec[tick_histogram_attr]) {
+		writer.Key("tick_histogram").RawValue(*histogram);
+	}
+	writer.EndObject();
+
+	if (auto message = rec[logging::expressions::smessage]) {
+		writer.Key("message").String(*message);
+	} else {
+		writer.Key("message").String("");
+	}
+
+	writer.EndObject();
+}
+
+void JsonFormatter(logging::record_view const& rec, logging::formatting_ostream& strm) {
+	std::string line;
+	WriteJsonRecord(rec, line);
+	strm << line;
+}
@@ -33,6 +33,15 @@ class LootGenerator {
 	 */
 	unsigned Generate(TimeInterval time_delta, unsigned loot_count, unsigned looter_count);
 
+	/*
+	 * Меняет состояние так же, как Generate, вернувший generated_loot.
+	 * Нужен при повторе журнала, где число появившихся трофеев уже известно
+	 */
+	void Advance(TimeInterval time_delta, unsigned generated_loot);
+
+	// Время с момента последнего появления трофеев
+	TimeInterval GetTimeWithoutLoot() const noexcept { return time_without_loot_; }
+
  private:
 	static double DefaultGenerator() noexcept { return 1.0; };
 	TimeInterval base_interval_;
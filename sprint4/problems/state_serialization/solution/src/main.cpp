@@ -11,14 +11,19 @@
 #include <cstdlib>
 #include <filesystem>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <thread>
 
+#include "async_log.h"
+#include "io_context_pool.h"
 #include "json_loader.h"
+#include "json_writer.h"
 #include "logger.h"
 #include "request_handler.h"
 #include "serialization.h"
 #include "state_saver.h"
+#include "state_view.h"
 #include "ticker.h"
 
 using namespace std::literals;
@@ -43,11 +48,40 @@ void RunWorkers(unsigned n, const Fn& fn) {
 	fn();
 }
 
-void InitLogging() {
+// Записи лога уходят в std::cout из отдельного потока
+std::unique_ptr<logger::AsyncLogSink> InitLogging(size_t queue_size) {
 	logging::add_common_attributes();
 
-	auto console_sink = logging::add_console_log(
-		 std::cout, logging::keywords::format = &JsonFormatter, logging::keywords::auto_flush = true);
+	return std::make_unique<logger::AsyncLogSink>(std::cout, queue_size);
+}
+
+// Корзина гистограммы: {"le_us": верхняя граница или null, "count": число тиков}
+std::string MakeTickHistogram(const TickStats& stats) {
+	std::string histogram;
+	util::JsonWriter writer(histogram);
+	writer.StartArray();
+	for (size_t bucket = 0; bucket < TickStats::BUCKET_COUNT; ++bucket) {
+		writer.StartObject().Key("le_us");
+		if (bucket < TickStats::BUCKET_BOUNDS.size()) {
+			writer.Int(TickStats::BUCKET_BOUNDS[bucket].count());
+		} else {
+			writer.Null();
+		}
+		writer.Key("count").Uint(stats.GetBucketCount(bucket)).EndObject();
+	}
+	writer.EndArray();
+	return histogram;
+}
+
+void LogTickStats(const TickStats& stats) {
+	BOOST_LOG_TRIVIAL(info) << logging::add_value(tick_count_attr, stats.GetTickCount())
+									<< logging::add_value(tick_steps_attr, stats.GetStepCount())
+									<< logging::add_value(tick_overruns_attr, stats.GetOverrunCount())
+									<< logging::add_value(missed_deadlines_attr, stats.GetMissedDeadlineCount())
+									<< logging::add_value(dropped_time_attr, stats.GetDroppedTime().count())
+									<< logging::add_value(max_tick_time_attr, stats.GetMaxTime().count())
+									<< logging::add_value(tick_histogram_attr, MakeTickHistogram(stats))
+									<< "tick stats";
 }
 
 struct Args {
@@ -57,13 +91,27 @@ struct Args {
 	bool randomize_spawn_points = false;
 	std::optional<std::string> state_file;
 	std::optional<uint32_t> save_period;
+	unsigned tick_threads = 1;
+	serialization::StateFormat state_format = serialization::StateFormat::TEXT;
+	uint32_t journal_flush_period = 10;
+	bool fixed_tick_step = false;
+	std::optional<uint32_t> max_tick_step;
+	uint32_t max_tick_catch_up = 1000;
+	unsigned log_sample_rate = 1;
+	size_t log_queue_size = 1 << 16;
+	uint64_t static_cache_size = 64 * 1024 * 1024;
+	size_t pipeline_limit = 1;
+	bool io_context_per_core = false;
+	bool pin_threads = false;
 };
 
 [[nodiscard]] std::optional<Args> ParseCommandLine(int argc, const char* const argv[]) {
 	Args args;
 	uint32_t tick_period_tmp;
 	uint32_t save_period_tmp;
+	uint32_t max_tick_step_tmp;
 	std::string state_file_tmp;
+	std::string state_format_tmp;
 
 	po::options_description desc("Allowed options");
 	desc.add_options()("help,h", "produce help message")(
@@ -74,7 +122,36 @@ struct Args {
 		 "config-file,c", po::value(&args.config_file)->value_name("file"), "set config file path")(
 		 "www-root,w", po::value(&args.www_root)->value_name("dir"), "set static files root")(
 		 "randomize-spawn-points", po::bool_switch(&args.randomize_spawn_points),
-		 "spawn dogs at random positions");
+		 "spawn dogs at random positions")(
+		 "tick-threads", po::value(&args.tick_threads)->value_name("count"),
+		 "set number of threads ticking game sessions in parallel")(
+		 "state-format", po::value(&state_format_tmp)->value_name("text|binary"),
+		 "set format of saved state, text by default")(
+		 "journal-flush-period", po::value(&args.journal_flush_period)->value_name("milliseconds"),
+		 "set how often the journal of changes since the last saved state is flushed to disk, "
+		 "10 by default, 0 disables the journal")(
+		 "fixed-tick-step", po::bool_switch(&args.fixed_tick_step),
+		 "schedule ticks at fixed deadlines and split late ticks into bounded steps")(
+		 "max-tick-step", po::value(&max_tick_step_tmp)->value_name("milliseconds"),
+		 "set the longest game time step with --fixed-tick-step, tick period by default")(
+		 "max-tick-catch-up", po::value(&args.max_tick_catch_up)->value_name("milliseconds"),
+		 "set how much game time one late tick may catch up with --fixed-tick-step, "
+		 "1000 by default")(
+		 "log-sample-rate", po::value(&args.log_sample_rate)->value_name("n"),
+		 "log every n-th request, 1 by default. Server errors are always logged")(
+		 "log-queue-size", po::value(&args.log_queue_size)->value_name("records"),
+		 "set how many log records may wait to be written, 65536 by default. "
+		 "Records that do not fit are dropped")(
+		 "static-cache-size", po::value(&args.static_cache_size)->value_name("bytes"),
+		 "set how much static file content is kept in memory, 64 MiB by default")(
+		 "pipeline-limit", po::value(&args.pipeline_limit)->value_name("requests"),
+		 "set how many requests of one connection may be handled at once, 1 by default. "
+		 "Responses are still sent in the order of requests")(
+		 "io-context-per-core", po::bool_switch(&args.io_context_per_core),
+		 "give each network thread its own io_context and SO_REUSEPORT listener "
+		 "instead of sharing one io_context")(
+		 "pin-threads", po::bool_switch(&args.pin_threads),
+		 "pin network threads to CPUs, requires --io-context-per-core");
 
 	po::variables_map vm;
 	po::store(po::parse_command_line(argc, argv, desc), vm);
@@ -89,6 +166,29 @@ struct Args {
 		args.tick_period = tick_period_tmp;
 	}
 
+	if (args.pipeline_limit == 0) {
+		throw std::runtime_error("Pipeline limit must be positive"s);
+	}
+
+	if (args.pin_threads && !args.io_context_per_core) {
+		throw std::runtime_error("Pinning threads requires --io-context-per-core"s);
+	}
+
+	if (args.log_sample_rate == 0) {
+		throw std::runtime_error("Log sample rate must be positive"s);
+	}
+
+	if (args.fixed_tick_step && args.tick_period.value_or(0) == 0) {
+		throw std::runtime_error("Fixed tick step requires a positive tick period"s);
+	}
+
+	if (vm.contains("max-tick-step")) {
+		if (max_tick_step_tmp == 0) {
+			throw std::runtime_error("Max tick step must be positive"s);
+		}
+		args.max_tick_step = max_tick_step_tmp;
+	}
+
 	if (vm.contains("state-file")) {
 		args.state_file = state_file_tmp;
 	}
@@ -97,6 +197,10 @@ struct Args {
 		args.save_period = save_period_tmp;
 	}
 
+	if (vm.contains("state-format")) {
+		args.state_format = serialization::ParseStateFormat(state_format_tmp);
+	}
+
 	if (args.config_file.empty()) {
 		throw std::runtime_error("Config file path is not specified"s);
 	}
@@ -116,29 +220,41 @@ int main(int argc, const char* argv[]) {
 	}
 	auto& args = *args_opt;
 
+	auto log_sink = InitLogging(args.log_queue_size);
+
 	try {
-		InitLogging();
 
 		// 1. Загружаем карту из файла и построить модель игры
 		model::Game game = json_loader::LoadGame(args.config_file);
+		game.SetTickThreads(args.tick_threads);
 		std::filesystem::path static_path = args.www_root;
 		app::Players players;
 		app::PlayerTokens tokens;
-		StateSaver state_saver(game, args.save_period, args.state_file.value_or(""), players, tokens);
+		StateSaver state_saver(game, args.save_period, args.state_file.value_or(""), players, tokens,
+									  args.state_format);
 
 		if (args.state_file) {
+			uint64_t journal_seq = 0;
 			try {
-				serialization::DeserializeState(*args.state_file, game, players, tokens);
+				journal_seq = serialization::DeserializeState(*args.state_file, game, players, tokens);
 			} catch (const std::exception& ex) {
 				BOOST_LOG_TRIVIAL(error)
 					 << logging::add_value(exception_c, ex.what()) << "failed to restore state";
 				return EXIT_FAILURE;
 			}
+			if (args.journal_flush_period > 0) {
+				state_saver.EnableJournal(journal_seq,
+												  std::chrono::milliseconds{args.journal_flush_period});
+			}
 		}
 
+		app::StateView state_view(game, players);
+
 		// 2. Инициализируем io_context
-		const unsigned num_threads = std::thread::hardware_concurrency();
-		net::io_context ioc(num_threads);
+		// В режиме io_context на ядро в ioc остаются только api_strand, тикер и сигналы,
+		// и его обслуживает один главный поток, а соединения - потоки IoContextPool
+		const unsigned num_threads = std::max(1u, std::thread::hardware_concurrency());
+		net::io_context ioc(args.io_context_per_core ? 1 : num_threads);
 		auto api_strand = net::make_strand(ioc);
 
 		// 3. Добавляем асинхронный обработчик сигналов SIGINT и SIGTERM
@@ -149,40 +265,92 @@ int main(int argc, const char* argv[]) {
 			}
 		});
 
-		// 4. Создаём обработчик HTTP-запросов и связываем его с моделью игры
-		auto handler = std::make_shared<http_handler::RequestHandler>(
-			 game, std::filesystem::absolute(static_path), api_strand, args.randomize_spawn_points,
-			 args.tick_period.has_value(), state_saver, players, tokens);
-		http_handler::LoggingRequestHandler log_handler(*handler);
-
 		std::shared_ptr<Ticker> ticker;
 		if (args.tick_period) {
 			std::chrono::milliseconds period{*args.tick_period};
+			std::optional<Ticker::FixedStep> fixed_step;
+			if (args.fixed_tick_step) {
+				fixed_step = Ticker::FixedStep{
+					 std::chrono::milliseconds{args.max_tick_step.value_or(*args.tick_period)},
+					 std::chrono::milliseconds{args.max_tick_catch_up}};
+			}
 			ticker = std::make_shared<Ticker>(
-				 api_strand, period, [&state_saver](std::chrono::steady_clock::duration delta) {
+				 api_strand, period,
+				 [&state_saver](std::chrono::steady_clock::duration delta) {
 					 double ms = std::chrono::duration_cast<std::chrono::milliseconds>(delta).count();
 					 state_saver.Tick(ms);
-				 });
+				 },
+				 // Снимок нужен только после последнего шага: промежуточные никто не увидит
+				 fixed_step, [&state_view] { state_view.Publish(); });
 			ticker->Start();
 		}
 
+		// 4. Создаём обработчик HTTP-запросов и связываем его с моделью игры
+		// Метрики занимают сотни килобайт, поэтому лежат в куче
+		auto request_metrics = std::make_unique<http_handler::RequestMetrics>();
+		http_handler::StaticFiles::Limits static_limits;
+		static_limits.max_cache_size = args.static_cache_size;
+		static_limits.max_file_size = std::min(static_limits.max_file_size, args.static_cache_size);
+		http_handler::StaticFiles static_files(std::filesystem::absolute(static_path), static_limits);
+		// Статика загружается и сжимается заранее, чтобы первые запросы не ждали сжатия
+		static_files.Preload();
+		auto handler = std::make_shared<http_handler::RequestHandler>(
+			 game, static_files, api_strand, args.randomize_spawn_points,
+			 args.tick_period.has_value(), state_saver, players, tokens, state_view, *request_metrics,
+			 ticker ? &ticker->GetStats() : nullptr);
+		http_handler::LoggingRequestHandler log_handler(*handler, *request_metrics,
+																		args.log_sample_rate);
+		handler->AddMetricsSource([&log_sink, &log_handler](util::PrometheusWriter& writer) {
+			const logger::AsyncJsonBackend& backend = log_sink->GetBackend();
+			writer.Family("game_server_log_records_written_total", "counter", "Log records written")
+				 .Sample("game_server_log_records_written_total", "", backend.GetWrittenCount());
+			writer.Family("game_server_log_records_dropped_total", "counter",
+							  "Log records dropped because the log queue was full")
+				 .Sample("game_server_log_records_dropped_total", "", backend.GetDroppedCount());
+			writer.Family("game_server_log_requests_skipped_total", "counter",
+							  "Requests left out of the log by sampling")
+				 .Sample("game_server_log_requests_skipped_total", "", log_handler.GetSkippedCount());
+		});
+
 		// 5. Запустить обработчик HTTP-запросов, делегируя их обработчику запросов
 		const auto address = net::ip::make_address("0.0.0.0");
 		constexpr int port = 8080;
-		http_server::ServeHttp(
-			 ioc, {address, port}, [&log_handler](auto&& req, const std::string ip, auto&& send) {
-				 log_handler(std::forward<decltype(req)>(req), ip, std::forward<decltype(send)>(send));
-			 });
+		auto serve = [&log_handler](auto&& req, const std::string ip, auto&& send) {
+			log_handler(std::forward<decltype(req)>(req), ip, std::forward<decltype(send)>(send));
+		};
+		// Пул объявлен после обработчиков, чтобы его потоки остановились раньше, чем они исчезнут
+		std::optional<http_server::IoContextPool> io_pool;
+		if (args.io_context_per_core) {
+			io_pool.emplace(num_threads, args.pin_threads);
+			http_server::ServeHttp(*io_pool, {address, port}, serve, args.pipeline_limit);
+		} else {
+			http_server::ServeHttp(ioc, {address, port}, serve, args.pipeline_limit);
+		}
 
 		BOOST_LOG_TRIVIAL(info) << logging::add_value(port_p, port)
 										<< logging::add_value(ip_add, "0.0.0.0") << "server started";
 
 		// 6. Запускаем обработку асинхронных операций
-		RunWorkers(std::max(1u, num_threads), [&ioc] { ioc.run(); });
+		if (io_pool) {
+			io_pool->Start();
+			if (args.pin_threads && io_pool->GetPinnedCount() < io_pool->GetSize()) {
+				BOOST_LOG_TRIVIAL(warning) << "failed to pin network threads to CPUs";
+			}
+			ioc.run();
+			io_pool->Stop();
+		} else {
+			RunWorkers(num_threads, [&ioc] { ioc.run(); });
+		}
+
+		if (ticker) {
+			LogTickStats(ticker->GetStats());
+		}
 
+		// Фоновая запись могла ещё не закончиться, а писать в один файл можно только по очереди
+		state_saver.Stop();
 		if (args.state_file) {
 			try {
-				serialization::SerializeState(*args.state_file, game, players, tokens);
+				state_saver.Save();
 			} catch (const std::exception& ex) {
 				BOOST_LOG_TRIVIAL(error) << boost::log::add_value(exception_c, ex.what())
 												 << "failed to save state on shutdown";
@@ -0,0 +1,175 @@
+#include "metrics.h"
+
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cmath>
+
+namespace util {
+
+size_t ThisThreadShard() noexcept {
+	static std::atomic<size_t> next_shard = 0;
+	thread_local const size_t shard =
+		 next_shard.fetch_add(1, std::memory_order_relaxed) % METRIC_SHARDS;
+	return shard;
+}
+
+uint64_t Counter::Get() const noexcept {
+	uint64_t total = 0;
+	for (const Shard& shard : shards_) {
+		total += shard.value.load(std::memory_order_relaxed);
+	}
+	return total;
+}
+
+uint64_t HistogramSnapshot::CountNotAbove(uint64_t value) const {
+	uint64_t total = 0;
+	for (size_t bucket = 0; bucket < counts.size(); ++bucket) {
+		if (Histogram::GetBucketEnd(bucket) - 1 > value) {
+			break;
+		}
+		total += counts[bucket];
+	}
+	return total;
+}
+
+uint64_t HistogramSnapshot::Quantile(double q) const {
+	if (count == 0) {
+		return 0;
+	}
+	const uint64_t rank =
+		 std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(std::clamp(q, 0.0, 1.0) * count)));
+	uint64_t seen = 0;
+	for (size_t bucket = 0; bucket < counts.size(); ++bucket) {
+		seen += counts[bucket];
+		if (seen >= rank) {
+			return Histogram::GetBucketEnd(bucket) - 1;
+		}
+	}
+	return Histogram::GetBucketEnd(counts.size() - 1) - 1;
+}
+
+size_t Histogram::GetBucket(uint64_t value) noexcept {
+	if (value < SUB_BUCKETS) {
+		return static_cast<size_t>(value);
+	}
+	const unsigned exponent = std::bit_width(value) - 1;
+	if (exponent >= MAX_EXPONENT) {
+		return BUCKET_COUNT - 1;
+	}
+	// Корзина определяется старшими SUB_BUCKET_BITS + 1 битами значения
+	const unsigned shift = exponent - SUB_BUCKET_BITS;
+	return static_cast<size_t>(SUB_BUCKETS * (shift + 1) + (value >> shift) - SUB_BUCKETS);
+}
+
+uint64_t Histogram::GetBucketEnd(size_t bucket) noexcept {
+	if (bucket < SUB_BUCKETS) {
+		return bucket + 1;
+	}
+	const uint64_t shift = bucket / SUB_BUCKETS - 1;
+	const uint64_t sub_bucket = bucket % SUB_BUCKETS;
+	return (SUB_BUCKETS + sub_bucket + 1) << shift;
+}
+
+HistogramSnapshot Histogram::Collect() const {
+	HistogramSnapshot snapshot;
+	snapshot.counts.assign(BUCKET_COUNT, 0);
+	for (const Shard& shard : shards_) {
+		for (size_t bucket = 0; bucket < BUCKET_COUNT; ++bucket) {
+			const uint64_t count = shard.counts[bucket].load(std::memory_order_relaxed);
+			snapshot.counts[bucket] += count;
+			snapshot.count += count;
+		}
+		snapshot.sum += shard.sum.load(std::memory_order_relaxed);
+	}
+	return snapshot;
+}
+
+namespace {
+
+void AppendNumber(std::string& out, uint64_t value) {
+	char buf[24];
+	auto [end, ec] = std::to_chars(buf, buf + sizeof(buf), value);
+	out.append(buf, end);
+}
+
+void AppendNumber(std::string& out, double value) {
+	char buf[32];
+	auto [end, ec] = std::to_chars(buf, buf + sizeof(buf), value);
+	out.append(buf, end);
+}
+
+} // namespace
+
+PrometheusWriter& PrometheusWriter::Family(std::string_view name, std::string_view type,
+														 std::string_view help) {
+	out_.append("# HELP ").append(name).append(" ").append(help).append("\n");
+	out_.append("# TYPE ").append(name).append(" ").append(type).append("\n");
+	return *this;
+}
+
+PrometheusWriter& PrometheusWriter::Sample(std::string_view name, std::string_view labels,
+														 uint64_t value) {
+	Name(name, {}, labels);
+	AppendNumber(out_, value);
+	out_ += '\n';
+	return *this;
+}
+
+PrometheusWriter& PrometheusWriter::Sample(std::string_view name, std::string_view labels,
+														 double value) {
+	Name(name, {}, labels);
+	AppendNumber(out_, value);
+	out_ += '\n';
+	return *this;
+}
+
+PrometheusWriter& PrometheusWriter::Histogram(std::string_view name, std::string_view labels,
+															 const HistogramSnapshot& snapshot,
+															 const std::vector<uint64_t>& bounds, double scale) {
+	for (uint64_t bound : bounds) {
+		Bucket(name, labels, bound * scale, snapshot.CountNotAbove(bound));
+	}
+	Bucket(name, labels, std::nullopt, snapshot.count);
+
+	Name(name, "_sum", labels);
+	AppendNumber(out_, snapshot.sum * scale);
+	out_ += '\n';
+	Name(name, "_count", labels);
+	AppendNumber(out_, snapshot.count);
+	out_ += '\n';
+	return *this;
+}
+
+PrometheusWriter& PrometheusWriter::Bucket(std::string_view name, std::string_view labels,
+														 std::optional<double> le, uint64_t cumulative_count) {
+	std::string le_label = "le=\"";
+	if (le) {
+		AppendNumber(le_label, *le);
+	} else {
+		le_label += "+Inf";
+	}
+	le_label += '"';
+
+	Name(name, "_bucket", labels, le_label);
+	AppendNumber(out_, cumulative_count);
+	out_ += '\n';
+	return *this;
+}
+
+void PrometheusWriter::Name(std::string_view name, std::string_view suffix,
+									 std::string_view labels, std::string_view extra_label) {
+	out_.append(name).append(suffix);
+	if (!labels.empty() || !extra_label.empty()) {
+		out_ += '{';
+		out_.append(labels);
+		if (!labels.empty() && !extra_label.empty()) {
+			out_ += ',';
+		}
+		out_.append(extra_label);
+		out_ += '}';
+	}
+	out_ += ' ';
+}
+
+} // namespace util
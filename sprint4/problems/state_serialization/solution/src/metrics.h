@@ -0,0 +1,120 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace util {
+
+/*
+ * Счётчики и гистограммы для метрик. Каждый поток пишет в свой шард,
+ * поэтому запись - это одна атомарная операция без блокировок и почти без
+ * конкуренции за кеш-линию. Чтение суммирует все шарды и нужно только при выдаче метрик.
+ */
+constexpr size_t METRIC_SHARDS = 16;
+
+// Шард, в который пишет текущий поток
+size_t ThisThreadShard() noexcept;
+
+class Counter {
+ public:
+	void Add(uint64_t n = 1) noexcept {
+		shards_[ThisThreadShard()].value.fetch_add(n, std::memory_order_relaxed);
+	}
+
+	uint64_t Get() const noexcept;
+
+ private:
+	struct alignas(64) Shard {
+		std::atomic<uint64_t> value = 0;
+	};
+
+	std::array<Shard, METRIC_SHARDS> shards_{};
+};
+
+struct HistogramSnapshot {
+	// Число значений в каждой корзине Histogram
+	std::vector<uint64_t> counts;
+	uint64_t count = 0;
+	uint64_t sum = 0;
+
+	// Сколько значений не больше value. Корзины, которые value делит пополам, не учитываются
+	uint64_t CountNotAbove(uint64_t value) const;
+	// Верхняя граница корзины, в которую попадает квантиль q из [0, 1]
+	uint64_t Quantile(double q) const;
+};
+
+/*
+ * Гистограмма в духе HdrHistogram: каждая степень двойки делится на SUB_BUCKETS
+ * корзин одинаковой ширины, поэтому относительная погрешность не превышает
+ * 1/SUB_BUCKETS во всём диапазоне, а память не зависит от числа значений.
+ */
+class Histogram {
+ public:
+	static constexpr unsigned SUB_BUCKET_BITS = 3;
+	static constexpr uint64_t SUB_BUCKETS = uint64_t{1} << SUB_BUCKET_BITS;
+	// Значения от 2^MAX_EXPONENT попадают в последнюю корзину
+	static constexpr unsigned MAX_EXPONENT = 40;
+	static constexpr size_t BUCKET_COUNT = SUB_BUCKETS * (MAX_EXPONENT - SUB_BUCKET_BITS + 1);
+
+	static size_t GetBucket(uint64_t value) noexcept;
+	// Наименьшее значение, которое уже не попадает в корзину bucket
+	static uint64_t GetBucketEnd(size_t bucket) noexcept;
+
+	void Record(uint64_t value) noexcept {
+		Shard& shard = shards_[ThisThreadShard()];
+		shard.counts[GetBucket(value)].fetch_add(1, std::memory_order_relaxed);
+		shard.sum.fetch_add(value, std::memory_order_relaxed);
+	}
+
+	HistogramSnapshot Collect() const;
+
+ private:
+	struct alignas(64) Shard {
+		std::array<std::atomic<uint64_t>, BUCKET_COUNT> counts{};
+		std::atomic<uint64_t> sum = 0;
+	};
+
+	std::array<Shard, METRIC_SHARDS> shards_{};
+};
+
+/*
+ * Запись метрик в текстовом формате Prometheus. Метки передаются готовой
+ * строкой вида name="value",name2="value2", пустая строка - без меток.
+ */
+class PrometheusWriter {
+ public:
+	explicit PrometheusWriter(std::string& out) : out_(out) {}
+
+	PrometheusWriter(const PrometheusWriter&) = delete;
+	PrometheusWriter& operator=(const PrometheusWriter&) = delete;
+
+	// Заголовок семейства метрик: type - counter, gauge или histogram
+	PrometheusWriter& Family(std::string_view name, std::string_view type, std::string_view help);
+
+	PrometheusWriter& Sample(std::string_view name, std::string_view labels, uint64_t value);
+	PrometheusWriter& Sample(std::string_view name, std::string_view labels, double value);
+
+	// Гистограмма с корзинами le из bounds. Значения и границы умножаются на scale,
+	// чтобы, например, записанные в микросекундах длительности выдавать в секундах
+	PrometheusWriter& Histogram(std::string_view name, std::string_view labels,
+										 const HistogramSnapshot& snapshot,
+										 const std::vector<uint64_t>& bounds, double scale = 1);
+
+	// Одна корзина гистограммы: сколько значений не больше le. Для корзины +Inf le не задаётся
+	PrometheusWriter& Bucket(std::string_view name, std::string_view labels,
+									 std::optional<double> le, uint64_t cumulative_count);
+
+ private:
+	void Name(std::string_view name, std::string_view suffix, std::string_view labels,
+				 std::string_view extra_label = {});
+
+	std::string& out_;
+};
+
+} // namespace util
@@ -2,6 +2,8 @@
 #include "collision_detector.h"
 
 #include <algorithm>
+#include <cmath>
+#include <limits>
 #include <random>
 #include <set>
 #include <stdexcept>
@@ -9,6 +11,47 @@
 namespace model {
 using namespace std::literals;
 
+std::optional<Coord> RoadIndex::ToLine(double value) {
+	const double line = std::round(value);
+	if (!(line >= std::numeric_limits<Coord>::min() && line <= std::numeric_limits<Coord>::max())) {
+		return std::nullopt;
+	}
+
+	const Coord coord = static_cast<Coord>(line);
+	if (std::abs(value - coord) > Road::HALF_WIDTH) {
+		return std::nullopt;
+	}
+
+	return coord;
+}
+
+RoadIndex::RoadIndex(const std::vector<Road>& roads) {
+	for (size_t index = 0; index < roads.size(); ++index) {
+		const Road& road = roads[index];
+		const Point start = road.GetStart();
+		const Point end = road.GetEnd();
+		if (road.IsHorizontal()) {
+			rows_[start.y].segments.push_back({std::min(start.x, end.x) - Road::HALF_WIDTH,
+														  std::max(start.x, end.x) + Road::HALF_WIDTH, index});
+		} else {
+			cols_[start.x].segments.push_back({std::min(start.y, end.y) - Road::HALF_WIDTH,
+														  std::max(start.y, end.y) + Road::HALF_WIDTH, index});
+		}
+	}
+
+	for (auto* lines : {&rows_, &cols_}) {
+		for (auto& [coord, line] : *lines) {
+			std::sort(line.segments.begin(), line.segments.end(),
+						 [](const Segment& lhs, const Segment& rhs) { return lhs.from < rhs.from; });
+			line.max_to.reserve(line.segments.size());
+			for (const Segment& segment : line.segments) {
+				line.max_to.push_back(
+					 line.max_to.empty() ? segment.to : std::max(line.max_to.back(), segment.to));
+			}
+		}
+	}
+}
+
 bool Road::IsOnRoad(geom::Point2D pos) const {
 	if (IsHorizontal()) {
 		double min_x = std::min(start_.x, end_.x);
@@ -73,33 +116,17 @@ geom::Point2D Map::GetRandomRoadPosition() const {
 
 std::vector<const Road*> Map::IsOnRoad(geom::Point2D pos) const {
 	std::vector<const Road*> result;
-
-	for (const auto& road : roads_) {
-		if (road.IsOnRoad(pos)) {
-			result.push_back(&road);
-		}
-	}
+	ForEachRoadAt(pos, [&result](const Road& road) { result.push_back(&road); });
+	std::sort(result.begin(), result.end());
 
 	return result;
 }
 
 bool Map::IsLineOnRoad(geom::Point2D p1, geom::Point2D p2) const {
-	std::vector<const Road*> v1 = IsOnRoad(p1);
-	std::vector<const Road*> v2 = IsOnRoad(p2);
-
-	if (v1.empty() || v2.empty()) {
-		return false;
-	}
+	bool on_road = false;
+	ForEachRoadAt(p1, [&on_road, p2](const Road& road) { on_road = on_road || road.IsOnRoad(p2); });
 
-	for (const Road* r1 : v1) {
-		for (const Road* r2 : v2) {
-			if (r1 == r2) {
-				return true;
-			}
-		}
-	}
-
-	return false;
+	return on_road;
 }
 
 std::pair<geom::Point2D, bool> Map::MoveDog(geom::Point2D pos, geom::Vec2D speed,
@@ -115,22 +142,21 @@ std::pair<geom::Point2D, bool> Map::MoveDog(geom::Point2D pos, geom::Vec2D speed
 		return {target_pos, false};
 	}
 
-	std::vector<const Road*> roads_at_pos = IsOnRoad(pos);
 	bool moving_horizontally = (speed.x != 0);
 	geom::Point2D max_pos;
 
-	for (const Road* road : roads_at_pos) {
-		if (road->IsHorizontal()) {
+	ForEachRoadAt(pos, [&](const Road& road) {
+		if (road.IsHorizontal()) {
 			if (moving_horizontally) {
-				double x = speed.x > 0 ? (std::max(road->GetStart().x, road->GetEnd().x) + 0.4)
-											  : (std::min(road->GetStart().x, road->GetEnd().x) - 0.4);
+				double x = speed.x > 0 ? (std::max(road.GetStart().x, road.GetEnd().x) + 0.4)
+											  : (std::min(road.GetStart().x, road.GetEnd().x) - 0.4);
 				geom::Point2D new_max_pos = {x, pos.y};
 				max_pos = (speed.x > 0 && new_max_pos.x > max_pos.x) ||
 										(speed.x < 0 && new_max_pos.x < max_pos.x)
 								  ? new_max_pos
 								  : max_pos;
 			} else {
-				double y = speed.y > 0 ? (road->GetStart().y + 0.4) : (road->GetStart().y - 0.4);
+				double y = speed.y > 0 ? (road.GetStart().y + 0.4) : (road.GetStart().y - 0.4);
 				geom::Point2D new_max_pos = {pos.x, y};
 				max_pos = (speed.y > 0 && new_max_pos.y > max_pos.y) ||
 										(speed.y < 0 && new_max_pos.y < max_pos.y)
@@ -139,15 +165,15 @@ std::pair<geom::Point2D, bool> Map::MoveDog(geom::Point2D pos, geom::Vec2D speed
 			}
 		} else {
 			if (moving_horizontally) {
-				double x = speed.x > 0 ? (road->GetStart().x + 0.4) : (road->GetStart().x - 0.4);
+				double x = speed.x > 0 ? (road.GetStart().x + 0.4) : (road.GetStart().x - 0.4);
 				geom::Point2D new_max_pos = {x, pos.y};
 				max_pos = (speed.x > 0 && new_max_pos.x > max_pos.x) ||
 										(speed.x < 0 && new_max_pos.x < max_pos.x)
 								  ? new_max_pos
 								  : max_pos;
 			} else {
-				double y = speed.y > 0 ? (std::max(road->GetStart().y, road->GetEnd().y) + 0.4)
-											  : (std::min(road->GetStart().y, road->GetEnd().y) - 0.4);
+				double y = speed.y > 0 ? (std::max(road.GetStart().y, road.GetEnd().y) + 0.4)
+											  : (std::min(road.GetStart().y, road.GetEnd().y) - 0.4);
 				geom::Point2D new_max_pos = {pos.x, y};
 				max_pos = (speed.y > 0 && new_max_pos.y > max_pos.y) ||
 										(speed.y < 0 && new_max_pos.y < max_pos.y)
@@ -155,29 +181,74 @@ std::pair<geom::Point2D, bool> Map::MoveDog(geom::Point2D pos, geom::Vec2D speed
 								  : max_pos;
 			}
 		}
-	}
+	});
 
 	return {max_pos, true};
 }
 
-bool GameSession::operator==(const GameSession& other) const { return map_ == other.map_; }
-
 Dog* GameSession::AddDog(std::string name) {
-	dogs_.push_back(Dog(name, last_id_++));
-	dogs_.back().SetBagCapacity(map_->GetBagCapacity());
-	return &dogs_.back();
+	Dog& dog = dogs_.emplace_back(std::move(name), last_id_++);
+	dog_slots_[dog.GetId()] = dogs_.size() - 1;
+	dog.SetBagCapacity(map_->GetBagCapacity());
+	dog.AttachTo(*dogs_storage_);
+	return &dog;
 }
 
 double GameSession::GetDefaultSpeed() const { return map_->GetDefaultSpeed(); }
 
 void GameSession::Tick(double ms) {
+	MoveDogsAndGatherLoot(ms);
+
+	int loot_count =
+		 loot_gen_.Generate(SecondsToTimeInterval(ms / 1000), lost_objects_.size(), dogs_.size());
+	int max_type = map_->GetLootTypes().size();
+	auto random_type = [max_type]() {
+		std::random_device rd;
+		std::mt19937 gen(rd());
+		std::uniform_int_distribution<int> dist(0, max_type - 1);
+		return dist(gen);
+	};
+
+	for (int i = 0; i < loot_count; ++i) {
+		int type = random_type();
+		geom::Point2D pos = map_->GetRandomRoadPosition();
+		AddLostObject({type, pos});
+	}
+	spawned_loot_count_ = loot_count;
+
+	CommitTickChanges();
+}
+
+void GameSession::Tick(double ms, const std::vector<LostObject>& spawned_loot) {
+	MoveDogsAndGatherLoot(ms);
+
+	for (const LostObject& loot : spawned_loot) {
+		AddLostObject({loot.type, loot.pos});
+	}
+	spawned_loot_count_ = spawned_loot.size();
+	// Иначе после повтора генератор выдал бы следующие трофеи не в те тики, что до сбоя
+	loot_gen_.Advance(SecondsToTimeInterval(ms / 1000), spawned_loot_count_);
+
+	CommitTickChanges();
+}
+
+std::vector<LostObject> GameSession::GetSpawnedLoot() const {
+	// Новые трофеи добавляются в конец после сбора
+	return {lost_objects_.end() - spawned_loot_count_, lost_objects_.end()};
+}
+
+void GameSession::MoveDogsAndGatherLoot(double ms) {
 	collision_detector::ItemGathererProvider provider;
-	for (Dog& dog : dogs_) {
-		geom::Point2D old_pos = dog.GetPosition();
-		auto [new_pos, should_stop] = map_->MoveDog(dog.GetPosition(), dog.GetSpeed(), ms);
-		dog.SetPosition(new_pos);
+	DogsStorage& storage = *dogs_storage_;
+	for (size_t slot = 0; slot < storage.Size(); ++slot) {
+		geom::Point2D old_pos = storage.positions[slot];
+		auto [new_pos, should_stop] = map_->MoveDog(old_pos, storage.speeds[slot], ms);
+		storage.positions[slot] = new_pos;
 		if (should_stop) {
-			dog.SetSpeed({0, 0});
+			storage.speeds[slot] = {0, 0};
+		}
+		if (new_pos != old_pos || should_stop) {
+			storage.MarkDirty(slot);
 		}
 
 		provider.AddGatherer({old_pos, new_pos, 0.3});
@@ -196,6 +267,7 @@ void GameSession::Tick(double ms) {
 
 	std::vector<collision_detector::GatheringEvent> events =
 		 collision_detector::FindGatherEvents(provider);
+	gather_events_ += events.size();
 	std::set<size_t, std::greater<size_t>> taken_items_;
 
 	for (collision_detector::GatheringEvent event : events) {
@@ -215,7 +287,8 @@ void GameSession::Tick(double ms) {
 			continue;
 		}
 
-		if (!dog.AddItem({lost_objects_[event.item_id].type, event.item_id})) {
+		const LostObject& loot = lost_objects_[event.item_id];
+		if (!dog.AddItem({loot.type, loot.id})) {
 			continue;
 		}
 
@@ -223,23 +296,28 @@ void GameSession::Tick(double ms) {
 	}
 
 	for (size_t item : taken_items_) {
+		++generation_;
+		pending_changes_.removed_loot.push_back(lost_objects_[item].id);
 		lost_objects_.erase(lost_objects_.begin() + item);
 	}
+}
 
-	int loot_count =
-		 loot_gen_.Generate(SecondsToTimeInterval(ms / 1000), lost_objects_.size(), dogs_.size());
-	int max_type = map_->GetLootTypes().size();
-	auto random_type = [max_type]() {
-		std::random_device rd;
-		std::mt19937 gen(rd());
-		std::uniform_int_distribution<int> dist(0, max_type - 1);
-		return dist(gen);
-	};
+void GameSession::CommitTickChanges() {
+	auto changes = std::make_shared<TickChanges>(std::move(pending_changes_));
+	pending_changes_ = {};
+	changes->tick = ++tick_;
 
-	for (int i = 0; i < loot_count; ++i) {
-		int type = random_type();
-		geom::Point2D pos = map_->GetRandomRoadPosition();
-		AddLostObject({type, pos});
+	DogsStorage& storage = *dogs_storage_;
+	changes->dogs.reserve(storage.dirty_slots.size());
+	for (size_t slot : storage.dirty_slots) {
+		changes->dogs.push_back(dogs_[slot].GetId());
+		storage.dirty[slot] = 0;
+	}
+	storage.dirty_slots.clear();
+
+	history_.push_back(std::move(changes));
+	if (history_.size() > HISTORY_DEPTH) {
+		history_.pop_front();
 	}
 }
 
@@ -268,27 +346,46 @@ const Map* Game::FindMap(const Map::Id& id) const noexcept {
 }
 
 GameSession* Game::AddGameSession(GameSession session) {
-	if (auto existing_session = FindGameSession(session)) {
-		return existing_session;
-	}
-
+	session.index_ = sessions_.size();
+	sessions_by_map_[session.GetMap()].push_back(session.index_);
 	sessions_.push_back(std::move(session));
 	return &sessions_.back();
 }
 
-GameSession* Game::FindGameSession(const GameSession& session) {
-	for (auto it = sessions_.begin(); it != sessions_.end(); ++it) {
-		if (*it == session) {
-			return &(*it);
+GameSession* Game::JoinSession(const Map* map) {
+	const std::optional<size_t> max_players = map->GetMaxPlayers();
+	GameSession* least_loaded = nullptr;
+	if (auto it = sessions_by_map_.find(map); it != sessions_by_map_.end()) {
+		for (size_t index : it->second) {
+			GameSession& session = sessions_[index];
+			if (max_players && session.GetDogs().size() >= *max_players) {
+				continue;
+			}
+			if (!least_loaded || session.GetDogs().size() < least_loaded->GetDogs().size()) {
+				least_loaded = &session;
+			}
 		}
 	}
 
-	return nullptr;
+	if (least_loaded) {
+		return least_loaded;
+	}
+	return AddGameSession(GameSession{map, loot_period_, loot_probability_});
 }
 
 const Map* GameSession::GetMap() const { return map_; }
 
+void Game::SetTickThreads(unsigned threads) {
+	tick_pool_ = threads > 1 ? std::make_unique<util::WorkerPool>(threads) : nullptr;
+}
+
 void Game::Tick(double ms) {
+	// Сессии не разделяют изменяемого состояния, поэтому их можно обрабатывать независимо
+	if (tick_pool_ && sessions_.size() > 1) {
+		tick_pool_->Run(sessions_.size(), [this, ms](size_t index) { sessions_[index].Tick(ms); });
+		return;
+	}
+
 	for (GameSession& session : sessions_) {
 		session.Tick(ms);
 	}
@@ -1,7 +1,9 @@
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
 #include <deque>
+#include <memory>
 #include <optional>
 #include <random>
 #include <string>
@@ -11,6 +13,7 @@
 #include "geom.h"
 #include "loot_generator.h"
 #include "tagged.h"
+#include "worker_pool.h"
 
 class GameSession;
 
@@ -51,6 +54,8 @@ struct Loot {
 struct LostObject {
 	int type;
 	geom::Point2D pos;
+	// Назначается сессией и не меняется, пока предмет лежит на карте
+	uint64_t id = 0;
 };
 
 struct TakenItem {
@@ -63,9 +68,9 @@ inline bool operator==(const TakenItem& v1, const TakenItem& v2) {
 }
 
 inline double GenerateRandomNumber() {
-	static std::random_device rd;
-	static std::mt19937 gen(rd());
-	static std::uniform_real_distribution<> dis(0.0, 1.0);
+	thread_local std::random_device rd;
+	thread_local std::mt19937 gen(rd());
+	thread_local std::uniform_real_distribution<> dis(0.0, 1.0);
 
 	return dis(gen);
 }
@@ -75,8 +80,6 @@ inline loot_gen::LootGenerator::TimeInterval SecondsToTimeInterval(double time)
 }
 
 class Road {
-	const double HALF_WIDTH = 0.4;
-
 	struct HorizontalTag {
 		explicit HorizontalTag() = default;
 	};
@@ -88,6 +91,7 @@ class Road {
  public:
 	constexpr static HorizontalTag HORIZONTAL{};
 	constexpr static VerticalTag VERTICAL{};
+	constexpr static double HALF_WIDTH = 0.4;
 
 	Road(HorizontalTag, Point start, Coord end_x) noexcept : start_{start}, end_{end_x, start.y} {}
 
@@ -108,6 +112,61 @@ class Road {
 	Point end_;
 };
 
+/*
+ * Индекс дорог карты. Концы дорог лежат в целых точках, а полуширина дороги меньше 0.5,
+ * поэтому точку могут содержать только горизонтальные дороги ряда round(y)
+ * и вертикальные дороги столбца round(x). Внутри ряда (столбца) отрезки отсортированы
+ * по началу, и поиск занимает O(log k) плюс количество найденных дорог.
+ */
+class RoadIndex {
+ public:
+	RoadIndex() = default;
+	explicit RoadIndex(const std::vector<Road>& roads);
+
+	// Вызывает fn(index) для индекса каждой дороги, на которой находится pos
+	template <typename Fn>
+	void ForEachRoadAt(geom::Point2D pos, Fn&& fn) const {
+		std::optional<Coord> row = ToLine(pos.y);
+		if (auto it = row ? rows_.find(*row) : rows_.end(); it != rows_.end()) {
+			it->second.ForEachAt(pos.x, fn);
+		}
+
+		std::optional<Coord> col = ToLine(pos.x);
+		if (auto it = col ? cols_.find(*col) : cols_.end(); it != cols_.end()) {
+			it->second.ForEachAt(pos.y, fn);
+		}
+	}
+
+ private:
+	struct Segment {
+		double from;
+		double to;
+		size_t road;
+	};
+
+	struct Line {
+		std::vector<Segment> segments;
+		// max_to[i] - наибольший конец среди segments[0..i]
+		std::vector<double> max_to;
+
+		template <typename Fn>
+		void ForEachAt(double pos, Fn& fn) const {
+			auto it = std::upper_bound(segments.begin(), segments.end(), pos,
+												[](double value, const Segment& s) { return value < s.from; });
+			for (size_t i = it - segments.begin(); i-- > 0 && max_to[i] >= pos;) {
+				if (segments[i].to >= pos) {
+					fn(segments[i].road);
+				}
+			}
+		}
+	};
+
+	static std::optional<Coord> ToLine(double value);
+
+	std::unordered_map<Coord, Line> rows_;
+	std::unordered_map<Coord, Line> cols_;
+};
+
 class Building {
  public:
 	explicit Building(Rectangle bounds) noexcept : bounds_{bounds} {}
@@ -156,7 +215,13 @@ class Map {
 
 	const Offices& GetOffices() const noexcept { return offices_; }
 
-	void AddRoad(const Road& road) { roads_.emplace_back(road); }
+	void AddRoad(const Road& road) {
+		roads_.emplace_back(road);
+		road_index_.reset();
+	}
+
+	// Строит индекс дорог. Вызывается после загрузки всех дорог карты
+	void BuildRoadIndex() { road_index_.emplace(roads_); }
 
 	void AddBuilding(const Building& building) { buildings_.emplace_back(building); }
 
@@ -181,113 +246,281 @@ class Map {
 
 	int GetBagCapacity() const { return bag_capacity_; }
 
+	// Сколько игроков помещается в одну сессию на карте. Без ограничения - одна сессия на карту
+	void SetMaxPlayers(std::optional<size_t> max_players) { max_players_ = max_players; }
+
+	std::optional<size_t> GetMaxPlayers() const { return max_players_; }
+
  private:
 	bool IsLineOnRoad(geom::Point2D p1, geom::Point2D p2) const;
 
+	template <typename Fn>
+	void ForEachRoadAt(geom::Point2D pos, Fn&& fn) const {
+		if (road_index_) {
+			road_index_->ForEachRoadAt(pos, [&](size_t index) { fn(roads_[index]); });
+			return;
+		}
+
+		for (const Road& road : roads_) {
+			if (road.IsOnRoad(pos)) {
+				fn(road);
+			}
+		}
+	}
+
 	using OfficeIdToIndex = std::unordered_map<Office::Id, size_t, util::TaggedHasher<Office::Id>>;
 
 	Id id_;
 	std::string name_;
 	Roads roads_;
+	std::optional<RoadIndex> road_index_;
 	Buildings buildings_;
 
 	OfficeIdToIndex warehouse_id_to_index_;
 	Offices offices_;
 	double def_speed_ = 1;
 	int bag_capacity_ = 3;
+	std::optional<size_t> max_players_;
 	std::vector<Loot> loot_types_;
 };
 
+using DogBag = std::vector<TakenItem>;
+
+/*
+ * Данные собак сессии, разложенные по столбцам. Цикл GameSession::Tick читает
+ * только позиции и скорости, и ему не приходится тянуть через кэш имена и рюкзаки.
+ */
+struct DogsStorage {
+	std::vector<geom::Point2D> positions;
+	std::vector<geom::Vec2D> speeds;
+	std::vector<Direction> directions;
+	std::vector<int> scores;
+	std::vector<DogBag> bags;
+	// Собаки, изменившиеся с конца прошлого тика
+	std::vector<char> dirty;
+	std::vector<size_t> dirty_slots;
+	// Увеличивается при каждом изменении любой собаки
+	uint64_t generation = 0;
+
+	size_t Size() const noexcept { return positions.size(); }
+
+	void MarkDirty(size_t slot) {
+		++generation;
+		if (!dirty[slot]) {
+			dirty[slot] = 1;
+			dirty_slots.push_back(slot);
+		}
+	}
+};
+
+// Что изменилось в сессии за один тик
+struct TickChanges {
+	uint64_t tick = 0;
+	std::vector<uint64_t> dogs;
+	std::vector<uint64_t> added_loot;
+	std::vector<uint64_t> removed_loot;
+};
+
+/*
+ * Собака либо хранит свои данные сама, либо, после добавления в сессию,
+ * ссылается на свою строку в DogsStorage сессии. Копия собаки всегда самостоятельна.
+ */
 class Dog {
  public:
-	using BagContent = std::vector<TakenItem>;
+	using BagContent = DogBag;
 
 	explicit Dog(std::string name, uint64_t id) : name_(name), id_(id) {}
 
+	Dog(const Dog& other)
+		 : name_(other.name_), id_(other.id_), bag_capacity_(other.bag_capacity_),
+			own_(other.CopyData()) {}
+
+	Dog(Dog&& other)
+		 : name_(std::move(other.name_)), id_(other.id_), bag_capacity_(other.bag_capacity_),
+			own_(other.storage_ ? other.CopyData() : std::move(other.own_)) {}
+
+	Dog& operator=(const Dog&) = delete;
+	Dog& operator=(Dog&&) = delete;
+
 	const std::string& GetName() const { return name_; }
 
 	uint64_t GetId() const { return id_; }
 
-	geom::Vec2D GetSpeed() const { return speed_; }
+	geom::Vec2D GetSpeed() const { return storage_ ? storage_->speeds[slot_] : own_.speed; }
 
-	geom::Point2D GetPosition() const { return pos_; }
+	geom::Point2D GetPosition() const { return storage_ ? storage_->positions[slot_] : own_.pos; }
 
-	Direction GetDirection() const { return dir_; }
+	Direction GetDirection() const { return storage_ ? storage_->directions[slot_] : own_.dir; }
 
-	void SetPosition(geom::Point2D pos) { pos_ = pos; }
+	void SetPosition(geom::Point2D pos) {
+		Touch();
+		(storage_ ? storage_->positions[slot_] : own_.pos) = pos;
+	}
 
-	void SetSpeed(geom::Vec2D speed) { speed_ = speed; }
+	void SetSpeed(geom::Vec2D speed) {
+		Touch();
+		(storage_ ? storage_->speeds[slot_] : own_.speed) = speed;
+	}
 
-	void SetDirection(Direction dir) { dir_ = dir; }
+	void SetDirection(Direction dir) {
+		Touch();
+		(storage_ ? storage_->directions[slot_] : own_.dir) = dir;
+	}
 
 	bool AddItem(TakenItem item) {
 		if (GetBagSize() == GetBagCapacity()) {
 			return false;
 		}
 
-		bag_.push_back(item);
+		Touch();
+		Bag().push_back(item);
 		return true;
 	}
 
-	const BagContent& GetBag() const { return bag_; }
+	const BagContent& GetBag() const { return storage_ ? storage_->bags[slot_] : own_.bag; }
 
-	void ClearBag() { bag_.clear(); }
+	void ClearBag() {
+		Touch();
+		Bag().clear();
+	}
 
-	size_t GetBagSize() const { return bag_.size(); }
+	size_t GetBagSize() const { return GetBag().size(); }
 
-	void AddScore(int score) { score_ += score; }
+	void AddScore(int score) {
+		Touch();
+		(storage_ ? storage_->scores[slot_] : own_.score) += score;
+	}
 
-	int GetScore() const { return score_; }
+	int GetScore() const { return storage_ ? storage_->scores[slot_] : own_.score; }
 
 	void SetBagCapacity(int capacity) { bag_capacity_ = capacity; }
 
 	int GetBagCapacity() const { return bag_capacity_; }
 
  private:
+	friend class GameSession;
+
+	struct OwnData {
+		geom::Point2D pos;
+		geom::Vec2D speed;
+		Direction dir = Direction::NORTH;
+		int score = 0;
+		BagContent bag;
+	};
+
+	BagContent& Bag() { return storage_ ? storage_->bags[slot_] : own_.bag; }
+
+	void Touch() {
+		if (storage_) {
+			storage_->MarkDirty(slot_);
+		}
+	}
+
+	OwnData CopyData() const { return {GetPosition(), GetSpeed(), GetDirection(), GetScore(), GetBag()}; }
+
+	// Переносит данные собаки в конец storage и дальше работает с ними там
+	void AttachTo(DogsStorage& storage) {
+		slot_ = storage.Size();
+		storage.positions.push_back(own_.pos);
+		storage.speeds.push_back(own_.speed);
+		storage.directions.push_back(own_.dir);
+		storage.scores.push_back(own_.score);
+		storage.bags.push_back(std::move(own_.bag));
+		storage.bags.back().reserve(bag_capacity_);
+		storage.dirty.push_back(0);
+		own_ = {};
+		storage_ = &storage;
+		Touch();
+	}
+
 	std::string name_;
 	uint64_t id_;
-	geom::Point2D pos_;
-	geom::Vec2D speed_;
-	Direction dir_ = Direction::NORTH;
-	BagContent bag_;
-	int score_ = 0;
 	int bag_capacity_ = 3;
+	DogsStorage* storage_ = nullptr;
+	size_t slot_ = 0;
+	OwnData own_;
 };
 
 class GameSession {
  public:
 	using Dogs = std::deque<Dog>;
+	using History = std::deque<std::shared_ptr<const TickChanges>>;
+
+	// Сколько последних тиков помнит сессия для инкрементальных ответов
+	constexpr static size_t HISTORY_DEPTH = 64;
+
 	explicit GameSession(const Map* map, double period, double probability)
 		 : map_(map), loot_gen_(SecondsToTimeInterval(period), probability, GenerateRandomNumber) {}
 
-	bool operator==(const GameSession& other) const;
 	Dog* AddDog(std::string name);
 	double GetDefaultSpeed() const;
 	const Map* GetMap() const;
 	void Tick(double ms);
+	// Тик, в котором вместо случайных появляются заданные трофеи. Нужен при повторе журнала
+	void Tick(double ms, const std::vector<LostObject>& spawned_loot);
+	// Трофеи, появившиеся в последнем тике
+	std::vector<LostObject> GetSpawnedLoot() const;
 	const Dogs& GetDogs() const { return dogs_; }
 	uint64_t GetLastDogId() const { return last_id_; }
 	void SetLastDogId(uint64_t id) { last_id_ = id; }
-	void AddExistingDog(Dog&& dog) { dogs_.push_back(std::move(dog)); }
-	void AddLostObject(LostObject obj) { lost_objects_.push_back(obj); }
+	Dog* AddExistingDog(Dog&& dog) {
+		Dog& added = dogs_.emplace_back(std::move(dog));
+		added.AttachTo(*dogs_storage_);
+		dog_slots_[added.GetId()] = dogs_.size() - 1;
+		return &added;
+	}
+	void AddLostObject(LostObject obj) {
+		++generation_;
+		obj.id = next_loot_id_++;
+		lost_objects_.push_back(obj);
+		pending_changes_.added_loot.push_back(obj.id);
+	}
 	Dog* FindDogById(uint64_t id) {
-		for (Dog& dog : dogs_) {
-			if (dog.GetId() == id) {
-				return &dog;
-			}
-		}
-
-		return nullptr;
+		auto it = dog_slots_.find(id);
+		return it != dog_slots_.end() ? &dogs_[it->second] : nullptr;
 	}
 
 	const std::deque<LostObject>& GetLostObjects() const { return lost_objects_; }
+	const loot_gen::LootGenerator& GetLootGenerator() const noexcept { return loot_gen_; }
+
+	// Номер последнего завершённого тика
+	uint64_t GetTick() const noexcept { return tick_; }
+
+	// Изменения за последние тики, не больше HISTORY_DEPTH, от старых к новым
+	const History& GetHistory() const noexcept { return history_; }
+
+	// Меняется при любом изменении собак и трофеев сессии, но не при пустом тике
+	uint64_t GetGeneration() const noexcept { return generation_ + dogs_storage_->generation; }
+
+	// Номер сессии в Game::GetGameSessions()
+	size_t GetIndex() const noexcept { return index_; }
+
+	// Сколько столкновений собак с трофеями и базами нашлось за все тики
+	uint64_t GetGatherEventCount() const noexcept { return gather_events_; }
 
  private:
+	friend class Game;
+
+	void MoveDogsAndGatherLoot(double ms);
+	void CommitTickChanges();
+
 	uint64_t last_id_ = 0;
 	Dogs dogs_;
+	// id собаки -> её номер в dogs_ и строка в dogs_storage_
+	std::unordered_map<uint64_t, size_t> dog_slots_;
+	// Лежит в куче, чтобы собаки продолжали ссылаться на него после перемещения сессии
+	std::unique_ptr<DogsStorage> dogs_storage_ = std::make_unique<DogsStorage>();
 	const Map* map_;
+	size_t index_ = 0;
 	std::deque<LostObject> lost_objects_;
+	uint64_t next_loot_id_ = 0;
+	size_t spawned_loot_count_ = 0;
+	uint64_t generation_ = 0;
+	uint64_t gather_events_ = 0;
 	loot_gen::LootGenerator loot_gen_;
+	uint64_t tick_ = 0;
+	TickChanges pending_changes_;
+	History history_;
 };
 
 class Game {
@@ -297,23 +530,28 @@ class Game {
 	void AddMap(Map map);
 	const Maps& GetMaps() const noexcept;
 	const Map* FindMap(const Map::Id& id) const noexcept;
+	// Добавляет новую сессию, даже если на её карте уже есть другие
 	GameSession* AddGameSession(GameSession session);
-	GameSession* FindGameSession(const GameSession& session);
 	void Tick(double ms);
+	// При threads > 1 сессии обрабатываются в Tick параллельно на пуле из threads потоков
+	void SetTickThreads(unsigned threads);
+	unsigned GetTickThreads() const noexcept { return tick_pool_ ? tick_pool_->GetThreadCount() : 1; }
 	void SetPeriod(double period) { loot_period_ = period; }
 	void SetProbability(double probability) { loot_probability_ = probability; }
 	double GetPeriod() const { return loot_period_; }
 	double GetProbability() const { return loot_probability_; }
 	const std::deque<GameSession>& GetGameSessions() const { return sessions_; }
+	GameSession* GetGameSession(size_t index) {
+		return index < sessions_.size() ? &sessions_[index] : nullptr;
+	}
+	// Первая сессия на карте map
 	GameSession* FindSessionByMap(const model::Map* map) {
-		for (GameSession& session : sessions_) {
-			if (session.GetMap() == map) {
-				return &session;
-			}
-		}
-
-		return nullptr;
+		auto it = sessions_by_map_.find(map);
+		return it != sessions_by_map_.end() ? &sessions_[it->second.front()] : nullptr;
 	}
+	// Наименее заполненная сессия на карте map, в которой есть место.
+	// Если все сессии карты заполнены, открывается новая
+	GameSession* JoinSession(const model::Map* map);
 
  private:
 	using MapIdHasher = util::TaggedHasher<Map::Id>;
@@ -322,8 +560,11 @@ class Game {
 	Maps maps_;
 	MapIdToIndex map_id_to_index_;
 	std::deque<GameSession> sessions_;
+	// Номера сессий каждой карты в sessions_
+	std::unordered_map<const Map*, std::vector<size_t>> sessions_by_map_;
 	double loot_period_;
 	double loot_probability_;
+	std::unique_ptr<util::WorkerPool> tick_pool_;
 };
 
 } // namespace model
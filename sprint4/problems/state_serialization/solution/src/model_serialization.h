@@ -2,11 +2,14 @@
 #include <boost/serialization/optional.hpp>
 #include <boost/serialization/string.hpp>
 #include <boost/serialization/vector.hpp>
+#include <boost/serialization/version.hpp>
 
 #include "model.h"
 
 #include "geom.h"
 
+#include <limits>
+
 namespace geom {
 
 template <typename Archive>
@@ -77,15 +80,23 @@ class DogRepr {
 namespace app::serialization {
 
 struct PlayerRepr {
+	// В старых файлах сессия игрока определяется по карте
+	constexpr static uint64_t UNKNOWN_SESSION = std::numeric_limits<uint64_t>::max();
+
 	uint64_t id = 0;
 	uint64_t dog_id = 0;
 	std::string map_id;
+	// Номер сессии в GameStateRepr::sessions
+	uint64_t session_index = UNKNOWN_SESSION;
 
 	template <typename Archive>
-	void serialize(Archive& ar, [[maybe_unused]] const unsigned version) {
+	void serialize(Archive& ar, const unsigned version) {
 		ar & id;
 		ar & dog_id;
 		ar & map_id;
+		if (version >= 1) {
+			ar & session_index;
+		}
 	}
 };
 
@@ -165,12 +176,48 @@ namespace serialization {
 struct StateRepr {
 	model::GameStateRepr game_state;
 	app::serialization::PlayersRepr players_state;
+	// Номер первой записи журнала, не вошедшей в снимок
+	uint64_t journal_seq = 0;
+	// Файлы с сессиями, которые хранятся отдельно, относительно каталога снимка
+	std::vector<std::string> segments;
 
 	template <typename Archive>
 	void serialize(Archive& ar, const unsigned version) {
 		ar & game_state;
 		ar & players_state;
+		if (version >= 1) {
+			ar & journal_seq;
+		}
+		if (version >= 2) {
+			ar & segments;
+		}
+	}
+};
+
+// Сессия вместе с её игроками, хранится в отдельном от снимка файле
+struct SessionSegmentRepr {
+	model::GameSessionRepr session;
+	std::vector<app::serialization::PlayerRepr> players;
+	std::vector<app::serialization::TokenRepr> tokens;
+
+	template <typename Archive>
+	void serialize(Archive& ar, [[maybe_unused]] const unsigned version) {
+		ar & session;
+		ar & players;
+		ar & tokens;
 	}
 };
 
+// Снимок IncrementalStateWriter: файл состояния и сессии, изменившиеся с прошлого сохранения
+struct IncrementalStateRepr {
+	StateRepr manifest;
+	// Имя файла сессии и её содержимое
+	std::vector<std::pair<std::string, SessionSegmentRepr>> changed;
+	// Поколения сессий в порядке manifest.segments
+	std::vector<uint64_t> generations;
+};
+
 } // namespace serialization
+
+BOOST_CLASS_VERSION(::serialization::StateRepr, 2)
+BOOST_CLASS_VERSION(::app::serialization::PlayerRepr, 1)
@@ -4,12 +4,37 @@
 
 namespace app {
 
+bool Player::Move(std::string_view move) {
+	double def_speed = GetDefaultSpeed();
+	if (move == "U") {
+		SetDirection(model::Direction::NORTH);
+		SetSpeed({0, -def_speed});
+	} else if (move == "D") {
+		SetDirection(model::Direction::SOUTH);
+		SetSpeed({0, def_speed});
+	} else if (move == "L") {
+		SetDirection(model::Direction::WEST);
+		SetSpeed({-def_speed, 0});
+	} else if (move == "R") {
+		SetDirection(model::Direction::EAST);
+		SetSpeed({def_speed, 0});
+	} else if (move.empty()) {
+		SetSpeed({0, 0});
+	} else {
+		return false;
+	}
+
+	return true;
+}
+
 Player* Players::Add(model::GameSession* session, model::Dog* dog) {
 	if (!session || !dog) {
 		throw std::invalid_argument("Session and Dog cannot be null");
 	}
 
 	players_.push_back(Player(session, dog, last_player_id_++));
+	session_players_[session].push_back(&players_.back());
+	players_by_id_[players_.back().GetId()] = &players_.back();
 
 	return &players_.back();
 }
@@ -24,43 +49,10 @@ std::vector<std::string> Players::GetNames() const {
 	return names;
 }
 
-json::object Players::GetPlayersInfo() const {
-	json::object players;
-
-	for (const Player& player : players_) {
-		json::object player_info;
-		PlayerInfo info = player.GetInfo();
-		player_info["pos"] = {info.pos.x, info.pos.y};
-		player_info["speed"] = {info.speed.x, info.speed.y};
-		player_info["score"] = info.score;
-		switch (info.dir) {
-		case model::Direction::NORTH:
-			player_info["dir"] = "U";
-			break;
-		case model::Direction::SOUTH:
-			player_info["dir"] = "D";
-			break;
-		case model::Direction::WEST:
-			player_info["dir"] = "L";
-			break;
-		case model::Direction::EAST:
-			player_info["dir"] = "R";
-			break;
-		}
-
-		json::array bag;
-		for (model::TakenItem item : player.GetBag()) {
-			json::object bag_item;
-			bag_item["id"] = item.id;
-			bag_item["type"] = item.type;
-			bag.push_back(std::move(bag_item));
-		}
-		
-		player_info["bag"] = std::move(bag);
-		players[std::to_string(player.GetId())] = player_info;
-	}
-
-	return players;
+const Players::SessionPlayers& Players::GetSessionPlayers(const model::GameSession* session) const {
+	static const SessionPlayers empty;
+	auto it = session_players_.find(session);
+	return it != session_players_.end() ? it->second : empty;
 }
 
 } // namespace app
@@ -6,8 +6,12 @@
 #include <deque>
 #include <iomanip>
 #include <random>
+#include <shared_mutex>
 #include <sstream>
 #include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 
 namespace json = boost::json;
 
@@ -53,6 +57,9 @@ class Player {
 
 	double GetDefaultSpeed() const { return session_->GetDefaultSpeed(); }
 
+	// move - "U", "D", "L", "R" или пустая строка для остановки. Для других значений false
+	bool Move(std::string_view move);
+
 	const std::vector<model::TakenItem>& GetBag() const { return dog_->GetBag(); }
 
  private:
@@ -63,10 +70,17 @@ class Player {
 
 class Players {
  public:
+	using SessionPlayers = std::vector<const Player*>;
+
 	Player* Add(model::GameSession* session, model::Dog* dog);
 	Player* FindByDogIdAndMapId(int dog_id, const std::string& map_id);
+	Player* FindById(uint64_t id) {
+		auto it = players_by_id_.find(id);
+		return it != players_by_id_.end() ? it->second : nullptr;
+	}
 	std::vector<std::string> GetNames() const;
-	json::object GetPlayersInfo() const;
+	// Игроки сессии в порядке добавления
+	const SessionPlayers& GetSessionPlayers(const model::GameSession* session) const;
 	const std::deque<Player>& GetAllPlayers() const noexcept { return players_; }
 	std::deque<Player>& GetAllPlayers() noexcept { return players_; }
 	uint64_t GetLastPlayerId() const noexcept { return last_player_id_; }
@@ -77,11 +91,16 @@ class Players {
 		}
 
 		players_.push_back(Player(session, dog, id));
+		session_players_[session].push_back(&players_.back());
+		players_by_id_[id] = &players_.back();
 		return &players_.back();
 	}
 
  private:
+	// deque не перемещает игроков, поэтому указатели в индексах и токенах остаются верными
 	std::deque<Player> players_;
+	std::unordered_map<uint64_t, Player*> players_by_id_;
+	std::unordered_map<const model::GameSession*, SessionPlayers> session_players_;
 	uint64_t last_player_id_ = 0;
 };
 
@@ -95,7 +114,9 @@ class PlayerTokens {
  public:
 	PlayerTokens() = default;
 
-	Player* FindPlayerByToken(Token token) {
+	// Поиск по токену выполняется и вне api_strand, поэтому таблица защищена
+	Player* FindPlayerByToken(Token token) const {
+		std::shared_lock lock(mutex_);
 		auto it = token_to_player_.find(token);
 		if (it != token_to_player_.end()) {
 			return it->second;
@@ -106,6 +127,7 @@ class PlayerTokens {
 
 	Token AddPlayer(Player* player) {
 		Token token = MakeToken();
+		std::unique_lock lock(mutex_);
 		token_to_player_[token] = player;
 
 		return token;
@@ -126,7 +148,10 @@ class PlayerTokens {
 		return token_to_player_;
 	}
 
-	void SetTokenForPlayer(const Token& token, Player* player) { token_to_player_[token] = player; }
+	void SetTokenForPlayer(const Token& token, Player* player) {
+		std::unique_lock lock(mutex_);
+		token_to_player_[token] = player;
+	}
 
  private:
 	std::random_device random_device_;
@@ -140,6 +165,7 @@ class PlayerTokens {
 	}()};
 
 	std::unordered_map<Token, Player*, util::TaggedHasher<Token>> token_to_player_;
+	mutable std::shared_mutex mutex_;
 };
 
 } // namespace app
@@ -0,0 +1,108 @@
+#include "recycling_allocator.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <new>
+
+namespace util {
+
+namespace {
+
+constexpr size_t MIN_SHIFT = std::countr_zero(BlockCache::MIN_BLOCK_SIZE);
+constexpr size_t CLASS_COUNT = std::countr_zero(BlockCache::MAX_BLOCK_SIZE) - MIN_SHIFT + 1;
+
+// Номер класса, в блок которого помещается size байт
+size_t GetSizeClass(size_t size) noexcept {
+	return std::bit_width(std::max(size, BlockCache::MIN_BLOCK_SIZE) - 1) - MIN_SHIFT;
+}
+
+// Блоки, освобождённые при завершении потока после разрушения его кэша, уходят сразу в delete
+thread_local bool cache_destroyed = false;
+
+class ThreadCache {
+ public:
+	ThreadCache() = default;
+	ThreadCache(const ThreadCache&) = delete;
+	ThreadCache& operator=(const ThreadCache&) = delete;
+
+	~ThreadCache() {
+		cache_destroyed = true;
+		for (size_t size_class = 0; size_class < CLASS_COUNT; ++size_class) {
+			while (FreeBlock* block = free_[size_class].head) {
+				free_[size_class].head = block->next;
+				::operator delete(block, BlockCache::MIN_BLOCK_SIZE << size_class);
+			}
+		}
+	}
+
+	void* Allocate(size_t size_class) {
+		FreeList& list = free_[size_class];
+		if (FreeBlock* block = list.head) {
+			list.head = block->next;
+			--list.count;
+			++stats_.hits;
+			return block;
+		}
+		++stats_.misses;
+		return ::operator new(BlockCache::MIN_BLOCK_SIZE << size_class);
+	}
+
+	void Deallocate(void* ptr, size_t size_class) noexcept {
+		FreeList& list = free_[size_class];
+		if (list.count == BlockCache::MAX_CACHED_BLOCKS) {
+			return ::operator delete(ptr, BlockCache::MIN_BLOCK_SIZE << size_class);
+		}
+		list.head = new (ptr) FreeBlock{list.head};
+		++list.count;
+	}
+
+	BlockCache::Stats GetStats() const noexcept { return stats_; }
+
+ private:
+	// Свободный блок хранит указатель на следующий прямо в своей памяти
+	struct FreeBlock {
+		FreeBlock* next;
+	};
+
+	struct FreeList {
+		FreeBlock* head = nullptr;
+		size_t count = 0;
+	};
+
+	std::array<FreeList, CLASS_COUNT> free_{};
+	BlockCache::Stats stats_;
+};
+
+ThreadCache& GetThreadCache() {
+	thread_local ThreadCache cache;
+	return cache;
+}
+
+} // namespace
+
+void* BlockCache::Allocate(size_t size) {
+	if (size > MAX_BLOCK_SIZE) {
+		return ::operator new(size);
+	}
+	if (cache_destroyed) {
+		return ::operator new(MIN_BLOCK_SIZE << GetSizeClass(size));
+	}
+	return GetThreadCache().Allocate(GetSizeClass(size));
+}
+
+void BlockCache::Deallocate(void* ptr, size_t size) noexcept {
+	if (size > MAX_BLOCK_SIZE) {
+		return ::operator delete(ptr, size);
+	}
+	if (cache_destroyed) {
+		return ::operator delete(ptr, MIN_BLOCK_SIZE << GetSizeClass(size));
+	}
+	GetThreadCache().Deallocate(ptr, GetSizeClass(size));
+}
+
+BlockCache::Stats BlockCache::GetThreadStats() noexcept {
+	return GetThreadCache().GetStats();
+}
+
+} // namespace util
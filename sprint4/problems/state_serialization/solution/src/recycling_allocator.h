@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace util {
+
+/*
+ * Кэш освобождённых блоков памяти, свой у каждого потока. Блоки до MAX_BLOCK_SIZE байт
+ * делятся на классы по степеням двойки, и освобождённый блок возвращается в список своего
+ * класса, а не в malloc. Блок можно освободить в другом потоке: он попадёт в кэш того
+ * потока, где освобождён. Каждый список хранит не больше MAX_CACHED_BLOCKS блоков, чтобы
+ * поток, который только освобождает память, не копил её без предела.
+ */
+class BlockCache {
+ public:
+	static constexpr size_t MIN_BLOCK_SIZE = 16;
+	static constexpr size_t MAX_BLOCK_SIZE = 4096;
+	static constexpr size_t MAX_CACHED_BLOCKS = 64;
+
+	struct Stats {
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+	};
+
+	static void* Allocate(size_t size);
+	// size - тот же размер, что был передан в Allocate
+	static void Deallocate(void* ptr, size_t size) noexcept;
+
+	// Статистика кэша текущего потока
+	static Stats GetThreadStats() noexcept;
+};
+
+/*
+ * Аллокатор без состояния поверх BlockCache. Все экземпляры взаимозаменяемы, поэтому
+ * контейнеры и сообщения Beast с ним можно перемещать между потоками, как с std::allocator.
+ */
+template <typename T>
+class RecyclingAllocator {
+ public:
+	using value_type = T;
+
+	RecyclingAllocator() noexcept = default;
+	template <typename U>
+	RecyclingAllocator(const RecyclingAllocator<U>&) noexcept {}
+
+	T* allocate(size_t n) { return static_cast<T*>(BlockCache::Allocate(n * sizeof(T))); }
+	void deallocate(T* ptr, size_t n) noexcept { BlockCache::Deallocate(ptr, n * sizeof(T)); }
+
+	template <typename U>
+	bool operator==(const RecyclingAllocator<U>&) const noexcept {
+		return true;
+	}
+};
+
+} // namespace util
@@ -2,41 +2,6 @@
 
 namespace http_handler {
 
-std::string ToLower(std::string str) {
-	std::transform(str.begin(), str.end(), str.begin(),
-						[](unsigned char c) { return std::tolower(c); });
-	return str;
-}
-
-std::string GetMimeType(const fs::path& ext) {
-	static const std::unordered_map<std::string, std::string> mime_types{
-		 {".htm", "text/html"},			{".html", "text/html"},
-		 {".css", "text/css"},			{".txt", "text/plain"},
-		 {".js", "text/javascript"},	{".json", "application/json"},
-		 {".xml", "application/xml"}, {".png", "image/png"},
-		 {".jpg", "image/jpeg"},		{".jpe", "image/jpeg"},
-		 {".jpeg", "image/jpeg"},		{".gif", "image/gif"},
-		 {".bmp", "image/bmp"},			{".ico", "image/vnd.microsoft.icon"},
-		 {".tiff", "image/tiff"},		{".tif", "image/tiff"},
-		 {".svg", "image/svg+xml"},	{".svgz", "image/svg+xml"},
-		 {".mp3", "audio/mpeg"}};
-	auto ext_str = ToLower(ext.string());
-	auto it = mime_types.find(ext_str);
-	return it != mime_types.end() ? it->second : "application/octet-stream";
-}
-
-bool IsSubPath(fs::path path, fs::path base) {
-	path = fs::weakly_canonical(path);
-	base = fs::weakly_canonical(base);
-
-	for (auto b = base.begin(), p = path.begin(); b != base.end(); ++b, ++p) {
-		if (p == path.end() || *p != *b) {
-			return false;
-		}
-	}
-	return true;
-}
-
 std::string DecodeUrl(std::string_view str) {
 	std::string result;
 	result.reserve(str.size());
@@ -60,5 +25,92 @@ std::string DecodeUrl(std::string_view str) {
 	return result;
 }
 
+RequestHandler::StringResponse RequestHandler::MetricsResponse(unsigned version, bool keep_alive,
+																					bool head) const {
+	StringResponse res{http::status::ok, version};
+	res.set(http::field::content_type, "text/plain; version=0.0.4");
+	res.set(http::field::cache_control, "no-cache");
+	res.keep_alive(keep_alive);
+	WriteMetrics(res.body());
+	res.prepare_payload();
+	if (head) {
+		res.body().clear();
+	}
+	return res;
+}
+
+void RequestHandler::WriteMetrics(std::string& out) const {
+	util::PrometheusWriter writer(out);
+	request_metrics_.Write(writer);
+
+	uint64_t dogs = 0;
+	uint64_t gather_events = 0;
+	for (const model::GameSession& session : game_.GetGameSessions()) {
+		dogs += session.GetDogs().size();
+		gather_events += session.GetGatherEventCount();
+	}
+	writer.Family("game_server_sessions", "gauge", "Open game sessions")
+		 .Sample("game_server_sessions", "", static_cast<uint64_t>(game_.GetGameSessions().size()));
+	writer.Family("game_server_dogs", "gauge", "Dogs in all game sessions")
+		 .Sample("game_server_dogs", "", dogs);
+	writer.Family("game_server_gather_events_total", "counter",
+					  "Collisions of dogs with loot and offices found by ticks")
+		 .Sample("game_server_gather_events_total", "", gather_events);
+
+	if (tick_stats_) {
+		writer.Family("game_server_tick_duration_seconds", "histogram", "Time spent in one tick");
+		uint64_t cumulative = 0;
+		for (size_t bucket = 0; bucket < TickStats::BUCKET_BOUNDS.size(); ++bucket) {
+			cumulative += tick_stats_->GetBucketCount(bucket);
+			writer.Bucket("game_server_tick_duration_seconds", "",
+							  TickStats::BUCKET_BOUNDS[bucket].count() * 1e-6, cumulative);
+		}
+		writer.Bucket("game_server_tick_duration_seconds", "", std::nullopt,
+						  tick_stats_->GetTickCount());
+		writer.Sample("game_server_tick_duration_seconds_sum", "",
+						  tick_stats_->GetTotalTime().count() * 1e-6);
+		writer.Sample("game_server_tick_duration_seconds_count", "", tick_stats_->GetTickCount());
+
+		writer.Family("game_server_tick_steps_total", "counter", "Game time steps made by ticks")
+			 .Sample("game_server_tick_steps_total", "", tick_stats_->GetStepCount());
+		writer.Family("game_server_tick_overruns_total", "counter", "Ticks longer than the tick period")
+			 .Sample("game_server_tick_overruns_total", "", tick_stats_->GetOverrunCount());
+		writer.Family("game_server_tick_missed_deadlines_total", "counter",
+						  "Tick deadlines skipped because the previous tick was late")
+			 .Sample("game_server_tick_missed_deadlines_total", "", tick_stats_->GetMissedDeadlineCount());
+		writer.Family("game_server_tick_dropped_seconds_total", "counter",
+						  "Game time dropped because it exceeded the catch-up budget")
+			 .Sample("game_server_tick_dropped_seconds_total", "",
+						tick_stats_->GetDroppedTime().count() * 1e-3);
+	}
+
+	const StateSaver::Metrics saver = state_saver_.GetMetrics();
+	writer.Family("game_server_state_saves_total", "counter", "Completed state saves")
+		 .Sample("game_server_state_saves_total", "", saver.saves);
+	writer.Family("game_server_state_saves_deferred_total", "counter",
+					  "State saves postponed until the previous write finished")
+		 .Sample("game_server_state_saves_deferred_total", "", saver.deferred);
+	writer.Family("game_server_state_capture_seconds", "gauge", "Time to capture the game state")
+		 .Sample("game_server_state_capture_seconds", "kind=\"last\"",
+					saver.last_capture_time.count() * 1e-6)
+		 .Sample("game_server_state_capture_seconds", "kind=\"max\"",
+					saver.max_capture_time.count() * 1e-6);
+	writer.Family("game_server_state_write_seconds", "gauge", "Time to encode and write the state file")
+		 .Sample("game_server_state_write_seconds", "kind=\"last\"", saver.last_write_time.count() * 1e-6)
+		 .Sample("game_server_state_write_seconds", "kind=\"max\"", saver.max_write_time.count() * 1e-6);
+
+	const StaticFiles::Stats static_stats = static_files_.GetStats();
+	writer.Family("game_server_static_lookups_total", "counter",
+					  "Static file lookups answered from the path cache or from disk")
+		 .Sample("game_server_static_lookups_total", "result=\"hit\"", static_stats.hits)
+		 .Sample("game_server_static_lookups_total", "result=\"miss\"", static_stats.misses);
+	writer.Family("game_server_static_cached_bytes", "gauge", "Static file content kept in memory")
+		 .Sample("game_server_static_cached_bytes", "", static_stats.cached_bytes);
+
+	for (const MetricsSource& source : metrics_sources_) {
+		source(writer);
+	}
+}
+
 } // namespace http_handler
 
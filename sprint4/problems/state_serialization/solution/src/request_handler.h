@@ -4,15 +4,22 @@
 #include "http_server.h"
 #include "logger.h"
 #include "model.h"
+#include "request_metrics.h"
+#include "shared_buffer_body.h"
+#include "static_files.h"
 #include "state_saver.h"
+#include "tick_stats.h"
 
 #include <boost/beast/http/empty_body.hpp>
+#include <boost/beast/http/file_body.hpp>
 #include <boost/beast/http/string_body.hpp>
 #include <boost/json.hpp>
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <string>
+#include <vector>
 
 namespace json = boost::json;
 
@@ -22,141 +29,230 @@ namespace http = beast::http;
 namespace fs = std::filesystem;
 namespace net = boost::asio;
 
-std::string ToLower(std::string str);
-std::string GetMimeType(const std::filesystem::path& ext);
 std::string DecodeUrl(std::string_view str);
-bool IsSubPath(fs::path path, fs::path base);
 
 class RequestHandler : public std::enable_shared_from_this<RequestHandler> {
  public:
 	using Strand = net::strand<net::io_context::executor_type>;
 
-	explicit RequestHandler(model::Game& game, fs::path static_files, Strand strand, bool randomize,
+	// tick_stats - статистика тикера, nullptr, если игра тикает только по запросам
+	explicit RequestHandler(model::Game& game, StaticFiles& static_files, Strand strand, bool randomize,
 									bool auto_tick, StateSaver& saver, app::Players& players,
-									app::PlayerTokens& tokens)
-		 : api_handler_(game, randomize, auto_tick, saver, players, tokens),
-			static_files_(static_files), api_strand_(strand) {}
+									app::PlayerTokens& tokens, app::StateView& state_view,
+									const RequestMetrics& request_metrics, const TickStats* tick_stats)
+		 : api_handler_(game, randomize, auto_tick, saver, players, tokens, state_view),
+			static_files_(static_files), api_strand_(strand), game_(game), state_saver_(saver),
+			request_metrics_(request_metrics), tick_stats_(tick_stats) {}
 
 	RequestHandler(const RequestHandler&) = delete;
 	RequestHandler& operator=(const RequestHandler&) = delete;
 
+	// Дописывает метрики других частей сервера в ответ /metrics
+	using MetricsSource = std::function<void(util::PrometheusWriter& writer)>;
+
+	// Вызывается до начала обслуживания запросов
+	void AddMetricsSource(MetricsSource source) { metrics_sources_.push_back(std::move(source)); }
+
 	template <typename Body, typename Allocator, typename Send>
 	void operator()(http::request<Body, http::basic_fields<Allocator>>&& req, Send&& send) {
 		try {
-			EndPoint endpoint(std::string(req.target()));
+			// EndPoint ссылается на target запроса и не должен его пережить
+			EndPoint endpoint({req.target().data(), req.target().size()});
+			if (endpoint.IsMetricsReq()) {
+				return MetricsRequest(req, std::move(send));
+			}
+
 			if (endpoint.IsApiReq()) {
-				auto handle = [&endpoint, self = shared_from_this(), send,
-									req = std::forward<decltype(req)>(req)] {
+				// Только мутации мира проходят через api_strand
+				if (ApiHandler::IsReadOnly(endpoint)) {
+					return api_handler_(endpoint, req, std::move(send));
+				}
+
+				// Запрос переезжает в лямбду, поэтому EndPoint строится заново по его target
+				auto handle = [self = shared_from_this(), send, req = std::forward<decltype(req)>(req)] {
 					try {
 						assert(self->api_strand_.running_in_this_thread());
+						EndPoint endpoint({req.target().data(), req.target().size()});
 						return self->api_handler_(endpoint, req, std::move(send));
 					} catch (const std::exception& e) {
-						return send(ServerError(req,
-														json::serialize(json::object{{"code", "internalError"},
-																							  {"message", e.what()}}),
-														"application/json"));
+						return send(
+							 ServerError(req, ErrorBody("internalError", e.what()), "application/json"));
 					}
 				};
-				return net::dispatch(api_strand_, handle);
+				// Запрос приходит из strand сессии, возможно, из другого io_context,
+				// поэтому в api_strand он всегда ставится в очередь
+				return net::post(api_strand_, handle);
 			}
 
 			if (req.method() != http::verb::get) {
-				return send(
-					 BadRequest(req,
-									json::serialize(json::object{{"code", "badRequest"},
-																		  {"message", "Unsupported http method"}}),
-									"application/json"));
+				return send(BadRequest(req, ErrorBody("badRequest", "Unsupported http method"),
+											  "application/json"));
 			}
 
 			return GetStaticFiles(endpoint, req, std::move(send));
 		} catch (const std::exception& e) {
-			return send(ServerError(
-				 req, json::serialize(json::object{{"code", "internalError"}, {"message", e.what()}}),
-				 "application/json"));
+			return send(
+				 ServerError(req, ErrorBody("internalError", e.what()), "application/json"));
 		}
 	}
 
  private:
-	template <typename Body, typename Allocator, typename Send>
-	void GetStaticFiles(const EndPoint& endpoint,
-							  const http::request<Body, http::basic_fields<Allocator>>& req, Send&& send) {
-		std::string path_str = DecodeUrl(endpoint.GetEndPoint());
+	using StringResponse = http::response<http::string_body, Fields>;
 
-		if (path_str.empty() || path_str.back() == '/') {
-			path_str += "index.html";
+	// Сессии и собаки читаются на api_strand, остальные метрики доступны из любого потока
+	template <typename Body, typename Allocator, typename Send>
+	void MetricsRequest(const http::request<Body, http::basic_fields<Allocator>>& req, Send&& send) {
+		if (req.method() != http::verb::get && req.method() != http::verb::head) {
+			auto res = MethodNotAllowed(req, "Only GET and HEAD methods are expected", "text/plain");
+			res.set(http::field::allow, "GET, HEAD");
+			return send(std::move(res));
 		}
 
-		if (path_str.front() == '/') {
-			path_str = path_str.substr(1);
-		}
+		auto handle = [self = shared_from_this(), send, version = req.version(),
+							keep_alive = req.keep_alive(), head = req.method() == http::verb::head] {
+			assert(self->api_strand_.running_in_this_thread());
+			return send(self->MetricsResponse(version, keep_alive, head));
+		};
+		return net::post(api_strand_, handle);
+	}
 
-		fs::path path = static_files_ / path_str;
+	StringResponse MetricsResponse(unsigned version, bool keep_alive, bool head) const;
+	void WriteMetrics(std::string& out) const;
 
-		if (!IsSubPath(path, static_files_)) {
+	template <typename Body, typename Allocator, typename Send>
+	void GetStaticFiles(const EndPoint& endpoint,
+							  const http::request<Body, http::basic_fields<Allocator>>& req, Send&& send) {
+		StaticFiles::Resolution resolution = static_files_.Resolve(DecodeUrl(endpoint.GetEndPoint()));
+		if (resolution.status == StaticFiles::Status::OUTSIDE_ROOT) {
 			return send(
 				 BadRequest(req, "Attempt to get a file outside the root directory", "text/plain"));
 		}
-
-		if (!fs::exists(path) || !fs::is_regular_file(path)) {
+		if (resolution.status == StaticFiles::Status::NOT_FOUND) {
 			return send(NotFound(req, "File not found", "text/plain"));
 		}
 
-		auto mime_type = GetMimeType(path.extension());
+		const StaticFile& file = *resolution.file;
+		const EncodedContent* encoded = nullptr;
+		if (auto it = req.find(http::field::accept_encoding); it != req.end()) {
+			encoded = ChooseEncoding({it->value().data(), it->value().size()}, file);
+		}
 
-		std::ifstream file(path, std::ios::binary);
-		if (!file) {
-			return send(NotFound(req, "File not found", "text/plain"));
+		if (IsNotModified(req, file, encoded ? encoded->etag : file.etag)) {
+			http::response<http::empty_body, Fields> res{http::status::not_modified, req.version()};
+			SetFileHeaders(res, file, encoded);
+			res.keep_alive(req.keep_alive());
+			return send(std::move(res));
+		}
+
+		// Содержимое из кэша отдаётся без копирования, пока ответ держит ссылку на файл
+		if (file.content) {
+			http::response<SharedBufferBody, Fields> res{http::status::ok, req.version()};
+			SetFileHeaders(res, file, encoded);
+			res.keep_alive(req.keep_alive());
+			res.body() = {resolution.file,
+								encoded ? std::string_view{encoded->data} : std::string_view{*file.content}};
+			res.prepare_payload();
+			return send(std::move(res));
 		}
 
-		std::string content;
-		file.seekg(0, std::ios::end);
-		content.resize(file.tellg());
-		file.seekg(0, std::ios::beg);
-		file.read(&content[0], content.size());
+		// Большие файлы читаются с диска по частям по мере отправки
+		http::file_body::value_type body;
+		beast::error_code ec;
+		body.open(file.path.c_str(), beast::file_mode::scan, ec);
+		if (ec) {
+			return send(NotFound(req, "File not found", "text/plain"));
+		}
 
-		http::response<http::string_body> res{http::status::ok, req.version()};
-		res.set(http::field::content_type, mime_type);
-		res.set(http::field::content_length, std::to_string(content.size()));
+		http::response<http::file_body, Fields> res{http::status::ok, req.version()};
+		SetFileHeaders(res, file, nullptr);
 		res.keep_alive(req.keep_alive());
-		if (req.method() == http::verb::get) {
-			res.body() = std::move(content);
-		}
+		res.body() = std::move(body);
 		res.prepare_payload();
-
 		return send(std::move(res));
 	}
 
+	// If-None-Match важнее If-Modified-Since, как требует RFC 9110
+	template <typename Body, typename Allocator>
+	static bool IsNotModified(const http::request<Body, http::basic_fields<Allocator>>& req,
+									  const StaticFile& file, std::string_view etag) {
+		if (auto it = req.find(http::field::if_none_match); it != req.end()) {
+			return MatchesETag({it->value().data(), it->value().size()}, etag);
+		}
+		if (auto it = req.find(http::field::if_modified_since); it != req.end()) {
+			auto since = ParseHttpDate({it->value().data(), it->value().size()});
+			return since && file.modified <= *since;
+		}
+		return false;
+	}
+
+	template <typename Response>
+	static void SetFileHeaders(Response& res, const StaticFile& file, const EncodedContent* encoded) {
+		res.set(http::field::content_type, file.mime_type);
+		res.set(http::field::last_modified, file.last_modified);
+		if (encoded) {
+			std::string_view name = GetEncodingName(encoded->encoding);
+			res.set(http::field::content_encoding, beast::string_view{name.data(), name.size()});
+			res.set(http::field::etag, encoded->etag);
+		} else {
+			res.set(http::field::etag, file.etag);
+		}
+		// Кэши между клиентом и сервером должны различать ответы по Accept-Encoding
+		if (file.compressible) {
+			res.set(http::field::vary, "Accept-Encoding");
+		}
+	}
+
 	ApiHandler api_handler_;
-	fs::path static_files_;
+	StaticFiles& static_files_;
 	Strand api_strand_;
+	const model::Game& game_;
+	const StateSaver& state_saver_;
+	const RequestMetrics& request_metrics_;
+	const TickStats* tick_stats_;
+	std::vector<MetricsSource> metrics_sources_;
 };
 
 class LoggingRequestHandler {
  public:
-	LoggingRequestHandler(RequestHandler& req) : decorated_(req) {}
+	// В лог попадает каждый sample_rate-й запрос и все ответы с ошибкой сервера
+	LoggingRequestHandler(RequestHandler& req, RequestMetrics& metrics, unsigned sample_rate = 1)
+		 : decorated_(req), metrics_(metrics), sample_rate_(std::max(1u, sample_rate)) {}
 
 	template <typename Body, typename Allocator, typename Send>
 	void operator()(boost::beast::http::request<Body, http::basic_fields<Allocator>>&& req,
 						 const std::string& client_ip, Send&& send) {
-		LogRequest(req, client_ip);
+		const bool sampled = IsSampled();
+		if (sampled) {
+			LogRequest(req, client_ip);
+		} else {
+			skipped_.Add();
+		}
 
 		auto start_time = std::chrono::steady_clock::now();
+		Route route = GetRoute({req.target().data(), req.target().size()});
 
-		auto send_wrapper = [send = std::forward<Send>(send), client_ip, start_time,
+		auto send_wrapper = [send = std::forward<Send>(send), client_ip, start_time, route, sampled,
 									this](auto&& response) {
-			LogResponse(response, client_ip, start_time);
+			auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
+				 std::chrono::steady_clock::now() - start_time);
+			metrics_.Record(route, response.result_int(), duration);
+			if (sampled || response.result_int() >= 500) {
+				LogResponse(response, client_ip, duration);
+			}
 			send(std::forward<decltype(response)>(response));
 		};
 
 		decorated_(std::forward<decltype(req)>(req), send_wrapper);
 	}
 
+	// Сколько запросов не попало в лог из-за выборки
+	uint64_t GetSkippedCount() const noexcept { return skipped_.Get(); }
+
  private:
 	template <typename Response>
 	static void LogResponse(Response&& response, const std::string& client_ip,
-									std::chrono::steady_clock::time_point start_time) {
-		auto end_time = std::chrono::steady_clock::now();
-		auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
+									std::chrono::microseconds duration) {
+		auto duration_ms = std::chrono::duration_cast<std::chrono::milliseconds>(duration);
 
 		std::string content_type_str = "unknown";
 		if (response.find(http::field::content_type) != response.end()) {
@@ -165,7 +261,7 @@ class LoggingRequestHandler {
 
 		BOOST_LOG_TRIVIAL(info) << boost::log::add_value(ip_address, client_ip)
 										<< boost::log::add_value(response_time,
-																		 static_cast<int>(duration.count()))
+																		 static_cast<int>(duration_ms.count()))
 										<< boost::log::add_value(status_code,
 																		 static_cast<int>(response.result()))
 										<< boost::log::add_value(content_type, content_type_str)
@@ -173,8 +269,8 @@ class LoggingRequestHandler {
 	}
 
 	template <typename Body, typename Allocator>
-	static void LogRequest(http::request<Body, http::basic_fields<Allocator>> req,
-								  std::string client_ip) {
+	static void LogRequest(const http::request<Body, http::basic_fields<Allocator>>& req,
+								  const std::string& client_ip) {
 		BOOST_LOG_TRIVIAL(info) << boost::log::add_value(ip_address, client_ip)
 										<< boost::log::add_value(uri, std::string(req.target()))
 										<< boost::log::add_value(http_method,
@@ -182,7 +278,16 @@ class LoggingRequestHandler {
 										<< "request received";
 	}
 
+	// Счётчик у каждого потока свой, чтобы выборка не требовала общей атомарной переменной
+	bool IsSampled() const noexcept {
+		thread_local unsigned counter = 0;
+		return sample_rate_ == 1 || counter++ % sample_rate_ == 0;
+	}
+
 	RequestHandler& decorated_;
+	RequestMetrics& metrics_;
+	unsigned sample_rate_;
+	util::Counter skipped_;
 };
 
 } // namespace http_handler
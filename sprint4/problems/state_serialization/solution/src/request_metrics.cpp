@@ -0,0 +1,131 @@
+#include "request_metrics.h"
+
+#include <algorithm>
+#include <string>
+#include <utility>
+
+namespace http_handler {
+
+using namespace std::literals;
+
+Route GetRoute(std::string_view target) {
+	const std::string_view path = target.substr(0, target.find('?'));
+
+	if (path == "/metrics"sv) {
+		return Route::METRICS;
+	}
+	if (!path.starts_with("/api"sv)) {
+		return Route::STATIC;
+	}
+	if (path == "/api/v1/maps"sv || path == "/api/v1/maps/"sv) {
+		return Route::MAPS;
+	}
+	if (path.starts_with("/api/v1/maps/"sv)) {
+		return Route::MAP;
+	}
+	if (path == "/api/v1/game/join"sv) {
+		return Route::JOIN;
+	}
+	if (path == "/api/v1/game/players"sv) {
+		return Route::PLAYERS;
+	}
+	if (path == "/api/v1/game/state"sv) {
+		return Route::STATE;
+	}
+	if (path == "/api/v1/game/player/action"sv) {
+		return Route::ACTION;
+	}
+	if (path == "/api/v1/game/tick"sv) {
+		return Route::TICK;
+	}
+	return Route::OTHER_API;
+}
+
+std::string_view GetRouteName(Route route) {
+	switch (route) {
+	case Route::MAPS:
+		return "maps"sv;
+	case Route::MAP:
+		return "map"sv;
+	case Route::JOIN:
+		return "join"sv;
+	case Route::PLAYERS:
+		return "players"sv;
+	case Route::STATE:
+		return "state"sv;
+	case Route::ACTION:
+		return "action"sv;
+	case Route::TICK:
+		return "tick"sv;
+	case Route::OTHER_API:
+		return "other_api"sv;
+	case Route::METRICS:
+		return "metrics"sv;
+	case Route::STATIC:
+		return "static"sv;
+	}
+	return "unknown"sv;
+}
+
+void RequestMetrics::Record(Route route, unsigned status, std::chrono::microseconds latency) noexcept {
+	RouteMetrics& metrics = routes_[static_cast<size_t>(route)];
+	const size_t status_index = std::find(STATUSES.begin(), STATUSES.end(), status) - STATUSES.begin();
+	metrics.responses[status_index].Add();
+	metrics.latency.Record(static_cast<uint64_t>(std::max<int64_t>(0, latency.count())));
+}
+
+void RequestMetrics::Write(util::PrometheusWriter& writer) const {
+	writer.Family("game_server_http_responses_total", "counter",
+					  "HTTP responses sent, by route and status code");
+	for (size_t route = 0; route < ROUTE_COUNT; ++route) {
+		const std::string route_label =
+			 "route=\""s + std::string(GetRouteName(static_cast<Route>(route))) + "\"";
+		const RouteMetrics& metrics = routes_[route];
+		for (size_t status = 0; status < metrics.responses.size(); ++status) {
+			const uint64_t count = metrics.responses[status].Get();
+			if (count == 0) {
+				continue;
+			}
+			const std::string code =
+				 status < STATUSES.size() ? std::to_string(STATUSES[status]) : "other"s;
+			writer.Sample("game_server_http_responses_total", route_label + ",code=\"" + code + "\"",
+							  count);
+		}
+	}
+
+	// Границы корзин в микросекундах, выдаются в секундах
+	static const std::vector<uint64_t> LATENCY_BOUNDS{
+		 50, 100, 250, 500, 1'000, 2'500, 5'000, 10'000, 25'000, 50'000, 100'000, 250'000, 500'000,
+		 1'000'000, 2'500'000, 10'000'000};
+	writer.Family("game_server_http_request_duration_seconds", "histogram",
+					  "Time from receiving a request to sending its response");
+	std::array<util::HistogramSnapshot, ROUTE_COUNT> snapshots;
+	for (size_t route = 0; route < ROUTE_COUNT; ++route) {
+		snapshots[route] = routes_[route].latency.Collect();
+		if (snapshots[route].count == 0) {
+			continue;
+		}
+		writer.Histogram("game_server_http_request_duration_seconds",
+							  "route=\""s + std::string(GetRouteName(static_cast<Route>(route))) + "\"",
+							  snapshots[route], LATENCY_BOUNDS, 1e-6);
+	}
+
+	// Квантили считаются по точной гистограмме, а не по крупным корзинам выше
+	static constexpr std::array<std::pair<double, std::string_view>, 4> QUANTILES{
+		 {{0.5, "0.5"sv}, {0.9, "0.9"sv}, {0.99, "0.99"sv}, {0.999, "0.999"sv}}};
+	writer.Family("game_server_http_request_duration_quantile_seconds", "gauge",
+					  "Request duration quantiles since the server start");
+	for (size_t route = 0; route < ROUTE_COUNT; ++route) {
+		if (snapshots[route].count == 0) {
+			continue;
+		}
+		for (const auto& [q, q_name] : QUANTILES) {
+			writer.Sample("game_server_http_request_duration_quantile_seconds",
+							  "route=\""s + std::string(GetRouteName(static_cast<Route>(route))) +
+									"\",quantile=\"" + std::string(q_name) + "\"",
+							  snapshots[route].Quantile(q) * 1e-6);
+		}
+	}
+}
+
+} // namespace http_handler
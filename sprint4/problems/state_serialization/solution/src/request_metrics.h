@@ -0,0 +1,53 @@
+#pragma once
+
+#include "metrics.h"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <string_view>
+
+namespace http_handler {
+
+// Группа запросов, по которой ведутся метрики
+enum class Route {
+	MAPS,
+	MAP,
+	JOIN,
+	PLAYERS,
+	STATE,
+	ACTION,
+	TICK,
+	OTHER_API,
+	METRICS,
+	STATIC,
+};
+
+constexpr size_t ROUTE_COUNT = static_cast<size_t>(Route::STATIC) + 1;
+
+// target - цель запроса вместе со строкой параметров
+Route GetRoute(std::string_view target);
+std::string_view GetRouteName(Route route);
+
+/*
+ * Число ответов по кодам статуса и гистограмма задержки в микросекундах
+ * для каждой группы запросов. Record вызывается на каждый ответ и не берёт блокировок.
+ */
+class RequestMetrics {
+ public:
+	// Коды статуса, которые считаются по отдельности. Остальные попадают в "other"
+	static constexpr std::array<unsigned, 7> STATUSES{200, 304, 400, 401, 404, 405, 500};
+
+	void Record(Route route, unsigned status, std::chrono::microseconds latency) noexcept;
+	void Write(util::PrometheusWriter& writer) const;
+
+ private:
+	struct RouteMetrics {
+		util::Histogram latency;
+		std::array<util::Counter, STATUSES.size() + 1> responses;
+	};
+
+	std::array<RouteMetrics, ROUTE_COUNT> routes_;
+};
+
+} // namespace http_handler
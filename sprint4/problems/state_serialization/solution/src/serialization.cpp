@@ -3,68 +3,102 @@
 #include "model_serialization.h"
 #include "player.h"
 
+#include "binary_archive.h"
+#include "file_util.h"
+#include "journal.h"
+#include "worker_pool.h"
+
 #include <boost/archive/text_iarchive.hpp>
 #include <boost/archive/text_oarchive.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <fcntl.h>
+#include <unistd.h>
 
+#include <algorithm>
 #include <filesystem>
 #include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <unordered_set>
 
 namespace fs = std::filesystem;
+namespace bip = boost::interprocess;
 
 namespace serialization {
 
-model::GameStateRepr MakeStateFromGame(const model::Game& game) {
-	model::GameStateRepr state;
+// Файлы сессий называются <файл состояния>.session.<метка запуска>.<номер>
+constexpr std::string_view SEGMENT_INFIX = ".session.";
 
-	const auto& sessions = game.GetGameSessions();
-	for (const auto& session : sessions) {
-		model::GameSessionRepr srepr;
+static model::GameSessionRepr MakeSessionRepr(const model::GameSession& session) {
+	model::GameSessionRepr srepr;
+	srepr.map_id = *session.GetMap()->GetId();
 
-		const auto* map = session.GetMap();
-		if (!map) {
-			continue;
-		}
-		srepr.map_id = *map->GetId();
+	for (const auto& dog : session.GetDogs()) {
+		srepr.dogs.emplace_back(dog);
+	}
 
-		for (const auto& dog : session.GetDogs()) {
-			srepr.dogs.emplace_back(dog);
-		}
+	for (const auto& lo : session.GetLostObjects()) {
+		model::LostObjectRepr lrepr;
+		lrepr.type = lo.type;
+		lrepr.pos = lo.pos;
+		srepr.lost_objects.push_back(lrepr);
+	}
 
-		for (const auto& lo : session.GetLostObjects()) {
-			model::LostObjectRepr lrepr;
-			lrepr.type = lo.type;
-			lrepr.pos = lo.pos;
-			srepr.lost_objects.push_back(lrepr);
-		}
+	srepr.last_dog_id = session.GetLastDogId();
+
+	return srepr;
+}
 
-		srepr.last_dog_id = session.GetLastDogId();
+model::GameStateRepr MakeStateFromGame(const model::Game& game) {
+	model::GameStateRepr state;
 
-		state.sessions.push_back(std::move(srepr));
+	// Номера сессий в снимке совпадают с GameSession::GetIndex()
+	for (const auto& session : game.GetGameSessions()) {
+		state.sessions.push_back(MakeSessionRepr(session));
 	}
 
 	return state;
 }
 
-static void RestoreGameFromState(const model::GameStateRepr& state, model::Game& game) {
-	for (const auto& srepr : state.sessions) {
-		const auto* map = game.FindMap(model::Map::Id{srepr.map_id});
-		if (!map) {
-			continue;
+static util::WorkerPool MakeRestorePool() {
+	return util::WorkerPool{std::max(1u, std::thread::hardware_concurrency())};
+}
+
+// Возвращает восстановленные сессии в порядке state.sessions, nullptr - карта не найдена
+static std::vector<model::GameSession*> RestoreGameFromState(const model::GameStateRepr& state,
+																				 model::Game& game, util::WorkerPool& pool) {
+	// Сессии создаются по очереди, а заполняются параллельно: общих данных у них нет
+	std::vector<model::GameSession*> sessions(state.sessions.size(), nullptr);
+	for (size_t i = 0; i < state.sessions.size(); ++i) {
+		if (const auto* map = game.FindMap(model::Map::Id{state.sessions[i].map_id})) {
+			sessions[i] = game.AddGameSession(
+				 model::GameSession{map, game.GetPeriod(), game.GetProbability()});
 		}
+	}
 
-		auto* session =
-			 game.AddGameSession(model::GameSession{map, game.GetPeriod(), game.GetProbability()});
+	pool.Run(sessions.size(), [&state, &sessions](size_t index) {
+		model::GameSession* session = sessions[index];
+		if (!session) {
+			return;
+		}
+		const model::GameSessionRepr& srepr = state.sessions[index];
 		session->SetLastDogId(srepr.last_dog_id);
 
 		for (const auto& drepr : srepr.dogs) {
-			auto dog = drepr.Restore();
-			session->AddExistingDog(std::move(dog));
+			session->AddExistingDog(drepr.Restore());
 		}
 
 		for (const auto& lrepr : srepr.lost_objects) {
 			session->AddLostObject({lrepr.type, lrepr.pos});
 		}
-	}
+	});
+
+	return sessions;
 }
 
 static app::serialization::PlayersRepr MakePlayersState(const app::Players& players,
@@ -82,6 +116,7 @@ static app::serialization::PlayersRepr MakePlayersState(const app::Players& play
 
 		const model::Map* map = session->GetMap();
 		pr.map_id = *map->GetId();
+		pr.session_index = session->GetIndex();
 
 		ps.players.push_back(std::move(pr));
 	}
@@ -103,15 +138,16 @@ static app::serialization::PlayersRepr MakePlayersState(const app::Players& play
 }
 
 static void RestorePlayersFromState(const app::serialization::PlayersRepr& ps, model::Game& game,
+												const std::vector<model::GameSession*>& sessions,
 												app::Players& players, app::PlayerTokens& tokens) {
 	for (const auto& pr : ps.players) {
-		const auto* map = game.FindMap(model::Map::Id{pr.map_id});
-		if (!map) {
-			continue;
+		model::GameSession* session = nullptr;
+		if (pr.session_index < sessions.size()) {
+			session = sessions[pr.session_index];
+		} else if (const auto* map = game.FindMap(model::Map::Id{pr.map_id})) {
+			session = game.FindSessionByMap(map);
 		}
 
-		model::GameSession* session = game.FindSessionByMap(map);
-
 		if (!session) {
 			continue;
 		}
@@ -121,78 +157,234 @@ static void RestorePlayersFromState(const app::serialization::PlayersRepr& ps, m
 			continue;
 		}
 
-		app::Player* player = players.AddExisting(session, dog, pr.id);
-		(void)player;
+		players.AddExisting(session, dog, pr.id);
 	}
 
 	players.SetLastPlayerId(ps.last_player_id);
 
-	std::unordered_map<uint64_t, app::Player*> id_to_player;
-	for (auto& p : players.GetAllPlayers()) {
-		id_to_player[p.GetId()] = &p;
-	}
-
 	for (const auto& tr : ps.tokens) {
-		auto it = id_to_player.find(tr.player_id);
-		if (it == id_to_player.end()) {
+		app::Player* player = players.FindById(tr.player_id);
+		if (!player) {
 			continue;
 		}
 		app::Token token{tr.token};
-		tokens.SetTokenForPlayer(token, it->second);
+		tokens.SetTokenForPlayer(token, player);
 	}
 }
 
-void SerializeState(const std::string& file, const model::Game& game, const app::Players& players,
-						  const app::PlayerTokens& tokens) {
-	fs::path target{file};
+template <typename Repr>
+static std::string EncodeState(const Repr& repr, StateFormat format) {
+	if (format == StateFormat::BINARY) {
+		return SaveBinaryState(repr);
+	}
+
+	std::ostringstream out;
+	{
+		boost::archive::text_oarchive oar(out);
+		oar & repr;
+	}
+	return std::move(out).str();
+}
+
+// Без fsync после сбоя питания на месте файла состояния может оказаться пустой файл
+static void WriteFileDurably(const fs::path& target, std::string_view data) {
 	fs::path tmp = target.string() + ".tmp";
-	serialization::StateRepr sr;
-	sr.game_state = MakeStateFromGame(game);
-	sr.players_state = MakePlayersState(players, tokens);
 
-	std::ofstream ofs(tmp, std::ios::binary);
-	if (!ofs) {
+	int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) {
 		throw std::runtime_error("Failed to open temp state file");
 	}
+	try {
+		util::WriteAll(fd, data);
+		if (::fsync(fd) != 0) {
+			throw std::runtime_error("Failed to sync temp state file");
+		}
+	} catch (...) {
+		::close(fd);
+		throw;
+	}
+	if (::close(fd) != 0) {
+		throw std::runtime_error("Failed to close temp state file");
+	}
 
-	boost::archive::text_oarchive oar(ofs);
-	oar & sr;
 	fs::rename(tmp, target);
+
+	util::SyncDirectory(target.parent_path());
 }
 
-void DeserializeState(const std::string& file, model::Game& game, app::Players& players,
-							 app::PlayerTokens& tokens) {
-	const fs::path path{file};
-	if (!fs::exists(path)) {
-		return;
+template <typename Repr>
+static void WriteStateFile(const fs::path& target, const Repr& repr, StateFormat format) {
+	WriteFileDurably(target, EncodeState(repr, format));
+}
+
+template <typename Repr>
+static void ReadStateFile(const fs::path& path, Repr& repr) {
+	// Двоичный файл читается прямо из отображённой в память копии, без потоков
+	if (fs::file_size(path) >= BINARY_STATE_HEADER_SIZE) {
+		bip::file_mapping file(path.c_str(), bip::read_only);
+		bip::mapped_region region(file, bip::read_only);
+		std::string_view data(static_cast<const char*>(region.get_address()), region.get_size());
+		if (IsBinaryState(data)) {
+			LoadBinaryState(data, repr);
+			return;
+		}
 	}
 
-	serialization::StateRepr sr;
 	std::ifstream ifs(path, std::ios::binary);
 	if (!ifs) {
 		throw std::runtime_error("Failed to open state file");
 	}
 	boost::archive::text_iarchive iar(ifs);
-	iar & sr;
+	iar & repr;
+}
 
-	RestoreGameFromState(sr.game_state, game);
-	RestorePlayersFromState(sr.players_state, game, players, tokens);
+StateFormat ParseStateFormat(std::string_view name) {
+	if (name == "text") {
+		return StateFormat::TEXT;
+	}
+	if (name == "binary") {
+		return StateFormat::BINARY;
+	}
+	throw std::invalid_argument("Unknown state format: " + std::string(name));
 }
 
-void SerializeGameState(const std::string& file, const model::Game& game) {
-	fs::path target{file};
-	fs::path tmp = target.string() + ".tmp";
+StateRepr CaptureState(const model::Game& game, const app::Players& players,
+							  const app::PlayerTokens& tokens) {
+	serialization::StateRepr sr;
+	sr.game_state = MakeStateFromGame(game);
+	sr.players_state = MakePlayersState(players, tokens);
+	return sr;
+}
 
-	model::GameStateRepr state = MakeStateFromGame(game);
+void WriteState(const std::string& file, const StateRepr& state, StateFormat format) {
+	WriteStateFile(file, state, format);
+}
 
-	std::ofstream ofs(tmp, std::ios::binary);
-	if (!ofs) {
-		throw std::runtime_error("Failed to open temp state file");
+void SerializeState(const std::string& file, const model::Game& game, const app::Players& players,
+						  const app::PlayerTokens& tokens, StateFormat format) {
+	WriteState(file, CaptureState(game, players, tokens), format);
+}
+
+IncrementalStateWriter::IncrementalStateWriter(const std::string& state_file, StateFormat format)
+	 : state_file_(state_file), format_(format) {
+	std::random_device random_device;
+	std::stringstream tag;
+	tag << std::hex << std::setw(8) << std::setfill('0') << random_device();
+	run_tag_ = tag.str();
+}
+
+std::unique_ptr<IncrementalStateRepr> IncrementalStateWriter::Capture(
+	 const model::Game& game, const app::Players& players, const app::PlayerTokens& tokens,
+	 uint64_t journal_seq) {
+	auto state = std::make_unique<IncrementalStateRepr>();
+	state->manifest.journal_seq = journal_seq;
+	state->manifest.players_state.last_player_id = players.GetLastPlayerId();
+
+	// Токены нужны только для изменившихся сессий
+	std::unordered_map<const app::Player*, const app::Token*> player_tokens;
+	auto find_token = [&](const app::Player* player) -> const app::Token* {
+		if (player_tokens.empty()) {
+			for (const auto& [token, token_player] : tokens.GetAll()) {
+				player_tokens[token_player] = &token;
+			}
+		}
+		auto it = player_tokens.find(player);
+		return it != player_tokens.end() ? it->second : nullptr;
+	};
+
+	const auto& sessions = game.GetGameSessions();
+	for (size_t i = 0; i < sessions.size(); ++i) {
+		const model::GameSession& session = sessions[i];
+		const uint64_t generation = session.GetGeneration();
+		state->generations.push_back(generation);
+		if (i < saved_generations_.size() && saved_generations_[i] == generation) {
+			state->manifest.segments.push_back(saved_segments_[i]);
+			continue;
+		}
+
+		SessionSegmentRepr segment;
+		segment.session = MakeSessionRepr(session);
+		for (const app::Player* player : players.GetSessionPlayers(&session)) {
+			segment.players.push_back(
+				 {player->GetId(), player->GetDog()->GetId(), segment.session.map_id, i});
+			if (const app::Token* token = find_token(player)) {
+				segment.tokens.push_back({**token, player->GetId()});
+			}
+		}
+
+		std::string file = state_file_.filename().string() + std::string(SEGMENT_INFIX) + run_tag_ +
+								 "." + std::to_string(next_segment_++);
+		state->manifest.segments.push_back(file);
+		state->changed.emplace_back(std::move(file), std::move(segment));
 	}
-	boost::archive::text_oarchive oar(ofs);
-	oar & state;
 
-	fs::rename(tmp, target);
+	return state;
+}
+
+void IncrementalStateWriter::Write(IncrementalStateRepr& state) {
+	const fs::path dir = state_file_.parent_path();
+	for (const auto& [file, segment] : state.changed) {
+		WriteStateFile(dir / file, segment, format_);
+	}
+	// Снимок подменяется только после того, как все его сессии на диске
+	WriteStateFile(state_file_, state.manifest, format_);
+
+	saved_segments_ = state.manifest.segments;
+	saved_generations_ = std::move(state.generations);
+	RemoveUnusedSegments();
+}
+
+void IncrementalStateWriter::RemoveUnusedSegments() const {
+	const fs::path dir = state_file_.parent_path().empty() ? fs::path{"."} : state_file_.parent_path();
+	const std::string prefix = state_file_.filename().string() + std::string(SEGMENT_INFIX);
+	const std::unordered_set<std::string> used(saved_segments_.begin(), saved_segments_.end());
+
+	std::error_code ec;
+	for (const fs::directory_entry& entry : fs::directory_iterator(dir, ec)) {
+		const std::string name = entry.path().filename().string();
+		if (name.compare(0, prefix.size(), prefix) == 0 && !used.contains(name)) {
+			fs::remove(entry.path(), ec);
+		}
+	}
+}
+
+uint64_t DeserializeState(const std::string& file, model::Game& game, app::Players& players,
+								 app::PlayerTokens& tokens) {
+	const fs::path path{file};
+	// Без снимка состояние целиком восстанавливается из журнала
+	serialization::StateRepr sr;
+	if (fs::exists(path)) {
+		util::WorkerPool pool = MakeRestorePool();
+		ReadStateFile(path, sr);
+
+		// Файлы сессий независимы и декодируются параллельно
+		std::vector<SessionSegmentRepr> segments(sr.segments.size());
+		pool.Run(segments.size(), [&](size_t index) {
+			ReadStateFile(path.parent_path() / sr.segments[index], segments[index]);
+		});
+		for (SessionSegmentRepr& segment : segments) {
+			// Номер сессии в файле сегмента зависит от того, в каком снимке он записан
+			for (auto& player : segment.players) {
+				player.session_index = sr.game_state.sessions.size();
+			}
+			sr.game_state.sessions.push_back(std::move(segment.session));
+			std::move(segment.players.begin(), segment.players.end(),
+						 std::back_inserter(sr.players_state.players));
+			std::move(segment.tokens.begin(), segment.tokens.end(),
+						 std::back_inserter(sr.players_state.tokens));
+		}
+
+		const auto sessions = RestoreGameFromState(sr.game_state, game, pool);
+		RestorePlayersFromState(sr.players_state, game, sessions, players, tokens);
+	}
+
+	return ReplayJournal(file, sr.journal_seq, game, players, tokens);
+}
+
+void SerializeGameState(const std::string& file, const model::Game& game, StateFormat format) {
+	model::GameStateRepr state = MakeStateFromGame(game);
+
+	WriteStateFile(file, state, format);
 }
 
 void DeserializeGameState(const std::string& file, model::Game& game) {
@@ -202,16 +394,10 @@ void DeserializeGameState(const std::string& file, model::Game& game) {
 	}
 
 	model::GameStateRepr state;
+	ReadStateFile(path, state);
 
-	std::ifstream ifs(path, std::ios::binary);
-	if (!ifs) {
-		throw std::runtime_error("Failed to open state file");
-	}
-	boost::archive::text_iarchive iar(ifs);
-	iar & state;
-
-	RestoreGameFromState(state, game);
+	util::WorkerPool pool = MakeRestorePool();
+	RestoreGameFromState(state, game, pool);
 }
 
 } // namespace serialization
-
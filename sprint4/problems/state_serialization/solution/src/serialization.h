@@ -3,17 +3,71 @@
 #include "model.h"
 #include "player.h"
 
+#include <filesystem>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
 
 namespace serialization {
 
+struct StateRepr;
+struct IncrementalStateRepr;
+
+// Формат, в котором сохраняется состояние. При загрузке формат определяется по файлу
+enum class StateFormat { TEXT, BINARY };
+
+// "text" или "binary"
+StateFormat ParseStateFormat(std::string_view name);
+
 void SerializeState(const std::string& file, const model::Game& game, const app::Players& players,
-						  const app::PlayerTokens& tokens);
+						  const app::PlayerTokens& tokens, StateFormat format = StateFormat::TEXT);
+
+// Снимает копию состояния, которую можно записать в файл из другого потока
+StateRepr CaptureState(const model::Game& game, const app::Players& players,
+							  const app::PlayerTokens& tokens);
+
+// Записывает снимок во временный файл, сбрасывает его на диск и атомарно подменяет file
+void WriteState(const std::string& file, const StateRepr& state,
+					 StateFormat format = StateFormat::TEXT);
+
+/*
+ * Сохраняет состояние по частям: каждая сессия вместе с игроками лежит в своём файле,
+ * а файл состояния только перечисляет эти файлы. Сессии, не менявшиеся с прошлого
+ * сохранения, не копируются и не записываются заново.
+ * Capture и Write не должны выполняться одновременно.
+ */
+class IncrementalStateWriter {
+ public:
+	IncrementalStateWriter(const std::string& state_file, StateFormat format);
+
+	// Снимает копию изменившихся сессий. Вызывается из api_strand
+	std::unique_ptr<IncrementalStateRepr> Capture(const model::Game& game,
+																 const app::Players& players,
+																 const app::PlayerTokens& tokens,
+																 uint64_t journal_seq);
+
+	// Записывает файлы изменившихся сессий, затем файл состояния и удаляет ненужные файлы сессий
+	void Write(IncrementalStateRepr& state);
+
+ private:
+	void RemoveUnusedSegments() const;
+
+	std::filesystem::path state_file_;
+	StateFormat format_;
+	// Отличает файлы сессий этого запуска от файлов прошлых запусков
+	std::string run_tag_;
+	uint64_t next_segment_ = 0;
+	std::vector<std::string> saved_segments_;
+	std::vector<uint64_t> saved_generations_;
+};
 
-void DeserializeState(const std::string& file, model::Game& game, app::Players& players,
-							 app::PlayerTokens& tokens);
+// Загружает снимок и повторяет записи журнала после него. Возвращает номер следующей записи журнала
+uint64_t DeserializeState(const std::string& file, model::Game& game, app::Players& players,
+								 app::PlayerTokens& tokens);
 
-void SerializeGameState(const std::string& file, const model::Game& game);
+void SerializeGameState(const std::string& file, const model::Game& game,
+								StateFormat format = StateFormat::TEXT);
 
 void DeserializeGameState(const std::string& file, model::Game& game);
 
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <boost/asio/buffer.hpp>
+#include <boost/beast/core/error.hpp>
+#include <boost/beast/http/message.hpp>
+#include <boost/optional.hpp>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <utility>
+
+namespace http_handler {
+
+/*
+ * Тело ответа, которое отдаёт неизменяемый буфер без копирования.
+ * owner продлевает жизнь владельца буфера (кэша карт, снимка состояния)
+ * до окончания записи ответа в сокет.
+ */
+struct SharedBufferBody {
+	struct value_type {
+		std::shared_ptr<const void> owner;
+		std::string_view data;
+	};
+
+	static std::uint64_t size(const value_type& body) { return body.data.size(); }
+
+	class writer {
+	 public:
+		using const_buffers_type = boost::asio::const_buffer;
+
+		template <bool isRequest, class Fields>
+		explicit writer(const boost::beast::http::header<isRequest, Fields>&, const value_type& body)
+			 : body_(body) {}
+
+		void init(boost::beast::error_code& ec) { ec = {}; }
+
+		boost::optional<std::pair<const_buffers_type, bool>> get(boost::beast::error_code& ec) {
+			ec = {};
+			return {{{body_.data.data(), body_.data.size()}, false}};
+		}
+
+	 private:
+		const value_type& body_;
+	};
+};
+
+} // namespace http_handler
@@ -0,0 +1,137 @@
+#include "state_saver.h"
+#include "logger.h"
+#include "model_serialization.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+std::chrono::microseconds SinceStart(Clock::time_point start) {
+	return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start);
+}
+
+} // namespace
+
+StateSaver::StateSaver(model::Game& game, std::optional<uint32_t> period_ms,
+							  const std::string state_file, app::Players& players,
+							  app::PlayerTokens& tokens, serialization::StateFormat format)
+	 : game_(game), players_(players), tokens_(tokens), period_ms_(period_ms),
+		state_file_(state_file), state_writer_(state_file, format) {
+	if (period_ms_ && !state_file_.empty()) {
+		writer_ = std::jthread([this](std::stop_token stop) { WriteStates(stop); });
+	}
+}
+
+StateSaver::~StateSaver() {
+	Stop();
+}
+
+void StateSaver::EnableJournal(uint64_t next_seq, std::chrono::milliseconds flush_period) {
+	journal_ = std::make_unique<serialization::Journal>(state_file_, next_seq, flush_period);
+}
+
+void StateSaver::Tick(double ms) {
+	game_.Tick(ms);
+	if (journal_) {
+		journal_->AppendTick(ms, game_);
+	}
+	if (!period_ms_ || state_file_.empty()) {
+		return;
+	}
+	from_last_save_ms_ += ms;
+	if (from_last_save_ms_ < *period_ms_) {
+		return;
+	}
+
+	{
+		std::lock_guard lock(mutex_);
+		if (busy_) {
+			++metrics_.deferred;
+			return;
+		}
+		busy_ = true;
+	}
+
+	auto start = Clock::now();
+	auto state =
+		 state_writer_.Capture(game_, players_, tokens_, journal_ ? journal_->Rotate() : 0);
+	auto capture_time = SinceStart(start);
+	from_last_save_ms_ = 0;
+
+	{
+		std::lock_guard lock(mutex_);
+		pending_ = std::move(state);
+		metrics_.last_capture_time = capture_time;
+		metrics_.max_capture_time = std::max(metrics_.max_capture_time, capture_time);
+	}
+	pending_cv_.notify_one();
+}
+
+void StateSaver::OnJoin(const app::Player& player, const app::Token& token) {
+	if (journal_) {
+		journal_->AppendJoin(player, token);
+	}
+}
+
+void StateSaver::OnMove(const app::Player& player, std::string_view move) {
+	if (journal_) {
+		journal_->AppendMove(player, move);
+	}
+}
+
+void StateSaver::Stop() {
+	if (writer_.joinable()) {
+		writer_.request_stop();
+		writer_.join();
+	}
+}
+
+void StateSaver::Save() {
+	auto state =
+		 state_writer_.Capture(game_, players_, tokens_, journal_ ? journal_->Rotate() : 0);
+	state_writer_.Write(*state);
+	if (journal_) {
+		journal_->DropBefore(state->manifest.journal_seq);
+	}
+}
+
+StateSaver::Metrics StateSaver::GetMetrics() const {
+	std::lock_guard lock(mutex_);
+	return metrics_;
+}
+
+void StateSaver::WriteStates(std::stop_token stop) {
+	std::unique_lock lock(mutex_);
+	// При остановке уже снятый снимок всё равно записывается
+	while (pending_cv_.wait(lock, stop, [this] { return pending_ != nullptr; })) {
+		auto state = std::move(pending_);
+		lock.unlock();
+
+		const int64_t sessions_written = static_cast<int64_t>(state->changed.size());
+		auto start = Clock::now();
+		try {
+			state_writer_.Write(*state);
+			if (journal_) {
+				journal_->DropBefore(state->manifest.journal_seq);
+			}
+		} catch (const std::exception& ex) {
+			BOOST_LOG_TRIVIAL(error) << boost::log::add_value(exception_c, ex.what())
+											 << "failed to save state";
+		}
+		auto write_time = SinceStart(start);
+		state.reset();
+
+		lock.lock();
+		++metrics_.saves;
+		metrics_.last_write_time = write_time;
+		metrics_.max_write_time = std::max(metrics_.max_write_time, write_time);
+		metrics_.last_sessions_written = sessions_written;
+		busy_ = false;
+
+		BOOST_LOG_TRIVIAL(info) << boost::log::add_value(capture_time,
+																		 metrics_.last_capture_time.count())
+										<< boost::log::add_value(write_time_attr, write_time.count())
+										<< boost::log::add_value(sessions_written_attr, sessions_written)
+										<< "state saved";
+	}
+}
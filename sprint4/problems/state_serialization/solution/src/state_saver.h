@@ -1,39 +1,81 @@
 #pragma once
 
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
+#include <thread>
 
+#include "journal.h"
 #include "model.h"
 #include "player.h"
 #include "serialization.h"
 
+/*
+ * Тикает игру и периодически сохраняет её состояние. На api_strand снимается
+ * только копия изменившихся сессий, а кодирование и запись в файл выполняет фоновый поток.
+ * Пока предыдущая запись не закончилась, новое сохранение откладывается.
+ */
 class StateSaver {
  public:
+	struct Metrics {
+		uint64_t saves = 0;
+		// Сколько раз сохранение откладывалось из-за незавершённой записи
+		uint64_t deferred = 0;
+		std::chrono::microseconds last_capture_time{0};
+		std::chrono::microseconds max_capture_time{0};
+		std::chrono::microseconds last_write_time{0};
+		std::chrono::microseconds max_write_time{0};
+		// Сколько сессий изменилось и было записано при последнем сохранении
+		int64_t last_sessions_written = 0;
+	};
+
 	explicit StateSaver(model::Game& game, std::optional<uint32_t> period_ms,
 							  const std::string state_file, app::Players& players,
-							  app::PlayerTokens& tokens)
-		 : game_(game), players_(players), tokens_(tokens), period_ms_(period_ms),
-			state_file_(state_file) {}
-
-	void Tick(double ms) {
-		game_.Tick(ms);
-		if (!period_ms_ || state_file_.empty()) {
-			return;
-		}
-		from_last_save_ms_ += ms;
-		if (from_last_save_ms_ >= *period_ms_) {
-			serialization::SerializeState(state_file_, game_, players_, tokens_);
-			from_last_save_ms_ = 0;
-		}
-	}
+							  app::PlayerTokens& tokens,
+							  serialization::StateFormat format = serialization::StateFormat::TEXT);
+	~StateSaver();
+
+	StateSaver(const StateSaver&) = delete;
+	StateSaver& operator=(const StateSaver&) = delete;
+
+	// Изменения после каждого снимка дописываются в журнал, начиная с записи next_seq
+	void EnableJournal(uint64_t next_seq, std::chrono::milliseconds flush_period);
+
+	// Вызываются из api_strand
+	void Tick(double ms);
+	void OnJoin(const app::Player& player, const app::Token& token);
+	void OnMove(const app::Player& player, std::string_view move);
+
+	// Дожидается окончания начатой записи и останавливает фоновый поток
+	void Stop();
+
+	// Синхронно сохраняет состояние. Вызывается после Stop
+	void Save();
+
+	Metrics GetMetrics() const;
 
  private:
+	void WriteStates(std::stop_token stop);
+
 	model::Game& game_;
 	app::Players& players_;
 	app::PlayerTokens& tokens_;
 	std::optional<uint32_t> period_ms_;
 	double from_last_save_ms_ = 0;
 	std::string state_file_;
-};
+	serialization::IncrementalStateWriter state_writer_;
 
+	std::unique_ptr<serialization::Journal> journal_;
+
+	mutable std::mutex mutex_;
+	std::condition_variable_any pending_cv_;
+	std::unique_ptr<serialization::IncrementalStateRepr> pending_;
+	// Снимок снят и ещё не записан
+	bool busy_ = false;
+	Metrics metrics_;
+	std::jthread writer_;
+};
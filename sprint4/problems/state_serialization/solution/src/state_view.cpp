@@ -0,0 +1,247 @@
+#include "state_view.h"
+#include "json_writer.h"
+
+#include <algorithm>
+
+namespace app {
+
+namespace {
+
+std::string_view DirectionToString(model::Direction dir) {
+	switch (dir) {
+	case model::Direction::NORTH:
+		return "U";
+	case model::Direction::SOUTH:
+		return "D";
+	case model::Direction::WEST:
+		return "L";
+	case model::Direction::EAST:
+		return "R";
+	}
+	return "U";
+}
+
+void WritePlayerInfo(util::JsonWriter& writer, const Player& player) {
+	PlayerInfo info = player.GetInfo();
+	writer.StartObject();
+	writer.Key("pos").StartArray().Double(info.pos.x).Double(info.pos.y).EndArray();
+	writer.Key("speed").StartArray().Double(info.speed.x).Double(info.speed.y).EndArray();
+	writer.Key("score").Int(info.score);
+	writer.Key("dir").String(DirectionToString(info.dir));
+
+	writer.Key("bag").StartArray();
+	for (model::TakenItem item : player.GetBag()) {
+		writer.StartObject().Key("id").Uint(item.id).Key("type").Int(item.type).EndObject();
+	}
+	writer.EndArray();
+	writer.EndObject();
+}
+
+void WriteLostObjectInfo(util::JsonWriter& writer, const model::LostObject& loot) {
+	writer.StartObject();
+	writer.Key("type").Int(loot.type);
+	writer.Key("pos").StartArray().Double(loot.pos.x).Double(loot.pos.y).EndArray();
+	writer.EndObject();
+}
+
+// Пишет в writer поле name: объект из всех фрагментов либо только из фрагментов с ключами ids
+void WriteFragments(util::JsonWriter& writer, std::string_view name,
+						  const SessionSnapshot::Fragments& fragments,
+						  const std::vector<uint64_t>* ids = nullptr) {
+	writer.Key(name).StartObject();
+	if (!ids) {
+		for (const auto& [id, fragment] : fragments) {
+			writer.RawMember(*fragment);
+		}
+	} else {
+		for (uint64_t id : *ids) {
+			auto it = std::lower_bound(fragments.begin(), fragments.end(), id,
+												[](const auto& fragment, uint64_t id) { return fragment.first < id; });
+			// Предмет мог появиться и исчезнуть в пределах запрошенных тиков
+			if (it != fragments.end() && it->first == id) {
+				writer.RawMember(*it->second);
+			}
+		}
+	}
+	writer.EndObject();
+}
+
+SessionSnapshot::Fragment MakePlayerFragment(const Player& player) {
+	std::string fragment;
+	util::JsonWriter writer(fragment);
+	writer.Key(player.GetId());
+	WritePlayerInfo(writer, player);
+	return std::make_shared<const std::string>(std::move(fragment));
+}
+
+// Тело /game/players: имена игроков сессии
+std::shared_ptr<const std::string> MakeNamesBody(const Players::SessionPlayers& players) {
+	std::string body;
+	util::JsonWriter names(body);
+	names.StartObject();
+	for (const Player* player : players) {
+		names.Key(player->GetId()).StartObject().Key("name").String(player->GetName()).EndObject();
+	}
+	names.EndObject();
+	return std::make_shared<const std::string>(std::move(body));
+}
+
+// Тело /game/state собирается из готовых фрагментов, без повторной сериализации
+std::string MakeStateBody(const SessionSnapshot& snapshot) {
+	std::string body;
+	util::JsonWriter state(body);
+	state.StartObject();
+	WriteFragments(state, "players", snapshot.players);
+	WriteFragments(state, "lostObjects", snapshot.lost_objects);
+	state.EndObject();
+	return body;
+}
+
+SessionSnapshot::Fragments::iterator FindFragment(SessionSnapshot::Fragments& fragments,
+																  uint64_t id) {
+	return std::lower_bound(fragments.begin(), fragments.end(), id,
+									[](const auto& fragment, uint64_t id) { return fragment.first < id; });
+}
+
+void SortUnique(std::vector<uint64_t>& ids) {
+	std::sort(ids.begin(), ids.end());
+	ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+}
+
+} // namespace
+
+void SessionSnapshot::WriteDelta(uint64_t since, std::string& out) const {
+	static const model::GameSession::History empty_history;
+	const model::GameSession::History& history = this->history ? *this->history : empty_history;
+	// Самый ранний тик, изменения после которого ещё есть в истории
+	uint64_t oldest = history.empty() ? tick : history.front()->tick - 1;
+	bool full = since == 0 || since < oldest || since > tick;
+
+	util::JsonWriter writer(out);
+	writer.StartObject();
+	writer.Key("tick").Uint(tick);
+	writer.Key("full").Bool(full);
+
+	if (full) {
+		out.reserve(out.size() + state_body.size() + 32);
+		WriteFragments(writer, "players", players);
+		WriteFragments(writer, "lostObjects", lost_objects);
+		writer.EndObject();
+		return;
+	}
+
+	std::vector<uint64_t> dogs;
+	std::vector<uint64_t> added_loot;
+	std::vector<uint64_t> removed_loot;
+	for (auto it = history.rbegin(); it != history.rend() && (*it)->tick > since; ++it) {
+		const model::TickChanges& changes = **it;
+		dogs.insert(dogs.end(), changes.dogs.begin(), changes.dogs.end());
+		added_loot.insert(added_loot.end(), changes.added_loot.begin(), changes.added_loot.end());
+		removed_loot.insert(removed_loot.end(), changes.removed_loot.begin(),
+								  changes.removed_loot.end());
+	}
+	SortUnique(dogs);
+	SortUnique(added_loot);
+	SortUnique(removed_loot);
+
+	WriteFragments(writer, "players", players, &dogs);
+	WriteFragments(writer, "lostObjects", lost_objects, &added_loot);
+
+	writer.Key("removedLostObjects").StartArray();
+	for (uint64_t id : removed_loot) {
+		writer.Uint(id);
+	}
+	writer.EndArray();
+	writer.EndObject();
+}
+
+void StateView::Publish() {
+	// Набор сессий меняется только здесь и в UpdatePlayer, оба вызываются из api_strand
+	const StateSnapshot& current = *snapshot_;
+	std::vector<std::pair<const model::GameSession*, std::shared_ptr<const SessionSnapshot>>> added;
+	for (const model::GameSession& session : game_.GetGameSessions()) {
+		auto session_snapshot = MakeSessionSnapshot(session);
+		if (auto it = current.sessions.find(&session); it != current.sessions.end()) {
+			it->second->Set(std::move(session_snapshot));
+		} else {
+			added.emplace_back(&session, std::move(session_snapshot));
+		}
+	}
+	if (!added.empty()) {
+		AddSessions(std::move(added));
+	}
+}
+
+void StateView::UpdatePlayer(const Player& player) {
+	const model::GameSession& session = *player.GetSession();
+	const StateSnapshot& current = *snapshot_;
+	if (auto it = current.sessions.find(&session); it != current.sessions.end()) {
+		it->second->Set(UpdatePlayer(*it->second->Get(), player));
+	} else {
+		AddSessions({{&session, MakeSessionSnapshot(session)}});
+	}
+}
+
+void StateView::AddSessions(
+	 std::vector<std::pair<const model::GameSession*, std::shared_ptr<const SessionSnapshot>>>
+		  added) {
+	auto snapshot = std::make_shared<StateSnapshot>(*snapshot_);
+	for (auto& [session, session_snapshot] : added) {
+		auto slot = std::make_shared<SessionSlot>();
+		slot->Set(std::move(session_snapshot));
+		snapshot->sessions.emplace(session, std::move(slot));
+	}
+
+	std::atomic_store(&snapshot_, std::shared_ptr<const StateSnapshot>(std::move(snapshot)));
+}
+
+std::shared_ptr<const SessionSnapshot> StateView::UpdatePlayer(const SessionSnapshot& previous,
+																					const Player& player) const {
+	// Копируются только указатели на фрагменты, история и тело с именами
+	auto snapshot = std::make_shared<SessionSnapshot>(previous);
+	const uint64_t dog_id = player.GetDog()->GetId();
+	auto it = FindFragment(snapshot->players, dog_id);
+	if (it != snapshot->players.end() && it->first == dog_id) {
+		it->second = MakePlayerFragment(player);
+	} else {
+		snapshot->players.emplace(it, dog_id, MakePlayerFragment(player));
+		snapshot->players_body = MakeNamesBody(players_.GetSessionPlayers(player.GetSession()));
+	}
+	snapshot->state_body = MakeStateBody(*snapshot);
+
+	return snapshot;
+}
+
+std::shared_ptr<const SessionSnapshot>
+StateView::MakeSessionSnapshot(const model::GameSession& session) const {
+	auto snapshot = std::make_shared<SessionSnapshot>();
+	snapshot->tick = session.GetTick();
+	if (!session.GetHistory().empty()) {
+		snapshot->history = std::make_shared<const model::GameSession::History>(session.GetHistory());
+	}
+
+	const Players::SessionPlayers& players = players_.GetSessionPlayers(&session);
+	snapshot->players.reserve(players.size());
+	snapshot->players_body = MakeNamesBody(players);
+	for (const Player* player : players) {
+		snapshot->players.emplace_back(player->GetDog()->GetId(), MakePlayerFragment(*player));
+	}
+	std::sort(snapshot->players.begin(), snapshot->players.end(),
+				 [](const auto& lhs, const auto& rhs) { return lhs.first < rhs.first; });
+
+	snapshot->lost_objects.reserve(session.GetLostObjects().size());
+	for (const model::LostObject& loot : session.GetLostObjects()) {
+		std::string fragment;
+		util::JsonWriter writer(fragment);
+		writer.Key(loot.id);
+		WriteLostObjectInfo(writer, loot);
+		snapshot->lost_objects.emplace_back(loot.id,
+														std::make_shared<const std::string>(std::move(fragment)));
+	}
+
+	snapshot->state_body = MakeStateBody(*snapshot);
+
+	return snapshot;
+}
+
+} // namespace app
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "model.h"
+#include "player.h"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace app {
+
+// Состояние одной сессии: готовые тела ответов и фрагменты JSON вида "id":{...}.
+// Всё, что не изменилось, новая версия снимка разделяет с предыдущей
+struct SessionSnapshot {
+	using Fragment = std::shared_ptr<const std::string>;
+	using Fragments = std::vector<std::pair<uint64_t, Fragment>>;
+
+	// Тело ответа /game/players. Меняется только при входе игрока
+	std::shared_ptr<const std::string> players_body;
+	// Тело ответа /game/state
+	std::string state_body;
+
+	uint64_t tick = 0;
+	// Упорядочены по id собаки, ключ фрагмента - id игрока
+	Fragments players;
+	// Упорядочены по id предмета
+	Fragments lost_objects;
+	// Меняется только в тике. nullptr - история пуста
+	std::shared_ptr<const model::GameSession::History> history;
+
+	// Дописывает в out тело ответа /game/state?since=N с тем, что изменилось после
+	// тика since. Если история сессии не покрывает эти тики, пишется полное состояние сессии
+	void WriteDelta(uint64_t since, std::string& out) const;
+};
+
+// Текущая версия снимка сессии. Заменяется атомарно, а прежняя версия живёт,
+// пока на неё есть ссылки
+class SessionSlot {
+ public:
+	std::shared_ptr<const SessionSnapshot> Get() const { return std::atomic_load(&snapshot_); }
+	void Set(std::shared_ptr<const SessionSnapshot> snapshot) {
+		std::atomic_store(&snapshot_, std::move(snapshot));
+	}
+
+ private:
+	std::shared_ptr<const SessionSnapshot> snapshot_;
+};
+
+// Сессии мира, из снимков которых отвечают /game/state и /game/players.
+// Набор сессий неизменяем и копируется, только когда появляется новая сессия
+struct StateSnapshot {
+	std::unordered_map<const model::GameSession*, std::shared_ptr<SessionSlot>> sessions;
+
+	// nullptr, если сессия появилась после публикации снимка
+	std::shared_ptr<const SessionSnapshot> FindSession(const model::GameSession* session) const {
+		auto it = sessions.find(session);
+		return it != sessions.end() ? it->second->Get() : nullptr;
+	}
+};
+
+// Снимки сессий собираются на api_strand после каждого тика и публикуются
+// атомарной заменой указателя. Читатели не ждут strand и никогда не видят
+// сессию посреди тика. Действия игроков между тиками пересобирают только
+// фрагмент самого игрока и заменяют снимок его сессии, не трогая остальные
+class StateView {
+ public:
+	StateView(const model::Game& game, const Players& players)
+		 : game_(game), players_(players), snapshot_(std::make_shared<StateSnapshot>()) {
+		Publish();
+	}
+
+	StateView(const StateView&) = delete;
+	StateView& operator=(const StateView&) = delete;
+
+	// Пересобирает снимки всех сессий после тика. Вызывается только из api_strand
+	void Publish();
+	// Пересобирает фрагмент игрока после его действия или входа в игру, остальные
+	// фрагменты сессии берутся из предыдущей версии. Вызывается только из api_strand
+	void UpdatePlayer(const Player& player);
+
+	std::shared_ptr<const StateSnapshot> Get() const { return std::atomic_load(&snapshot_); }
+
+ private:
+	std::shared_ptr<const SessionSnapshot> MakeSessionSnapshot(const model::GameSession& session) const;
+	// Добавляет слоты сессий, которых ещё нет в опубликованном наборе
+	void AddSessions(
+		 std::vector<std::pair<const model::GameSession*, std::shared_ptr<const SessionSnapshot>>>
+			  added);
+	std::shared_ptr<const SessionSnapshot> UpdatePlayer(const SessionSnapshot& previous,
+																		 const Player& player) const;
+
+	const model::Game& game_;
+	const Players& players_;
+	std::shared_ptr<const StateSnapshot> snapshot_;
+};
+
+} // namespace app
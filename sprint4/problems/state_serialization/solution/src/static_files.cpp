@@ -0,0 +1,437 @@
+#include "static_files.h"
+
+#include "compression.h"
+
+#include <boost/asio/post.hpp>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstdio>
+#include <fstream>
+
+namespace http_handler {
+
+std::string ToLower(std::string str) {
+	std::transform(str.begin(), str.end(), str.begin(),
+						[](unsigned char c) { return std::tolower(c); });
+	return str;
+}
+
+std::string GetMimeType(const fs::path& ext) {
+	static const std::unordered_map<std::string, std::string> mime_types{
+		 {".htm", "text/html"},			{".html", "text/html"},
+		 {".css", "text/css"},			{".txt", "text/plain"},
+		 {".js", "text/javascript"},	{".json", "application/json"},
+		 {".xml", "application/xml"}, {".png", "image/png"},
+		 {".jpg", "image/jpeg"},		{".jpe", "image/jpeg"},
+		 {".jpeg", "image/jpeg"},		{".gif", "image/gif"},
+		 {".bmp", "image/bmp"},			{".ico", "image/vnd.microsoft.icon"},
+		 {".tiff", "image/tiff"},		{".tif", "image/tiff"},
+		 {".svg", "image/svg+xml"},	{".svgz", "image/svg+xml"},
+		 {".mp3", "audio/mpeg"}};
+	auto ext_str = ToLower(ext.string());
+	auto it = mime_types.find(ext_str);
+	return it != mime_types.end() ? it->second : "application/octet-stream";
+}
+
+bool IsSubPath(fs::path path, fs::path base) {
+	path = fs::weakly_canonical(path);
+	base = fs::weakly_canonical(base);
+
+	for (auto b = base.begin(), p = path.begin(); b != base.end(); ++b, ++p) {
+		if (p == path.end() || *p != *b) {
+			return false;
+		}
+	}
+	return true;
+}
+
+uint64_t StaticFile::GetMemorySize() const {
+	uint64_t size = content ? content->size() : 0;
+	for (const EncodedContent& variant : encoded) {
+		size += variant.data.size();
+	}
+	return size;
+}
+
+std::string_view GetEncodingName(ContentEncoding encoding) {
+	switch (encoding) {
+		case ContentEncoding::GZIP:
+			return "gzip";
+		case ContentEncoding::BROTLI:
+			return "br";
+	}
+	return {};
+}
+
+bool IsCompressible(std::string_view mime_type) {
+	return mime_type.substr(0, 5) == "text/" || mime_type == "application/json" ||
+			 mime_type == "application/xml" || mime_type == "image/svg+xml" ||
+			 mime_type == "image/bmp" || mime_type == "image/vnd.microsoft.icon";
+}
+
+namespace {
+
+std::string_view Trim(std::string_view str) {
+	while (!str.empty() && (str.front() == ' ' || str.front() == '\t')) {
+		str.remove_prefix(1);
+	}
+	while (!str.empty() && (str.back() == ' ' || str.back() == '\t')) {
+		str.remove_suffix(1);
+	}
+	return str;
+}
+
+bool EqualsIgnoreCase(std::string_view a, std::string_view b) {
+	return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+				 return std::tolower(static_cast<unsigned char>(x)) ==
+						  std::tolower(static_cast<unsigned char>(y));
+			 });
+}
+
+// Вес q кодирования в Accept-Encoding: 0 - клиент его не принимает
+double GetQuality(std::string_view accept_encoding, std::string_view coding) {
+	std::optional<double> any;
+	while (!accept_encoding.empty()) {
+		const size_t comma = accept_encoding.find(',');
+		std::string_view item = accept_encoding.substr(0, comma);
+		accept_encoding.remove_prefix(comma == std::string_view::npos ? accept_encoding.size() : comma + 1);
+
+		const size_t semicolon = item.find(';');
+		const std::string_view name = Trim(item.substr(0, semicolon));
+		double q = 1;
+		if (semicolon != std::string_view::npos) {
+			std::string_view param = Trim(item.substr(semicolon + 1));
+			if (param.size() > 2 && (param[0] == 'q' || param[0] == 'Q') && param[1] == '=') {
+				param.remove_prefix(2);
+				if (std::from_chars(param.data(), param.data() + param.size(), q).ec != std::errc{}) {
+					q = 0;
+				}
+			}
+		}
+
+		if (EqualsIgnoreCase(name, coding)) {
+			return q;
+		}
+		if (name == "*") {
+			any = q;
+		}
+	}
+	return any.value_or(0);
+}
+
+} // namespace
+
+const EncodedContent* ChooseEncoding(std::string_view accept_encoding, const StaticFile& file) {
+	const EncodedContent* best = nullptr;
+	double best_q = 0;
+	for (const EncodedContent& variant : file.encoded) {
+		const double q = GetQuality(accept_encoding, GetEncodingName(variant.encoding));
+		if (q > best_q || (q > 0 && q == best_q && variant.data.size() < best->data.size())) {
+			best = &variant;
+			best_q = q;
+		}
+	}
+	return best;
+}
+
+namespace {
+
+// Отметка времени изменения файла, по которой видно, что его переписали
+struct FileStamp {
+	uint64_t size = 0;
+	std::time_t modified = 0;
+	long modified_nsec = 0;
+};
+
+std::optional<FileStamp> StatRegularFile(const fs::path& path) {
+	struct stat st {};
+	if (::stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+		return std::nullopt;
+	}
+	return FileStamp{static_cast<uint64_t>(st.st_size), st.st_mtim.tv_sec, st.st_mtim.tv_nsec};
+}
+
+std::string MakeETag(const FileStamp& stamp) {
+	char buf[64];
+	std::snprintf(buf, sizeof(buf), "\"%llx-%llx-%lx\"", static_cast<unsigned long long>(stamp.size),
+					  static_cast<unsigned long long>(stamp.modified), stamp.modified_nsec);
+	return buf;
+}
+
+// ETag сжатого варианта: тот же, что у файла, с суффиксом кодирования внутри кавычек
+std::string MakeEncodedETag(std::string_view etag, ContentEncoding encoding) {
+	std::string result{etag.substr(0, etag.size() - 1)};
+	result += encoding == ContentEncoding::GZIP ? "-gz\"" : "-br\"";
+	return result;
+}
+
+void AddEncoded(StaticFile& file, ContentEncoding encoding, std::string data) {
+	// Вариант, который экономит меньше 10%, не стоит памяти и отдельного ETag
+	if (data.size() * 10 < file.content->size() * 9) {
+		std::string etag = MakeEncodedETag(file.etag, encoding);
+		file.encoded.push_back({encoding, std::move(data), std::move(etag)});
+	}
+}
+
+} // namespace
+
+std::string FormatHttpDate(std::time_t time) {
+	std::tm tm{};
+	gmtime_r(&time, &tm);
+	char buf[64];
+	size_t size = std::strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+	return {buf, size};
+}
+
+std::optional<std::time_t> ParseHttpDate(std::string_view date) {
+	std::string str(date);
+	std::tm tm{};
+	const char* end = strptime(str.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+	if (!end || *end != '\0') {
+		return std::nullopt;
+	}
+	return timegm(&tm);
+}
+
+namespace {
+
+std::string_view SkipSeparators(std::string_view list) {
+	size_t start = list.find_first_not_of(" \t,");
+	return start == std::string_view::npos ? std::string_view{} : list.substr(start);
+}
+
+// Слабое сравнение не различает сильные и слабые теги
+std::string_view StripWeak(std::string_view etag) {
+	return etag.starts_with("W/") ? etag.substr(2) : etag;
+}
+
+} // namespace
+
+bool MatchesETag(std::string_view if_none_match, std::string_view etag) {
+	etag = StripWeak(etag);
+	for (std::string_view list = SkipSeparators(if_none_match); !list.empty();
+		  list = SkipSeparators(list)) {
+		if (list.front() == '*') {
+			return true;
+		}
+		// Запятая может быть и внутри кавычек, поэтому тег читается до закрывающей кавычки
+		std::string_view tag = StripWeak(list);
+		size_t close = tag.starts_with('"') ? tag.find('"', 1) : std::string_view::npos;
+		if (close == std::string_view::npos) {
+			// Некорректный элемент списка пропускается целиком
+			size_t comma = list.find(',');
+			list = comma == std::string_view::npos ? std::string_view{} : list.substr(comma);
+			continue;
+		}
+		if (tag.substr(0, close + 1) == etag) {
+			return true;
+		}
+		list = tag.substr(close + 1);
+	}
+	return false;
+}
+
+StaticFiles::StaticFiles(fs::path root) : StaticFiles(std::move(root), Limits{}) {}
+
+StaticFiles::StaticFiles(fs::path root, Limits limits) : root_(std::move(root)), limits_(limits) {}
+
+StaticFiles::~StaticFiles() {
+	compressor_.join();
+}
+
+StaticFiles::Resolution StaticFiles::Resolve(std::string url_path) {
+	if (url_path.empty() || url_path.back() == '/') {
+		url_path += "index.html";
+	}
+
+	const Clock::time_point now = Clock::now();
+	std::shared_ptr<const StaticFile> cached;
+	{
+		std::lock_guard lock{mutex_};
+		if (auto it = entries_.find(url_path); it != entries_.end()) {
+			Entry& entry = it->second;
+			if (now - entry.checked_at < limits_.revalidate_period) {
+				++hits_;
+				Touch(entry);
+				return entry.resolution;
+			}
+			cached = entry.resolution.file;
+		}
+	}
+
+	// stat выполняется без блокировки, чтобы не задерживать запросы к другим файлам
+	if (cached && IsUpToDate(*cached)) {
+		std::lock_guard lock{mutex_};
+		if (auto it = entries_.find(url_path); it != entries_.end()) {
+			Entry& entry = it->second;
+			++hits_;
+			entry.checked_at = now;
+			Touch(entry);
+			return entry.resolution;
+		}
+	}
+
+	Resolution resolution = Load(url_path);
+	std::lock_guard lock{mutex_};
+	++misses_;
+	Store(url_path, resolution, now);
+	if (resolution.file && resolution.file->compressible) {
+		++pending_compressions_;
+		boost::asio::post(compressor_, [this, url_path, file = resolution.file] {
+			Compress(url_path, file);
+		});
+	}
+	return resolution;
+}
+
+StaticFiles::Stats StaticFiles::GetStats() const {
+	std::lock_guard lock{mutex_};
+	return {hits_, misses_, cached_bytes_};
+}
+
+size_t StaticFiles::Preload() {
+	size_t count = 0;
+	std::error_code ec;
+	for (fs::recursive_directory_iterator it{root_, fs::directory_options::skip_permission_denied, ec}, end;
+		  !ec && it != end; it.increment(ec)) {
+		if (it->is_regular_file(ec)) {
+			Resolve("/" + fs::relative(it->path(), root_, ec).generic_string());
+			++count;
+		}
+	}
+	WaitCompressed();
+	return count;
+}
+
+void StaticFiles::WaitCompressed() {
+	std::unique_lock lock{mutex_};
+	compressed_cv_.wait(lock, [this] { return pending_compressions_ == 0; });
+}
+
+void StaticFiles::Compress(const std::string& url_path,
+									const std::shared_ptr<const StaticFile>& file) {
+	// Копия разделяет содержимое с оригиналом, копируются только метаданные
+	auto compressed = std::make_shared<StaticFile>(*file);
+	try {
+		AddEncoded(*compressed, ContentEncoding::BROTLI, util::BrotliCompress(*file->content));
+		AddEncoded(*compressed, ContentEncoding::GZIP, util::GzipCompress(*file->content));
+	} catch (const std::exception&) {
+		// Файл продолжит отдаваться без сжатия
+		compressed->encoded.clear();
+	}
+
+	{
+		std::lock_guard lock{mutex_};
+		--pending_compressions_;
+		// Пока файл сжимался, его могли вытеснить или перезагрузить
+		auto it = entries_.find(url_path);
+		if (!compressed->encoded.empty() && it != entries_.end() &&
+			 it->second.resolution.file == file) {
+			Entry& entry = it->second;
+			if (entry.lru_pos) {
+				cached_bytes_ += compressed->GetMemorySize() - file->GetMemorySize();
+			}
+			entry.resolution.file = std::move(compressed);
+			while (cached_bytes_ > limits_.max_cache_size && !lru_.empty()) {
+				Forget(entries_.find(lru_.back()));
+			}
+		}
+	}
+	compressed_cv_.notify_all();
+}
+
+StaticFiles::Resolution StaticFiles::Load(const std::string& url_path) const {
+	fs::path path = root_ / std::string_view(url_path).substr(url_path.front() == '/' ? 1 : 0);
+	if (!IsSubPath(path, root_)) {
+		return {Status::OUTSIDE_ROOT, nullptr};
+	}
+
+	const std::optional<FileStamp> stamp = StatRegularFile(path);
+	if (!stamp) {
+		return {Status::NOT_FOUND, nullptr};
+	}
+
+	auto file = std::make_shared<StaticFile>();
+	file->mime_type = GetMimeType(path.extension());
+	file->size = stamp->size;
+	file->modified = stamp->modified;
+	file->modified_nsec = stamp->modified_nsec;
+	file->etag = MakeETag(*stamp);
+	file->last_modified = FormatHttpDate(stamp->modified);
+
+	if (file->size <= limits_.max_file_size && file->size <= limits_.max_cache_size) {
+		std::ifstream in(path, std::ios::binary);
+		auto content = std::make_shared<std::string>(file->size, '\0');
+		if (!in.read(content->data(), static_cast<std::streamsize>(content->size()))) {
+			return {Status::NOT_FOUND, nullptr};
+		}
+		file->content = std::move(content);
+
+		// Сжатие выполняется один раз после загрузки, а не на каждый ответ
+		file->compressible =
+			 file->size >= limits_.min_compress_size && IsCompressible(file->mime_type);
+	}
+	file->path = std::move(path);
+
+	return {Status::OK, std::move(file)};
+}
+
+bool StaticFiles::IsUpToDate(const StaticFile& file) const {
+	const std::optional<FileStamp> stamp = StatRegularFile(file.path);
+	return stamp && stamp->size == file.size && stamp->modified == file.modified &&
+			 stamp->modified_nsec == file.modified_nsec;
+}
+
+void StaticFiles::Store(const std::string& url_path, Resolution resolution, Clock::time_point now) {
+	if (auto it = entries_.find(url_path); it != entries_.end()) {
+		Forget(it);
+	}
+
+	Entry entry{std::move(resolution), now, std::nullopt, std::nullopt};
+	if (entry.resolution.file && entry.resolution.file->content) {
+		lru_.push_front(url_path);
+		entry.lru_pos = lru_.begin();
+		cached_bytes_ += entry.resolution.file->GetMemorySize();
+	} else if (entry.resolution.status != Status::OK) {
+		// Запросы к несуществующим путям не должны раздувать кэш без предела,
+		// но и вытеснять содержимое настоящих файлов тоже не должны
+		if (limits_.max_missing_paths == 0) {
+			return;
+		}
+		if (missing_.size() >= limits_.max_missing_paths) {
+			Forget(entries_.find(missing_.back()));
+		}
+		missing_.push_front(url_path);
+		entry.missing_pos = missing_.begin();
+	}
+	entries_.emplace(url_path, std::move(entry));
+
+	while (cached_bytes_ > limits_.max_cache_size && !lru_.empty()) {
+		Forget(entries_.find(lru_.back()));
+	}
+}
+
+void StaticFiles::Forget(std::unordered_map<std::string, Entry>::iterator it) {
+	if (it->second.lru_pos) {
+		cached_bytes_ -= it->second.resolution.file->GetMemorySize();
+		lru_.erase(*it->second.lru_pos);
+	}
+	if (it->second.missing_pos) {
+		missing_.erase(*it->second.missing_pos);
+	}
+	entries_.erase(it);
+}
+
+void StaticFiles::Touch(Entry& entry) {
+	if (entry.lru_pos) {
+		lru_.splice(lru_.begin(), lru_, *entry.lru_pos);
+	}
+	if (entry.missing_pos) {
+		missing_.splice(missing_.begin(), missing_, *entry.missing_pos);
+	}
+}
+
+} // namespace http_handler
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <boost/asio/thread_pool.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace http_handler {
+
+namespace fs = std::filesystem;
+
+enum class ContentEncoding { GZIP, BROTLI };
+
+// Сжатый вариант содержимого. ETag у него свой, так как байты ответа другие
+struct EncodedContent {
+	ContentEncoding encoding;
+	std::string data;
+	std::string etag;
+};
+
+// Файл из каталога статики и всё, что нужно для ответа на запрос к нему
+struct StaticFile {
+	fs::path path;
+	std::string mime_type;
+	uint64_t size = 0;
+	// Время изменения с точностью до секунды, как в Last-Modified
+	std::time_t modified = 0;
+	long modified_nsec = 0;
+	std::string etag;
+	std::string last_modified;
+	// Содержимое, если файл поместился в кэш. Иначе файл читается при каждом запросе
+	std::shared_ptr<const std::string> content;
+	// Сжатые варианты content. Только те, что заметно меньше оригинала
+	std::vector<EncodedContent> encoded;
+	// Файл сжимается в фоне, и пока сжатие не закончено, encoded пуст.
+	// Ответы всё равно зависят от Accept-Encoding, о чём говорит заголовок Vary
+	bool compressible = false;
+
+	// Сколько памяти кэша занимают содержимое и его сжатые варианты
+	uint64_t GetMemorySize() const;
+};
+
+/*
+ * Находит файлы статики по пути из запроса. Проверка пути, stat и MIME-тип
+ * кэшируются для каждого пути, а содержимое небольших файлов держится в памяти
+ * в пределах общего лимита, вытесняясь по давности использования.
+ * Кэшированный файл перепроверяется через stat не чаще раза в revalidate_period.
+ * Сжатые варианты готовятся в отдельном потоке, а до тех пор файл отдаётся как есть,
+ * чтобы сжатие большого файла не задерживало запросы в потоке сессии.
+ */
+class StaticFiles {
+ public:
+	struct Limits {
+		// Суммарный размер содержимого в памяти
+		uint64_t max_cache_size = 64 * 1024 * 1024;
+		// Файлы больше этого размера в память не загружаются
+		uint64_t max_file_size = 8 * 1024 * 1024;
+		std::chrono::milliseconds revalidate_period{1000};
+		// Сколько несуществующих путей помнить. Они вытесняют только друг друга
+		size_t max_missing_paths = 4096;
+		// Файлы меньше этого размера не сжимаются: выигрыш съедают заголовки
+		uint64_t min_compress_size = 256;
+	};
+
+	enum class Status { OK, NOT_FOUND, OUTSIDE_ROOT };
+
+	struct Resolution {
+		Status status = Status::NOT_FOUND;
+		std::shared_ptr<const StaticFile> file;
+	};
+
+	struct Stats {
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+		uint64_t cached_bytes = 0;
+	};
+
+	explicit StaticFiles(fs::path root);
+	StaticFiles(fs::path root, Limits limits);
+
+	StaticFiles(const StaticFiles&) = delete;
+	StaticFiles& operator=(const StaticFiles&) = delete;
+	~StaticFiles();
+
+	// url_path - декодированный путь из запроса. Для каталогов отдаётся index.html
+	Resolution Resolve(std::string url_path);
+
+	Stats GetStats() const;
+
+	// Загружает в кэш и сжимает все файлы каталога, чтобы не делать этого при первых запросах.
+	// Возвращает число найденных файлов
+	size_t Preload();
+
+	// Ждёт, пока будут сжаты все загруженные к этому моменту файлы
+	void WaitCompressed();
+
+	const fs::path& GetRoot() const noexcept { return root_; }
+
+ private:
+	using Clock = std::chrono::steady_clock;
+
+	struct Entry {
+		Resolution resolution;
+		Clock::time_point checked_at;
+		// Позиция в lru_, если содержимое файла в кэше
+		std::optional<std::list<std::string>::iterator> lru_pos;
+		// Позиция в missing_, если файла нет или путь вне корня
+		std::optional<std::list<std::string>::iterator> missing_pos;
+	};
+
+	Resolution Load(const std::string& url_path) const;
+	bool IsUpToDate(const StaticFile& file) const;
+	void Store(const std::string& url_path, Resolution resolution, Clock::time_point now);
+	void Forget(std::unordered_map<std::string, Entry>::iterator it);
+	void Touch(Entry& entry);
+	// Сжимает файл и подменяет им запись url_path, если в ней всё ещё тот же файл
+	void Compress(const std::string& url_path, const std::shared_ptr<const StaticFile>& file);
+
+	fs::path root_;
+	Limits limits_;
+
+	mutable std::mutex mutex_;
+	std::unordered_map<std::string, Entry> entries_;
+	// Пути файлов с содержимым в памяти, от недавно использованных к давним
+	std::list<std::string> lru_;
+	// Несуществующие пути, от недавно запрошенных к давним
+	std::list<std::string> missing_;
+	uint64_t cached_bytes_ = 0;
+	uint64_t hits_ = 0;
+	uint64_t misses_ = 0;
+	size_t pending_compressions_ = 0;
+	std::condition_variable compressed_cv_;
+
+	// Объявлен последним, чтобы остановиться раньше, чем исчезнут данные, с которыми он работает
+	boost::asio::thread_pool compressor_{1};
+};
+
+/*
+ * Выбирает сжатый вариант файла по заголовку Accept-Encoding: с наибольшим q,
+ * а при равных q - самый короткий. nullptr - отдавать файл без сжатия.
+ */
+const EncodedContent* ChooseEncoding(std::string_view accept_encoding, const StaticFile& file);
+std::string_view GetEncodingName(ContentEncoding encoding);
+// Уже сжатые форматы повторно не сжимаются
+bool IsCompressible(std::string_view mime_type);
+
+std::string ToLower(std::string str);
+std::string GetMimeType(const std::filesystem::path& ext);
+bool IsSubPath(fs::path path, fs::path base);
+
+// Дата в формате HTTP: "Sun, 06 Nov 1994 08:49:37 GMT"
+std::string FormatHttpDate(std::time_t time);
+std::optional<std::time_t> ParseHttpDate(std::string_view date);
+
+// Есть ли etag в списке тегов из If-None-Match. Теги сравниваются слабо, как требует
+// RFC 9110: W/"x" совпадает с "x". "*" совпадает с любым тегом
+bool MatchesETag(std::string_view if_none_match, std::string_view etag);
+
+} // namespace http_handler
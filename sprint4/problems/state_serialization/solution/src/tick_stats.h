@@ -0,0 +1,82 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Статистика тиков игровых часов. Пишется только из strand тикера,
+ * а читаться может из любого потока, поэтому все счётчики атомарные.
+ */
+class TickStats {
+ public:
+	using Duration = std::chrono::microseconds;
+
+	// Верхние границы корзин гистограммы длительности тика. Последняя корзина - всё, что дольше
+	static constexpr std::array<Duration, 10> BUCKET_BOUNDS{
+		 Duration{500},    Duration{1000},   Duration{2000},   Duration{5000},    Duration{10000},
+		 Duration{20000},  Duration{50000},  Duration{100000}, Duration{200000},  Duration{500000}};
+	static constexpr size_t BUCKET_COUNT = BUCKET_BOUNDS.size() + 1;
+
+	// Номер корзины, в которую попадает тик длительностью duration
+	static size_t GetBucket(Duration duration) noexcept {
+		size_t bucket = 0;
+		while (bucket < BUCKET_BOUNDS.size() && duration > BUCKET_BOUNDS[bucket]) {
+			++bucket;
+		}
+		return bucket;
+	}
+
+	// Тик занял duration и был разбит на steps шагов. Дольше периода - перерасход
+	void AddTick(Duration duration, Duration period, uint64_t steps) noexcept {
+		buckets_[GetBucket(duration)].fetch_add(1, std::memory_order_relaxed);
+		ticks_.fetch_add(1, std::memory_order_relaxed);
+		steps_.fetch_add(steps, std::memory_order_relaxed);
+		total_time_.fetch_add(duration.count(), std::memory_order_relaxed);
+		if (duration > period) {
+			overruns_.fetch_add(1, std::memory_order_relaxed);
+		}
+		for (auto max = max_time_.load(std::memory_order_relaxed); duration.count() > max;) {
+			if (max_time_.compare_exchange_weak(max, duration.count(), std::memory_order_relaxed)) {
+				break;
+			}
+		}
+	}
+
+	// Тикер опоздал и пропустил count сроков срабатывания
+	void AddMissedDeadlines(uint64_t count) noexcept {
+		missed_deadlines_.fetch_add(count, std::memory_order_relaxed);
+	}
+
+	// Игровое время, которое не уложилось в бюджет догоняния и было отброшено
+	void AddDroppedTime(std::chrono::milliseconds time) noexcept {
+		dropped_time_.fetch_add(time.count(), std::memory_order_relaxed);
+	}
+
+	uint64_t GetTickCount() const noexcept { return ticks_.load(std::memory_order_relaxed); }
+	uint64_t GetStepCount() const noexcept { return steps_.load(std::memory_order_relaxed); }
+	uint64_t GetOverrunCount() const noexcept { return overruns_.load(std::memory_order_relaxed); }
+	uint64_t GetMissedDeadlineCount() const noexcept {
+		return missed_deadlines_.load(std::memory_order_relaxed);
+	}
+	std::chrono::milliseconds GetDroppedTime() const noexcept {
+		return std::chrono::milliseconds{dropped_time_.load(std::memory_order_relaxed)};
+	}
+	Duration GetTotalTime() const noexcept { return Duration{total_time_.load(std::memory_order_relaxed)}; }
+	Duration GetMaxTime() const noexcept { return Duration{max_time_.load(std::memory_order_relaxed)}; }
+	uint64_t GetBucketCount(size_t bucket) const noexcept {
+		return buckets_[bucket].load(std::memory_order_relaxed);
+	}
+
+ private:
+	std::array<std::atomic<uint64_t>, BUCKET_COUNT> buckets_{};
+	std::atomic<uint64_t> ticks_ = 0;
+	std::atomic<uint64_t> steps_ = 0;
+	std::atomic<uint64_t> overruns_ = 0;
+	std::atomic<uint64_t> missed_deadlines_ = 0;
+	std::atomic<int64_t> dropped_time_ = 0;
+	std::atomic<int64_t> total_time_ = 0;
+	std::atomic<int64_t> max_time_ = 0;
+};
@@ -4,31 +4,72 @@
 #include <boost/asio/strand.hpp>
 #include <boost/asio/steady_timer.hpp>
 
+#include <algorithm>
+#include <cassert>
 #include <chrono>
 #include <memory>
 #include <functional>
+#include <optional>
+
+#include "tick_stats.h"
 
 namespace net = boost::asio;
 namespace sys = boost::system;
 
+// Вызывает fn для шагов не длиннее max_step, в сумме дающих delta. Возвращает число шагов
+template <typename Fn>
+size_t ForEachTickStep(std::chrono::milliseconds delta, std::chrono::milliseconds max_step, Fn&& fn) {
+	if (delta <= std::chrono::milliseconds::zero()) {
+		return 0;
+	}
+	const auto count = (delta.count() + max_step.count() - 1) / max_step.count();
+	// Шаги делаются почти равными, чтобы последний не оказался слишком коротким
+	const auto base = delta.count() / count;
+	const auto remainder = delta.count() % count;
+	for (decltype(delta.count()) i = 0; i < count; ++i) {
+		fn(std::chrono::milliseconds{base + (i < remainder ? 1 : 0)});
+	}
+	return static_cast<size_t>(count);
+}
+
 class Ticker : public std::enable_shared_from_this<Ticker> {
  public:
 	using Strand = net::strand<net::io_context::executor_type>;
 	using Handler = std::function<void(std::chrono::milliseconds delta)>;
+	// Вызывается один раз после всех шагов тика, например, чтобы опубликовать его итог
+	using TickEndHandler = std::function<void()>;
+
+	// Режим фиксированного шага: сроки тиков отсчитываются от старта и не накапливают сдвиг,
+	// прошедшее время делится на шаги не длиннее max_step, а всё, что дольше max_catch_up, отбрасывается
+	struct FixedStep {
+		std::chrono::milliseconds max_step;
+		std::chrono::milliseconds max_catch_up;
+	};
 
 	// Функция handler будет вызываться внутри strand с интервалом period
-	Ticker(Strand strand, std::chrono::milliseconds period, Handler handler)
-		 : strand_{strand}, period_{period}, handler_{std::move(handler)} {}
+	Ticker(Strand strand, std::chrono::milliseconds period, Handler handler,
+			 std::optional<FixedStep> fixed_step = std::nullopt, TickEndHandler on_tick_end = {})
+		 : strand_{strand}, period_{period}, handler_{std::move(handler)}, fixed_step_{fixed_step},
+			on_tick_end_{std::move(on_tick_end)} {}
 
 	void Start() {
 		last_tick_ = Clock::now();
+		next_deadline_ = last_tick_ + period_;
 		net::dispatch(strand_, [self = shared_from_this()] { self->ScheduleTick(); });
 	}
 
+	const TickStats& GetStats() const noexcept { return stats_; }
+
  private:
+	using Clock = std::chrono::steady_clock;
+
 	void ScheduleTick() {
 		assert(strand_.running_in_this_thread());
-		timer_.expires_after(period_);
+		if (fixed_step_) {
+			timer_.expires_at(next_deadline_);
+		} else {
+			timer_.expires_after(period_);
+		}
 		timer_.async_wait([self = shared_from_this()](sys::error_code ec) { self->OnTick(ec); });
 	}
 
@@ -39,21 +80,57 @@ class Ticker : public std::enable_shared_from_this<Ticker> {
 		if (!ec) {
 			auto this_tick = Clock::now();
 			auto delta = duration_cast<milliseconds>(this_tick - last_tick_);
-			last_tick_ = this_tick;
+			size_t steps = 1;
 			try {
-				handler_(delta);
+				if (fixed_step_) {
+					// Остаток меньше миллисекунды переходит в следующий тик
+					last_tick_ += delta;
+					steps = RunFixedSteps(delta);
+				} else {
+					last_tick_ = this_tick;
+					handler_(delta);
+				}
+				if (on_tick_end_ && steps > 0) {
+					on_tick_end_();
+				}
 			} catch (...) {
 			}
+
+			auto tick_end = Clock::now();
+			stats_.AddTick(duration_cast<TickStats::Duration>(tick_end - this_tick), period_, steps);
+			if (fixed_step_) {
+				AdvanceDeadline(tick_end);
+			}
 			ScheduleTick();
 		}
 	}
 
-	using Clock = std::chrono::steady_clock;
+	size_t RunFixedSteps(std::chrono::milliseconds delta) {
+		auto budget = std::min(delta, fixed_step_->max_catch_up);
+		if (budget < delta) {
+			stats_.AddDroppedTime(delta - budget);
+		}
+		return ForEachTickStep(budget, fixed_step_->max_step,
+									  [this](std::chrono::milliseconds step) { handler_(step); });
+	}
+
+	// Сроки, прошедшие во время тика, пропускаются, чтобы не запускать тики подряд
+	void AdvanceDeadline(Clock::time_point now) {
+		next_deadline_ += period_;
+		if (next_deadline_ <= now) {
+			const auto missed = (now - next_deadline_) / period_ + 1;
+			next_deadline_ += missed * period_;
+			stats_.AddMissedDeadlines(static_cast<uint64_t>(missed));
+		}
+	}
 
 	Strand strand_;
 	std::chrono::milliseconds period_;
 	net::steady_timer timer_{strand_};
 	Handler handler_;
+	std::optional<FixedStep> fixed_step_;
+	TickEndHandler on_tick_end_;
 	std::chrono::steady_clock::time_point last_tick_;
+	std::chrono::steady_clock::time_point next_deadline_;
+	TickStats stats_;
 };
-
@@ -0,0 +1,90 @@
+#include "worker_pool.h"
+
+#include <algorithm>
+
+namespace util {
+
+WorkerPool::WorkerPool(unsigned threads) {
+	threads = std::max(1u, threads);
+	workers_.reserve(threads - 1);
+	while (--threads) {
+		workers_.emplace_back([this] { WorkerLoop(); });
+	}
+}
+
+WorkerPool::~WorkerPool() {
+	{
+		std::lock_guard lock{mutex_};
+		stopped_ = true;
+	}
+	job_cv_.notify_all();
+	for (std::thread& worker : workers_) {
+		worker.join();
+	}
+}
+
+void WorkerPool::Run(size_t count, const Task& task) {
+	{
+		std::lock_guard lock{mutex_};
+		task_ = &task;
+		count_ = count;
+		next_index_ = 0;
+		busy_workers_ = workers_.size();
+		error_ = nullptr;
+		++generation_;
+	}
+	job_cv_.notify_all();
+
+	Work();
+
+	std::unique_lock lock{mutex_};
+	done_cv_.wait(lock, [this] { return busy_workers_ == 0; });
+	task_ = nullptr;
+	if (error_) {
+		std::rethrow_exception(std::exchange(error_, nullptr));
+	}
+}
+
+void WorkerPool::WorkerLoop() {
+	size_t seen_generation = 0;
+	std::unique_lock lock{mutex_};
+	while (true) {
+		job_cv_.wait(lock, [&] { return stopped_ || generation_ != seen_generation; });
+		if (stopped_) {
+			return;
+		}
+		seen_generation = generation_;
+
+		lock.unlock();
+		Work();
+		lock.lock();
+
+		if (--busy_workers_ == 0) {
+			done_cv_.notify_one();
+		}
+	}
+}
+
+void WorkerPool::Work() {
+	while (true) {
+		size_t index;
+		{
+			std::lock_guard lock{mutex_};
+			if (next_index_ >= count_ || error_) {
+				return;
+			}
+			index = next_index_++;
+		}
+
+		try {
+			(*task_)(index);
+		} catch (...) {
+			std::lock_guard lock{mutex_};
+			if (!error_) {
+				error_ = std::current_exception();
+			}
+		}
+	}
+}
+
+} // namespace util
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace util {
+
+/*
+ * Пул потоков для параллельного выполнения пачки независимых задач.
+ * Run вызывает task(i) для каждого i из [0, count) и возвращает управление только
+ * после завершения всех вызовов. Вызывающий поток тоже участвует в работе,
+ * поэтому пул из n потоков запускает n-1 собственных потоков.
+ */
+class WorkerPool {
+ public:
+	using Task = std::function<void(size_t index)>;
+
+	explicit WorkerPool(unsigned threads);
+	~WorkerPool();
+
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+
+	unsigned GetThreadCount() const noexcept { return static_cast<unsigned>(workers_.size()) + 1; }
+
+	void Run(size_t count, const Task& task);
+
+ private:
+	void WorkerLoop();
+	void Work();
+
+	std::mutex mutex_;
+	std::condition_variable job_cv_;
+	std::condition_variable done_cv_;
+	const Task* task_ = nullptr;
+	size_t count_ = 0;
+	size_t next_index_ = 0;
+	size_t generation_ = 0;
+	size_t busy_workers_ = 0;
+	bool stopped_ = false;
+	std::exception_ptr error_;
+	std::vector<std::thread> workers_;
+};
+
+} // namespace util
@@ -0,0 +1,36 @@
+#include "allocation-counter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+std::atomic<size_t> allocations_count{0};
+
+} // namespace
+
+// Подсчёт выделений памяти во всей программе
+void* operator new(std::size_t size) {
+	allocations_count.fetch_add(1, std::memory_order_relaxed);
+	if (void* ptr = std::malloc(size == 0 ? 1 : size)) {
+		return ptr;
+	}
+	throw std::bad_alloc{};
+}
+
+void operator delete(void* ptr) noexcept {
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+	std::free(ptr);
+}
+
+namespace test_util {
+
+size_t GetAllocationCount() noexcept {
+	return allocations_count.load(std::memory_order_relaxed);
+}
+
+} // namespace test_util
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+
+namespace test_util {
+
+// Число вызовов operator new во всей программе с её запуска.
+// Глобальный operator new заменяется в allocation-counter.cpp, поэтому он должен
+// входить в исполняемый файл теста ровно один раз
+size_t GetAllocationCount() noexcept;
+
+// Сколько раз выделялась память во время вызова fn
+template <typename Fn>
+size_t CountAllocations(Fn&& fn) {
+	const size_t before = GetAllocationCount();
+	fn();
+	return GetAllocationCount() - before;
+}
+
+} // namespace test_util
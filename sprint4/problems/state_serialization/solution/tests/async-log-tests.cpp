@@ -0,0 +1,111 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <boost/log/sources/logger.hpp>
+#include <boost/log/sources/record_ostream.hpp>
+
+#include <algorithm>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "../src/async_log.h"
+#include "../src/logger.h"
+
+SCENARIO("Log record queue") {
+	GIVEN("a queue for four records") {
+		logger::RecordQueue queue{3};
+		REQUIRE(queue.GetCapacity() == 4);
+
+		WHEN("it is filled up") {
+			for (int i = 0; i < 4; ++i) {
+				REQUIRE(queue.TryPush(std::to_string(i)));
+			}
+
+			THEN("further records are rejected") {
+				CHECK_FALSE(queue.TryPush("overflow"));
+			}
+
+			THEN("records come out in order and free their cells") {
+				std::string record;
+				for (int i = 0; i < 4; ++i) {
+					REQUIRE(queue.TryPop(record));
+					CHECK(record == std::to_string(i));
+				}
+				CHECK_FALSE(queue.TryPop(record));
+				CHECK(queue.TryPush("again"));
+				REQUIRE(queue.TryPop(record));
+				CHECK(record == "again");
+			}
+		}
+	}
+
+	GIVEN("several writers and one reader") {
+		constexpr int WRITERS = 4;
+		constexpr int RECORDS = 10000;
+		logger::RecordQueue queue{64};
+
+		std::vector<std::thread> writers;
+		for (int w = 0; w < WRITERS; ++w) {
+			writers.emplace_back([&queue, w] {
+				for (int i = 0; i < RECORDS; ++i) {
+					std::string record = std::to_string(w) + ":" + std::to_string(i);
+					while (!queue.TryPush(std::move(record))) {
+						std::this_thread::yield();
+					}
+				}
+			});
+		}
+
+		std::vector<int> next(WRITERS, 0);
+		std::string record;
+		for (int received = 0; received < WRITERS * RECORDS;) {
+			if (!queue.TryPop(record)) {
+				std::this_thread::yield();
+				continue;
+			}
+			++received;
+			const size_t colon = record.find(':');
+			const int w = std::stoi(record.substr(0, colon));
+			CHECK(std::stoi(record.substr(colon + 1)) == next[w]++);
+		}
+		for (auto& writer : writers) {
+			writer.join();
+		}
+
+		THEN("every record arrives once and in the order of its writer") {
+			CHECK(std::all_of(next.begin(), next.end(), [](int n) { return n == RECORDS; }));
+		}
+	}
+}
+
+SCENARIO("Asynchronous JSON log sink") {
+	GIVEN("a sink writing to a string stream") {
+		std::ostringstream out;
+		boost::log::sources::logger lg;
+
+		WHEN("records are logged and the sink is destroyed") {
+			{
+				logger::AsyncLogSink sink{out, 1024};
+				for (int i = 0; i < 100; ++i) {
+					BOOST_LOG(lg) << logging::add_value(port_p, i) << logging::add_value(text, "a \"quoted\" text")
+									  << "record";
+				}
+				boost::log::core::get()->flush();
+				CHECK(sink.GetBackend().GetWrittenCount() + sink.GetBackend().GetDroppedCount() == 100);
+			}
+
+			THEN("every kept record is one JSON line") {
+				std::istringstream lines{out.str()};
+				std::string line;
+				int count = 0;
+				while (std::getline(lines, line)) {
+					CHECK(line ==
+							"{\"data\":{\"port\":" + std::to_string(count) +
+								 ",\"text\":\"a \\\"quoted\\\" text\"},\"message\":\"record\"}");
+					++count;
+				}
+				CHECK(count == 100);
+			}
+		}
+	}
+}
@@ -0,0 +1,32 @@
+#include "../src/collision_detector.h"
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <random>
+
+using namespace collision_detector;
+
+// Запуск: collision_detection_tests "[benchmark]"
+TEST_CASE("Gather events search benchmark", "[.][benchmark]") {
+	constexpr int ITEMS_COUNT = 10'000;
+	constexpr int GATHERERS_COUNT = 1'000;
+	constexpr double FIELD_SIZE = 1'000.0;
+
+	std::mt19937 gen{42};
+	std::uniform_real_distribution<double> coord{0.0, FIELD_SIZE};
+	std::uniform_real_distribution<double> step{-1.0, 1.0};
+
+	ItemGathererProvider provider;
+	for (int i = 0; i < ITEMS_COUNT; ++i) {
+		provider.AddItem({{coord(gen), coord(gen)}, 0.0});
+	}
+	for (int i = 0; i < GATHERERS_COUNT; ++i) {
+		geom::Point2D start{coord(gen), coord(gen)};
+		provider.AddGatherer({start, {start.x + step(gen), start.y + step(gen)}, 0.6});
+	}
+
+	REQUIRE(FindGatherEvents(provider).size() == FindGatherEventsBruteForce(provider).size());
+
+	BENCHMARK("brute force") { return FindGatherEventsBruteForce(provider); };
+
+	BENCHMARK("uniform grid") { return FindGatherEvents(provider); };
+}
@@ -1,5 +1,6 @@
 #include "../src/collision_detector.h"
 #include <catch2/catch_test_macros.hpp>
+#include <random>
 
 using namespace collision_detector;
 
@@ -36,3 +37,70 @@ SCENARIO("Collision detector") {
 	}
 }
 
+
+SCENARIO("Gather events search") {
+	GIVEN("Random gatherers and items on a small field") {
+		std::mt19937 gen{42};
+		std::uniform_real_distribution<double> coord{0.0, 30.0};
+		std::uniform_real_distribution<double> step{-2.0, 2.0};
+		std::uniform_real_distribution<double> width{0.0, 0.5};
+
+		ItemGathererProvider provider;
+		for (int i = 0; i < 500; ++i) {
+			provider.AddItem({{coord(gen), coord(gen)}, width(gen), i % 10 == 0});
+		}
+		for (int i = 0; i < 100; ++i) {
+			geom::Point2D start{coord(gen), coord(gen)};
+			geom::Point2D end = i % 7 == 0 ? start : geom::Point2D{start.x + step(gen), start.y + step(gen)};
+			provider.AddGatherer({start, end, 0.6});
+		}
+
+		WHEN("events are found with the uniform grid") {
+			const auto events = FindGatherEvents(provider);
+
+			THEN("they are the same as found by brute force") {
+				const auto expected = FindGatherEventsBruteForce(provider);
+				CHECK_FALSE(expected.empty());
+				REQUIRE(events.size() == expected.size());
+				for (size_t i = 0; i < events.size(); ++i) {
+					CHECK(events[i].item_id == expected[i].item_id);
+					CHECK(events[i].gatherer_id == expected[i].gatherer_id);
+					CHECK(events[i].sq_distance == expected[i].sq_distance);
+					CHECK(events[i].time == expected[i].time);
+				}
+			}
+		}
+	}
+}
+
+SCENARIO("Batch collection check") {
+	GIVEN("A gatherer segment and a block of random points") {
+		std::mt19937 gen{7};
+		std::uniform_real_distribution<double> coord{-50.0, 50.0};
+		const geom::Point2D a{coord(gen), coord(gen)};
+		const geom::Point2D b{coord(gen), coord(gen)};
+
+		constexpr size_t COUNT = 1003;
+		std::vector<double> xs(COUNT);
+		std::vector<double> ys(COUNT);
+		for (size_t i = 0; i < COUNT; ++i) {
+			xs[i] = coord(gen);
+			ys[i] = coord(gen);
+		}
+
+		WHEN("points are checked in a batch") {
+			std::vector<double> sq_distances(COUNT);
+			std::vector<double> proj_ratios(COUNT);
+			TryCollectPoints(a, b, xs.data(), ys.data(), COUNT, sq_distances.data(),
+								  proj_ratios.data());
+
+			THEN("results are exactly the same as of single point checks") {
+				for (size_t i = 0; i < COUNT; ++i) {
+					const CollectionResult res = TryCollectPoint(a, b, {xs[i], ys[i]});
+					CHECK(sq_distances[i] == res.sq_distance);
+					CHECK(proj_ratios[i] == res.proj_ratio);
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,37 @@
+#include "../src/model.h"
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+
+using namespace model;
+
+// Запуск: model_tests "[benchmark]"
+TEST_CASE("Game session tick benchmark", "[.][benchmark]") {
+	constexpr int DOGS_COUNT = 100'000;
+	constexpr Coord GRID_SIZE = 100;
+	constexpr Coord CELL = 10;
+
+	Map map{Map::Id{"map"}, "Map"};
+	for (Coord line = 0; line <= GRID_SIZE; line += CELL) {
+		map.AddRoad({Road::HORIZONTAL, {0, line}, GRID_SIZE});
+		map.AddRoad({Road::VERTICAL, {line, 0}, GRID_SIZE});
+	}
+	map.AddLootType({});
+	map.BuildRoadIndex();
+
+	// Нулевая вероятность отключает генерацию трофеев, чтобы измерялось только движение
+	model::GameSession session{&map, 1.0, 0.0};
+	const geom::Vec2D speeds[] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+	for (int i = 0; i < DOGS_COUNT; ++i) {
+		Dog* dog = session.AddDog("dog");
+		const Coord line = i % (GRID_SIZE / CELL + 1) * CELL;
+		const double offset = i % GRID_SIZE;
+		dog->SetPosition(i % 2 == 0 ? geom::Point2D{offset, static_cast<double>(line)}
+											 : geom::Point2D{static_cast<double>(line), offset});
+		dog->SetSpeed(speeds[i % 4]);
+	}
+
+	BENCHMARK("tick 100k dogs") {
+		session.Tick(50);
+		return session.GetDogs().size();
+	};
+}
@@ -0,0 +1,122 @@
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/strand.hpp>
+
+#include <thread>
+#include <vector>
+
+#include "../src/http_server.h"
+
+using namespace http_server;
+
+namespace {
+
+// Отвечает из другого потока, как обработчик мутирующих запросов, которые идут через api_strand
+class StrandHandler {
+ public:
+	explicit StrandHandler(net::io_context& api_ioc) : api_strand_(net::make_strand(api_ioc)) {}
+
+	template <typename Send>
+	void operator()(http::request<http::string_body, Fields>&& req, const std::string&, Send&& send) {
+		http::response<http::string_body> res{http::status::ok, req.version()};
+		res.body() = std::string(req.target());
+		res.keep_alive(req.keep_alive());
+		res.prepare_payload();
+		net::post(api_strand_, [send = std::forward<Send>(send), res = std::move(res)]() mutable {
+			send(std::move(res));
+		});
+	}
+
+ private:
+	net::strand<net::io_context::executor_type> api_strand_;
+};
+
+// Сервер, принимающий соединения, пока жив объект
+class BenchmarkServer {
+ public:
+	explicit BenchmarkServer(size_t pipeline_limit)
+		 : acceptor_(ioc_, {net::ip::make_address("127.0.0.1"), 0}), pipeline_limit_(pipeline_limit) {
+		Accept();
+		thread_ = std::thread([this] { ioc_.run(); });
+		api_thread_ = std::thread([this] { api_ioc_.run(); });
+	}
+
+	~BenchmarkServer() {
+		ioc_.stop();
+		api_ioc_.stop();
+		thread_.join();
+		api_thread_.join();
+	}
+
+	tcp::endpoint GetEndpoint() const { return acceptor_.local_endpoint(); }
+
+ private:
+	void Accept() {
+		acceptor_.async_accept(net::make_strand(ioc_), [this](sys::error_code ec, StrandSocket socket) {
+			if (ec) {
+				return;
+			}
+			std::make_shared<Session<StrandHandler>>(std::move(socket), StrandHandler{api_ioc_},
+																  pipeline_limit_)
+				 ->Run();
+			Accept();
+		});
+	}
+
+	net::io_context ioc_;
+	net::io_context api_ioc_;
+	net::executor_work_guard<net::io_context::executor_type> api_work_ = net::make_work_guard(api_ioc_);
+	tcp::acceptor acceptor_;
+	size_t pipeline_limit_;
+	std::thread thread_;
+	std::thread api_thread_;
+};
+
+// Нагрузка с конвейером: клиент отправляет все запросы одной записью и затем читает ответы
+class PipelinedClient {
+ public:
+	PipelinedClient(const tcp::endpoint& endpoint, int requests) : socket_(ioc_), requests_(requests) {
+		socket_.connect(endpoint);
+		socket_.set_option(tcp::no_delay(true));
+		for (int i = 0; i < requests; ++i) {
+			data_ += "GET /api/v1/maps/map" + std::to_string(i) + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+		}
+	}
+
+	size_t Run() {
+		net::write(socket_, net::buffer(data_));
+		size_t bytes = 0;
+		for (int i = 0; i < requests_; ++i) {
+			http::response<http::string_body> res;
+			http::read(socket_, buffer_, res);
+			bytes += res.body().size();
+		}
+		return bytes;
+	}
+
+ private:
+	net::io_context ioc_;
+	tcp::socket socket_;
+	beast::flat_buffer buffer_;
+	std::string data_;
+	int requests_;
+};
+
+} // namespace
+
+TEST_CASE("Pipelined keep-alive requests benchmark", "[.][benchmark]") {
+	constexpr int REQUESTS = 64;
+
+	BenchmarkServer sequential{1};
+	PipelinedClient sequential_client{sequential.GetEndpoint(), REQUESTS};
+	BENCHMARK("64 pipelined requests, one at a time") { return sequential_client.Run(); };
+
+	BenchmarkServer pipelined{16};
+	PipelinedClient pipelined_client{pipelined.GetEndpoint(), REQUESTS};
+	BENCHMARK("64 pipelined requests, 16 in flight") { return pipelined_client.Run(); };
+}
@@ -0,0 +1,260 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "../src/http_server.h"
+
+using namespace http_server;
+using namespace std::literals;
+
+namespace {
+
+using StringResponse = http::response<http::string_body>;
+using Send = std::function<void(StringResponse&&)>;
+
+// Запоминает запросы и отвечает на них, только когда тест попросит
+class DeferredHandler {
+ public:
+	void operator()(http::request<http::string_body, Fields>&& req, const std::string&, Send send) {
+		std::lock_guard lock{mutex_};
+		pending_.emplace_back(std::string(req.target()), std::move(send));
+		++received_;
+	}
+
+	size_t GetReceived() const {
+		std::lock_guard lock{mutex_};
+		return received_;
+	}
+
+	// Отвечает на отложенные запросы в обратном порядке, телом ответа служит target запроса
+	void RespondReversed() {
+		std::vector<std::pair<std::string, Send>> pending;
+		{
+			std::lock_guard lock{mutex_};
+			pending.swap(pending_);
+		}
+		for (auto it = pending.rbegin(); it != pending.rend(); ++it) {
+			StringResponse res{http::status::ok, 11};
+			res.body() = it->first;
+			res.prepare_payload();
+			it->second(std::move(res));
+		}
+	}
+
+ private:
+	mutable std::mutex mutex_;
+	std::vector<std::pair<std::string, Send>> pending_;
+	size_t received_ = 0;
+};
+
+// Сервер на случайном порту, который обслуживает одно соединение
+class TestServer {
+ public:
+	explicit TestServer(size_t pipeline_limit)
+		 : acceptor_(ioc_, {net::ip::make_address("127.0.0.1"), 0}) {
+		acceptor_.async_accept(net::make_strand(ioc_), [this, pipeline_limit](sys::error_code ec,
+																							 StrandSocket socket) {
+			if (ec) {
+				return;
+			}
+			auto handler = [this](auto&& req, const std::string& ip, auto&& send) {
+				handler_(std::move(req), ip, Send(std::move(send)));
+			};
+			std::make_shared<Session<decltype(handler)>>(std::move(socket), handler, pipeline_limit)
+				 ->Run();
+		});
+		for (int i = 0; i < 2; ++i) {
+			threads_.emplace_back([this] { ioc_.run(); });
+		}
+	}
+
+	~TestServer() {
+		ioc_.stop();
+		for (auto& thread : threads_) {
+			thread.join();
+		}
+	}
+
+	tcp::endpoint GetEndpoint() const { return acceptor_.local_endpoint(); }
+	DeferredHandler& GetHandler() { return handler_; }
+
+	bool WaitReceived(size_t count) {
+		const auto deadline = std::chrono::steady_clock::now() + 5s;
+		while (handler_.GetReceived() < count) {
+			if (std::chrono::steady_clock::now() > deadline) {
+				return false;
+			}
+			std::this_thread::sleep_for(1ms);
+		}
+		return true;
+	}
+
+ private:
+	net::io_context ioc_;
+	// Сессия, которая ждёт ответов и ничего не читает, не оставляет io_context работы
+	net::executor_work_guard<net::io_context::executor_type> work_ = net::make_work_guard(ioc_);
+	tcp::acceptor acceptor_;
+	DeferredHandler handler_;
+	std::vector<std::thread> threads_;
+};
+
+// Пишет запросы одним блоком, target i-го запроса - "/i"
+void WriteRequests(tcp::socket& socket, const std::vector<http::verb>& methods, bool close_last) {
+	std::string data;
+	for (size_t i = 0; i < methods.size(); ++i) {
+		http::request<http::empty_body> req{methods[i], "/" + std::to_string(i), 11};
+		req.keep_alive(!(close_last && i + 1 == methods.size()));
+		std::ostringstream out;
+		out << req;
+		data += out.str();
+	}
+	net::write(socket, net::buffer(data));
+}
+
+void WriteRequests(tcp::socket& socket, int count, bool close_last) {
+	WriteRequests(socket, std::vector<http::verb>(count, http::verb::get), close_last);
+}
+
+} // namespace
+
+SCENARIO("Pipelined HTTP session") {
+	GIVEN("a session that keeps up to four requests in flight") {
+		TestServer server{4};
+		net::io_context client_ioc;
+		tcp::socket socket{client_ioc};
+		socket.connect(server.GetEndpoint());
+
+		WHEN("four requests are sent at once and answered in reverse order") {
+			WriteRequests(socket, 4, true);
+			REQUIRE(server.WaitReceived(4));
+			server.GetHandler().RespondReversed();
+
+			THEN("responses arrive in the order of requests and the connection is closed") {
+				beast::flat_buffer buffer;
+				for (int i = 0; i < 4; ++i) {
+					StringResponse res;
+					http::read(socket, buffer, res);
+					CHECK(res.body() == "/" + std::to_string(i));
+				}
+				StringResponse res;
+				beast::error_code ec;
+				http::read(socket, buffer, res, ec);
+				CHECK(ec == http::error::end_of_stream);
+			}
+		}
+	}
+
+	GIVEN("a session that keeps up to two requests in flight") {
+		TestServer server{2};
+		net::io_context client_ioc;
+		tcp::socket socket{client_ioc};
+		socket.connect(server.GetEndpoint());
+
+		WHEN("four requests are sent at once") {
+			WriteRequests(socket, 4, false);
+			REQUIRE(server.WaitReceived(2));
+			std::this_thread::sleep_for(50ms);
+
+			THEN("the rest are read only after responses are written") {
+				CHECK(server.GetHandler().GetReceived() == 2);
+				server.GetHandler().RespondReversed();
+				REQUIRE(server.WaitReceived(4));
+				server.GetHandler().RespondReversed();
+
+				beast::flat_buffer buffer;
+				for (int i = 0; i < 4; ++i) {
+					StringResponse res;
+					http::read(socket, buffer, res);
+					CHECK(res.body() == "/" + std::to_string(i));
+				}
+			}
+		}
+	}
+
+	GIVEN("a session that keeps up to four requests in flight, pipelining a POST") {
+		TestServer server{4};
+		net::io_context client_ioc;
+		tcp::socket socket{client_ioc};
+		socket.connect(server.GetEndpoint());
+
+		WHEN("a GET follows a POST on the same connection") {
+			WriteRequests(socket, {http::verb::get, http::verb::post, http::verb::get}, false);
+			REQUIRE(server.WaitReceived(2));
+			std::this_thread::sleep_for(50ms);
+
+			THEN("the GET reaches the handler only after the POST is answered") {
+				CHECK(server.GetHandler().GetReceived() == 2);
+				server.GetHandler().RespondReversed();
+				REQUIRE(server.WaitReceived(3));
+				server.GetHandler().RespondReversed();
+
+				beast::flat_buffer buffer;
+				for (int i = 0; i < 3; ++i) {
+					StringResponse res;
+					http::read(socket, buffer, res);
+					CHECK(res.body() == "/" + std::to_string(i));
+				}
+			}
+		}
+	}
+}
+
+SCENARIO("Listeners in per-core io_contexts") {
+	GIVEN("two io_contexts listening on one port") {
+		IoContextPool pool{2, false};
+		// Отвечает номером потока, принявшего соединение
+		std::mutex mutex;
+		std::vector<std::thread::id> thread_ids;
+		auto handler = [&](auto&& req, const std::string&, auto&& send) {
+			size_t index;
+			{
+				std::lock_guard lock{mutex};
+				auto it = std::find(thread_ids.begin(), thread_ids.end(), std::this_thread::get_id());
+				index = it - thread_ids.begin();
+				if (it == thread_ids.end()) {
+					thread_ids.push_back(std::this_thread::get_id());
+				}
+			}
+			http::response<http::string_body, Fields> res{http::status::ok, req.version()};
+			res.body() = std::to_string(index);
+			res.keep_alive(false);
+			res.prepare_payload();
+			send(std::move(res));
+		};
+		const tcp::endpoint endpoint =
+			 ServeHttp(pool, {net::ip::make_address("127.0.0.1"), 0}, handler);
+		pool.Start();
+
+		WHEN("many clients connect") {
+			std::set<std::string> served_by;
+			net::io_context client_ioc;
+			for (int i = 0; i < 32; ++i) {
+				tcp::socket socket{client_ioc};
+				socket.connect(endpoint);
+				WriteRequests(socket, 1, true);
+				beast::flat_buffer buffer;
+				StringResponse res;
+				http::read(socket, buffer, res);
+				served_by.insert(res.body());
+			}
+
+			THEN("the kernel spreads connections over both threads") {
+				CHECK(endpoint.port() != 0);
+				CHECK(served_by == std::set<std::string>{"0", "1"});
+			}
+		}
+
+		pool.Stop();
+	}
+}
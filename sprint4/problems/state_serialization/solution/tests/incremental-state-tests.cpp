@@ -0,0 +1,127 @@
+#include <catch2/catch_test_macros.hpp>
+#include <filesystem>
+#include <unistd.h>
+
+#include "../src/model_serialization.h"
+#include "../src/serialization.h"
+
+using namespace model;
+namespace fs = std::filesystem;
+
+namespace {
+
+Game MakeGame(int maps_count) {
+	Game game;
+	for (int i = 0; i < maps_count; ++i) {
+		Map map{Map::Id{"map" + std::to_string(i)}, "Map"};
+		map.AddRoad({Road::HORIZONTAL, {0, 0}, 10});
+		map.AddLootType({});
+		map.BuildRoadIndex();
+		game.AddMap(std::move(map));
+	}
+	game.SetPeriod(1.0);
+	game.SetProbability(0.0);
+	return game;
+}
+
+size_t CountSegmentFiles(const fs::path& dir) {
+	size_t count = 0;
+	for (const fs::directory_entry& entry : fs::directory_iterator(dir)) {
+		count += entry.path().filename().string().starts_with("state.session.");
+	}
+	return count;
+}
+
+} // namespace
+
+SCENARIO("Incremental state snapshot") {
+	GIVEN("a game with several sessions saved once") {
+		const fs::path dir =
+			 fs::temp_directory_path() / ("incremental-state-tests-" + std::to_string(::getpid()));
+		fs::create_directories(dir);
+		const std::string state_file = (dir / "state").string();
+
+		constexpr int MAPS_COUNT = 4;
+		Game game = MakeGame(MAPS_COUNT);
+		app::Players players;
+		app::PlayerTokens tokens;
+		for (const Map& map : game.GetMaps()) {
+			model::GameSession* session = game.AddGameSession(
+				 model::GameSession{&map, game.GetPeriod(), game.GetProbability()});
+			Dog* dog = session->AddDog("dog");
+			tokens.AddPlayer(players.Add(session, dog));
+		}
+
+		serialization::IncrementalStateWriter writer{state_file, serialization::StateFormat::BINARY};
+		auto first = writer.Capture(game, players, tokens, 0);
+		writer.Write(*first);
+		CHECK(first->changed.size() == MAPS_COUNT);
+
+		WHEN("only one session changes") {
+			game.FindSessionByMap(game.FindMap(Map::Id{"map2"}))->AddLostObject({0, {5, 0}});
+			game.Tick(100);
+			auto second = writer.Capture(game, players, tokens, 0);
+			writer.Write(*second);
+
+			THEN("only that session is written again") {
+				REQUIRE(second->changed.size() == 1);
+				CHECK(second->changed.front().second.session.map_id == "map2");
+				CHECK(CountSegmentFiles(dir) == MAPS_COUNT);
+			}
+
+			AND_THEN("the saved state contains all sessions") {
+				Game restored = MakeGame(MAPS_COUNT);
+				app::Players restored_players;
+				app::PlayerTokens restored_tokens;
+				serialization::DeserializeState(state_file, restored, restored_players, restored_tokens);
+
+				CHECK(restored.GetGameSessions().size() == MAPS_COUNT);
+				CHECK(restored_players.GetAllPlayers().size() == players.GetAllPlayers().size());
+				CHECK(restored_tokens.GetAll().size() == tokens.GetAll().size());
+				const model::GameSession* session =
+					 restored.FindSessionByMap(restored.FindMap(Map::Id{"map2"}));
+				REQUIRE(session);
+				CHECK(session->GetLostObjects().size() == 1);
+			}
+		}
+
+		WHEN("a second session opens on a map") {
+			const Map* map = game.FindMap(Map::Id{"map1"});
+			model::GameSession* session =
+				 game.AddGameSession(model::GameSession{map, game.GetPeriod(), game.GetProbability()});
+			Dog* dog = session->AddDog("second");
+			tokens.AddPlayer(players.Add(session, dog));
+			auto second = writer.Capture(game, players, tokens, 0);
+			writer.Write(*second);
+
+			THEN("its players are restored into it") {
+				CHECK(second->changed.size() == 1);
+
+				Game restored = MakeGame(MAPS_COUNT);
+				app::Players restored_players;
+				app::PlayerTokens restored_tokens;
+				serialization::DeserializeState(state_file, restored, restored_players, restored_tokens);
+
+				REQUIRE(restored.GetGameSessions().size() == MAPS_COUNT + 1);
+				for (const app::Player& player : restored_players.GetAllPlayers()) {
+					const model::GameSession* restored_session = player.GetSession();
+					const model::GameSession& saved_session = game.GetGameSessions()[restored_session->GetIndex()];
+					CHECK(restored_session->GetMap()->GetId() == saved_session.GetMap()->GetId());
+					CHECK(player.GetDog()->GetName() == saved_session.GetDogs().front().GetName());
+				}
+			}
+		}
+
+		WHEN("nothing changes") {
+			game.Tick(100);
+			auto second = writer.Capture(game, players, tokens, 0);
+			writer.Write(*second);
+
+			THEN("no session is written") {
+				CHECK(second->changed.empty());
+			}
+		}
+
+		fs::remove_all(dir);
+	}
+}
@@ -0,0 +1,199 @@
+#include <catch2/catch_test_macros.hpp>
+#include <filesystem>
+#include <optional>
+#include <unistd.h>
+
+#include "../src/journal.h"
+
+using namespace model;
+using namespace std::literals;
+namespace fs = std::filesystem;
+
+namespace {
+
+Game MakeGame(std::optional<size_t> max_players = std::nullopt) {
+	Map map{Map::Id{"map"}, "Map"};
+	map.SetMaxPlayers(max_players);
+	map.AddRoad({Road::HORIZONTAL, {0, 0}, 10});
+	map.AddRoad({Road::VERTICAL, {0, 0}, 10});
+	map.AddRoad({Road::HORIZONTAL, {0, 10}, 10});
+	map.AddLootType({});
+	map.AddLootType({});
+	map.BuildRoadIndex();
+
+	Game game;
+	game.AddMap(std::move(map));
+	game.SetPeriod(0.1);
+	game.SetProbability(0.9);
+	return game;
+}
+
+// Повторяет то, что делает обработчик /game/join
+app::Player* Join(Game& game, app::Players& players, app::PlayerTokens& tokens,
+						serialization::Journal& journal, std::string name) {
+	const Map* map = game.FindMap(Map::Id{"map"});
+	model::GameSession* session = game.JoinSession(map);
+	Dog* dog = session->AddDog(std::move(name));
+	dog->SetPosition({0, 0});
+	app::Player* player = players.Add(session, dog);
+	journal.AppendJoin(*player, tokens.AddPlayer(player));
+	return player;
+}
+
+} // namespace
+
+SCENARIO("Journal replay") {
+	GIVEN("a journal of joins, moves and ticks with random loot") {
+		const fs::path dir = fs::temp_directory_path() / ("journal-tests-" + std::to_string(::getpid()));
+		fs::create_directories(dir);
+		const std::string state_file = (dir / "state").string();
+
+		Game game = MakeGame();
+		app::Players players;
+		app::PlayerTokens tokens;
+		uint64_t records = 0;
+		{
+			serialization::Journal journal{state_file, 0, 1ms};
+			app::Player* rex = Join(game, players, tokens, journal, "Rex");
+			app::Player* lassie = Join(game, players, tokens, journal, "Lassie");
+			records += 2;
+
+			const std::string_view moves[] = {"R", "U", "D", "L", ""};
+			for (int i = 0; i < 50; ++i) {
+				if (i % 4 == 0) {
+					app::Player* player = i % 8 == 0 ? rex : lassie;
+					player->Move(moves[i / 4 % 5]);
+					journal.AppendMove(*player, moves[i / 4 % 5]);
+					++records;
+				}
+				game.Tick(300);
+				journal.AppendTick(300, game);
+				++records;
+			}
+		}
+
+		const model::GameSession& session = game.GetGameSessions().front();
+		REQUIRE(!session.GetLostObjects().empty());
+
+		WHEN("the journal is replayed into an empty game") {
+			Game restored = MakeGame();
+			app::Players restored_players;
+			app::PlayerTokens restored_tokens;
+			uint64_t next_seq =
+				 serialization::ReplayJournal(state_file, 0, restored, restored_players, restored_tokens);
+
+			THEN("the game state is the same") {
+				CHECK(next_seq == records);
+				REQUIRE(restored.GetGameSessions().size() == 1);
+				const model::GameSession& restored_session = restored.GetGameSessions().front();
+				REQUIRE(restored_session.GetDogs().size() == session.GetDogs().size());
+				for (size_t i = 0; i < session.GetDogs().size(); ++i) {
+					const Dog& dog = session.GetDogs()[i];
+					const Dog& restored_dog = restored_session.GetDogs()[i];
+					CHECK(restored_dog.GetName() == dog.GetName());
+					CHECK(restored_dog.GetPosition() == dog.GetPosition());
+					CHECK(restored_dog.GetSpeed() == dog.GetSpeed());
+					CHECK(restored_dog.GetBag() == dog.GetBag());
+					CHECK(restored_dog.GetScore() == dog.GetScore());
+				}
+				REQUIRE(restored_session.GetLostObjects().size() == session.GetLostObjects().size());
+				for (size_t i = 0; i < session.GetLostObjects().size(); ++i) {
+					CHECK(restored_session.GetLostObjects()[i].id == session.GetLostObjects()[i].id);
+					CHECK(restored_session.GetLostObjects()[i].type == session.GetLostObjects()[i].type);
+					CHECK(restored_session.GetLostObjects()[i].pos == session.GetLostObjects()[i].pos);
+				}
+				// Следующие трофеи появятся после повтора так же скоро, как появились бы до сбоя
+				CHECK(restored_session.GetLootGenerator().GetTimeWithoutLoot() ==
+						session.GetLootGenerator().GetTimeWithoutLoot());
+				for (const auto& [token, player] : tokens.GetAll()) {
+					const app::Player* restored_player = restored_tokens.FindPlayerByToken(token);
+					REQUIRE(restored_player);
+					CHECK(restored_player->GetId() == player->GetId());
+				}
+			}
+		}
+
+		WHEN("the journal is replayed after a snapshot") {
+			Game restored = MakeGame();
+			app::Players restored_players;
+			app::PlayerTokens restored_tokens;
+			uint64_t next_seq = serialization::ReplayJournal(state_file, records, restored,
+																			 restored_players, restored_tokens);
+
+			THEN("records included in the snapshot are skipped") {
+				CHECK(next_seq == records);
+				CHECK(restored.GetGameSessions().empty());
+			}
+		}
+
+		WHEN("the last record was not written completely") {
+			const fs::path segment = state_file + ".journal.0";
+			fs::resize_file(segment, fs::file_size(segment) - 3);
+
+			Game restored = MakeGame();
+			app::Players restored_players;
+			app::PlayerTokens restored_tokens;
+			uint64_t next_seq =
+				 serialization::ReplayJournal(state_file, 0, restored, restored_players, restored_tokens);
+
+			THEN("all records before it are replayed") {
+				CHECK(next_seq == records - 1);
+			}
+		}
+
+		fs::remove_all(dir);
+	}
+}
+
+SCENARIO("Journal replay with several sessions on a map") {
+	GIVEN("a journal of players spread over sessions by the player cap") {
+		const fs::path dir =
+			 fs::temp_directory_path() / ("journal-sharding-tests-" + std::to_string(::getpid()));
+		fs::create_directories(dir);
+		const std::string state_file = (dir / "state").string();
+
+		Game game = MakeGame(1);
+		app::Players players;
+		app::PlayerTokens tokens;
+		{
+			serialization::Journal journal{state_file, 0, 1ms};
+			for (const char* name : {"Rex", "Lassie", "Bim"}) {
+				app::Player* player = Join(game, players, tokens, journal, name);
+				player->Move("R");
+				journal.AppendMove(*player, "R");
+			}
+			for (int i = 0; i < 20; ++i) {
+				game.Tick(300);
+				journal.AppendTick(300, game);
+			}
+		}
+		REQUIRE(game.GetGameSessions().size() == 3);
+
+		WHEN("the journal is replayed with the cap removed from the config") {
+			Game restored = MakeGame();
+			app::Players restored_players;
+			app::PlayerTokens restored_tokens;
+			serialization::ReplayJournal(state_file, 0, restored, restored_players, restored_tokens);
+
+			THEN("players stay in their sessions") {
+				REQUIRE(restored.GetGameSessions().size() == 3);
+				for (size_t i = 0; i < 3; ++i) {
+					const model::GameSession& session = game.GetGameSessions()[i];
+					const model::GameSession& restored_session = restored.GetGameSessions()[i];
+					REQUIRE(restored_session.GetDogs().size() == 1);
+					CHECK(restored_session.GetDogs().front().GetName() == session.GetDogs().front().GetName());
+					CHECK(restored_session.GetDogs().front().GetPosition() ==
+							session.GetDogs().front().GetPosition());
+					CHECK(restored_session.GetLostObjects().size() == session.GetLostObjects().size());
+				}
+				for (const auto& [token, player] : tokens.GetAll()) {
+					const app::Player* restored_player = restored_tokens.FindPlayerByToken(token);
+					REQUIRE(restored_player);
+					CHECK(restored_player->GetSession()->GetIndex() == player->GetSession()->GetIndex());
+				}
+			}
+		}
+
+		fs::remove_all(dir);
+	}
+}
@@ -0,0 +1,64 @@
+#include "../src/json_writer.h"
+#include <catch2/catch_test_macros.hpp>
+
+using util::JsonWriter;
+
+SCENARIO("Streaming JSON writer") {
+	GIVEN("An empty output string") {
+		std::string out;
+		JsonWriter writer(out);
+
+		WHEN("nested objects and arrays are written") {
+			writer.StartObject();
+			writer.Key("players").StartObject();
+			writer.Key(uint64_t{7}).StartObject().Key("pos").StartArray().Double(4.0).Double(0.5).EndArray();
+			writer.Key("bag").StartArray().EndArray().EndObject();
+			writer.EndObject();
+			writer.Key("lostObjects").StartObject().EndObject();
+			writer.Key("tick").Uint(12).Key("full").Bool(false).Key("score").Int(-3);
+			writer.EndObject();
+
+			THEN("commas are placed between members and elements only") {
+				CHECK(out == R"({"players":{"7":{"pos":[4.0,0.5],"bag":[]}},"lostObjects":{},)"
+								 R"("tick":12,"full":false,"score":-3})");
+			}
+		}
+
+		WHEN("strings with special characters are written") {
+			writer.StartArray().String("a\"b\\c\n\x01").String("Пёс").EndArray();
+
+			THEN("they are escaped, UTF-8 is kept as is") {
+				CHECK(out == "[\"a\\\"b\\\\c\\n\\u0001\",\"Пёс\"]");
+			}
+		}
+
+		WHEN("doubles are written") {
+			writer.StartArray().Double(0).Double(-2).Double(0.1).Double(1e300).Double(1.0 / 0.0).EndArray();
+
+			THEN("each stays a floating point number in the shortest form") {
+				CHECK(out == "[0.0,-2.0,0.1,1e+300,null]");
+			}
+		}
+
+		WHEN("ready fragments are inserted") {
+			writer.StartObject().RawMember(R"("1":{})").RawMember(R"("2":[])");
+			writer.Key("x").RawValue("true").EndObject();
+
+			THEN("they are separated like regular members") {
+				CHECK(out == R"({"1":{},"2":[],"x":true})");
+			}
+		}
+	}
+
+	GIVEN("An output string with content") {
+		std::string out = "prefix:";
+
+		WHEN("a value is written") {
+			JsonWriter(out).StartObject().Key("a").Int(1).EndObject();
+
+			THEN("it is appended") {
+				CHECK(out == R"(prefix:{"a":1})");
+			}
+		}
+	}
+}
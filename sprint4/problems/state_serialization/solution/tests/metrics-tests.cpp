@@ -0,0 +1,140 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "../src/metrics.h"
+#include "../src/request_metrics.h"
+
+using namespace std::chrono_literals;
+
+SCENARIO("Histogram buckets") {
+	GIVEN("the bucket layout") {
+		THEN("every value falls into a bucket that contains it") {
+			for (uint64_t value : {0ull, 1ull, 7ull, 8ull, 15ull, 16ull, 17ull, 100ull, 1000ull,
+										  123456ull, 1ull << 30, (1ull << 39) + 12345}) {
+				const size_t bucket = util::Histogram::GetBucket(value);
+				const uint64_t begin = bucket == 0 ? 0 : util::Histogram::GetBucketEnd(bucket - 1);
+				CHECK(begin <= value);
+				CHECK(value < util::Histogram::GetBucketEnd(bucket));
+			}
+		}
+
+		THEN("bucket width stays within the relative precision") {
+			for (size_t bucket = util::Histogram::SUB_BUCKETS; bucket < util::Histogram::BUCKET_COUNT;
+				  ++bucket) {
+				const uint64_t begin = util::Histogram::GetBucketEnd(bucket - 1);
+				const uint64_t end = util::Histogram::GetBucketEnd(bucket);
+				CHECK(begin < end);
+				CHECK((end - begin) * util::Histogram::SUB_BUCKETS <= begin);
+			}
+		}
+
+		THEN("huge values go to the last bucket") {
+			CHECK(util::Histogram::GetBucket(~uint64_t{0}) == util::Histogram::BUCKET_COUNT - 1);
+		}
+	}
+}
+
+SCENARIO("Histogram recording") {
+	GIVEN("a histogram filled from several threads") {
+		auto histogram = std::make_unique<util::Histogram>();
+		util::Counter counter;
+		std::vector<std::thread> threads;
+		for (int t = 0; t < 4; ++t) {
+			threads.emplace_back([&] {
+				for (uint64_t value = 1; value <= 1000; ++value) {
+					histogram->Record(value);
+					counter.Add();
+				}
+			});
+		}
+		for (auto& thread : threads) {
+			thread.join();
+		}
+
+		WHEN("it is collected") {
+			util::HistogramSnapshot snapshot = histogram->Collect();
+
+			THEN("no value is lost") {
+				CHECK(counter.Get() == 4000);
+				CHECK(snapshot.count == 4000);
+				CHECK(snapshot.sum == 4 * 500500);
+				CHECK(snapshot.CountNotAbove(7) == 4 * 7);
+				CHECK(snapshot.CountNotAbove(10'000) == 4000);
+			}
+
+			THEN("quantiles are accurate within a bucket") {
+				const uint64_t median = snapshot.Quantile(0.5);
+				CHECK(median >= 500);
+				CHECK(median <= 500 + 500 / util::Histogram::SUB_BUCKETS);
+				CHECK(snapshot.Quantile(1.0) >= 1000);
+				CHECK(snapshot.Quantile(0.0) == 1);
+			}
+		}
+	}
+}
+
+SCENARIO("Prometheus text format") {
+	GIVEN("a writer") {
+		std::string out;
+		util::PrometheusWriter writer(out);
+
+		WHEN("a counter is written") {
+			writer.Family("requests_total", "counter", "Requests").Sample("requests_total", "code=\"200\"",
+																								  uint64_t{5});
+
+			THEN("it has help, type and the sample") {
+				CHECK(out ==
+						"# HELP requests_total Requests\n"
+						"# TYPE requests_total counter\n"
+						"requests_total{code=\"200\"} 5\n");
+			}
+		}
+
+		WHEN("a histogram is written") {
+			util::Histogram histogram;
+			histogram.Record(1);
+			histogram.Record(3);
+			histogram.Record(100);
+			writer.Histogram("latency", "", histogram.Collect(), {2, 50}, 0.5);
+
+			THEN("buckets are cumulative and scaled") {
+				CHECK(out ==
+						"latency_bucket{le=\"1\"} 1\n"
+						"latency_bucket{le=\"25\"} 2\n"
+						"latency_bucket{le=\"+Inf\"} 3\n"
+						"latency_sum 52\n"
+						"latency_count 3\n");
+			}
+		}
+	}
+}
+
+SCENARIO("Request metrics") {
+	GIVEN("responses to different routes") {
+		auto metrics = std::make_unique<http_handler::RequestMetrics>();
+		metrics->Record(http_handler::GetRoute("/api/v1/game/state?since=3"), 200, 120us);
+		metrics->Record(http_handler::GetRoute("/api/v1/maps/map1"), 404, 80us);
+		metrics->Record(http_handler::GetRoute("/index.html"), 418, 10us);
+
+		WHEN("they are written") {
+			std::string out;
+			util::PrometheusWriter writer(out);
+			metrics->Write(writer);
+
+			THEN("each route and status is counted") {
+				CHECK(out.find("game_server_http_responses_total{route=\"state\",code=\"200\"} 1\n") !=
+						std::string::npos);
+				CHECK(out.find("game_server_http_responses_total{route=\"map\",code=\"404\"} 1\n") !=
+						std::string::npos);
+				CHECK(out.find("game_server_http_responses_total{route=\"static\",code=\"other\"} 1\n") !=
+						std::string::npos);
+				CHECK(out.find("game_server_http_request_duration_seconds_count{route=\"state\"} 1\n") !=
+						std::string::npos);
+				CHECK(out.find("route=\"join\"") == std::string::npos);
+			}
+		}
+	}
+}
@@ -0,0 +1,45 @@
+#include "../src/model.h"
+#include <catch2/catch_test_macros.hpp>
+#include <random>
+
+using namespace model;
+
+SCENARIO("Road index") {
+	GIVEN("A map with overlapping and crossing roads") {
+		std::mt19937 gen{42};
+		std::uniform_int_distribution<Coord> coord{0, 20};
+
+		Map unindexed{Map::Id{"map"}, "Map"};
+		for (int i = 0; i < 60; ++i) {
+			Point start{coord(gen), coord(gen)};
+			if (i % 2 == 0) {
+				unindexed.AddRoad({Road::HORIZONTAL, start, coord(gen)});
+			} else {
+				unindexed.AddRoad({Road::VERTICAL, start, coord(gen)});
+			}
+		}
+		Map indexed = unindexed;
+		indexed.BuildRoadIndex();
+
+		WHEN("dogs are moved in every direction") {
+			std::uniform_real_distribution<double> pos{-1.0, 21.0};
+			const geom::Vec2D speeds[] = {{3, 0}, {-3, 0}, {0, 3}, {0, -3}};
+
+			THEN("the index gives the same result as scanning all roads") {
+				for (int i = 0; i < 2000; ++i) {
+					geom::Point2D start{pos(gen), pos(gen)};
+					if (i % 2 == 0) {
+						start.y = std::round(start.y);
+					} else {
+						start.x = std::round(start.x);
+					}
+
+					CHECK(indexed.IsOnRoad(start).size() == unindexed.IsOnRoad(start).size());
+					for (geom::Vec2D speed : speeds) {
+						CHECK(indexed.MoveDog(start, speed, 500) == unindexed.MoveDog(start, speed, 500));
+					}
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,117 @@
+#include "../src/model.h"
+#include <catch2/catch_test_macros.hpp>
+
+using namespace model;
+
+SCENARIO("Session and dog lookup") {
+	GIVEN("A game with two maps") {
+		Game game;
+		game.SetPeriod(1.0);
+		game.SetProbability(0.0);
+		for (const char* id : {"map1", "map2"}) {
+			Map map{Map::Id{id}, id};
+			map.AddRoad({Road::HORIZONTAL, {0, 0}, 10});
+			game.AddMap(std::move(map));
+		}
+		const Map* map1 = game.FindMap(Map::Id{"map1"});
+		const Map* map2 = game.FindMap(Map::Id{"map2"});
+
+		WHEN("players join maps without a session cap") {
+			model::GameSession* session1 = game.JoinSession(map1);
+			session1->AddDog("dog");
+			model::GameSession* session2 = game.JoinSession(map2);
+
+			THEN("each map gets one session") {
+				CHECK(session1 != session2);
+				CHECK(game.JoinSession(map1) == session1);
+				CHECK(game.FindSessionByMap(map2) == session2);
+				CHECK(game.GetGameSessions().size() == 2);
+				CHECK(session1->GetIndex() == 0);
+				CHECK(session2->GetIndex() == 1);
+				CHECK(game.GetGameSession(1) == session2);
+				CHECK(game.GetGameSession(2) == nullptr);
+			}
+		}
+
+		WHEN("a session is added for a map that already has one") {
+			model::GameSession* session1 = game.JoinSession(map1);
+			model::GameSession* session2 = game.AddGameSession(model::GameSession{map1, 1.0, 0.0});
+
+			THEN("the map has two sessions") {
+				CHECK(session1 != session2);
+				CHECK(game.FindSessionByMap(map1) == session1);
+				CHECK(game.GetGameSessions().size() == 2);
+			}
+		}
+
+		WHEN("dogs are added to a session") {
+			model::GameSession* session = game.JoinSession(map1);
+			std::vector<Dog*> dogs;
+			for (int i = 0; i < 1000; ++i) {
+				dogs.push_back(session->AddDog("dog"));
+			}
+			Dog* restored = session->AddExistingDog(Dog{"restored", 5000});
+
+			THEN("they are found by id") {
+				for (Dog* dog : dogs) {
+					CHECK(session->FindDogById(dog->GetId()) == dog);
+				}
+				CHECK(session->FindDogById(5000) == restored);
+				CHECK(session->FindDogById(4000) == nullptr);
+			}
+		}
+	}
+}
+
+SCENARIO("Sessions are sharded by player cap") {
+	GIVEN("A map limited to two players per session") {
+		Game game;
+		game.SetPeriod(1.0);
+		game.SetProbability(0.0);
+		Map map{Map::Id{"map1"}, "map1"};
+		map.AddRoad({Road::HORIZONTAL, {0, 0}, 10});
+		map.SetMaxPlayers(2);
+		game.AddMap(std::move(map));
+		const Map* map1 = game.FindMap(Map::Id{"map1"});
+
+		auto join = [&] {
+			model::GameSession* session = game.JoinSession(map1);
+			session->AddDog("dog");
+			return session;
+		};
+
+		WHEN("five players join") {
+			std::vector<model::GameSession*> sessions;
+			for (int i = 0; i < 5; ++i) {
+				sessions.push_back(join());
+			}
+
+			THEN("a new session opens when the others are full") {
+				REQUIRE(game.GetGameSessions().size() == 3);
+				CHECK(sessions[0] == sessions[1]);
+				CHECK(sessions[2] == sessions[3]);
+				CHECK(sessions[0] != sessions[2]);
+				CHECK(sessions[4] != sessions[0]);
+				CHECK(sessions[4] != sessions[2]);
+				for (const auto& session : game.GetGameSessions()) {
+					CHECK(session.GetDogs().size() <= 2);
+				}
+			}
+		}
+
+		WHEN("sessions have different load") {
+			model::GameSession* full = game.AddGameSession(model::GameSession{map1, 1.0, 0.0});
+			full->AddDog("dog");
+			full->AddDog("dog");
+			model::GameSession* half = game.AddGameSession(model::GameSession{map1, 1.0, 0.0});
+			half->AddDog("dog");
+			model::GameSession* empty = game.AddGameSession(model::GameSession{map1, 1.0, 0.0});
+
+			THEN("a player joins the least loaded session") {
+				CHECK(join() == empty);
+				CHECK(game.JoinSession(map1) == half);
+				CHECK(game.GetGameSessions().size() == 3);
+			}
+		}
+	}
+}
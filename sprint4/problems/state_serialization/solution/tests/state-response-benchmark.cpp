@@ -0,0 +1,171 @@
+#include "../src/api_handler.h"
+#include <boost/json.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+
+#include <optional>
+#include <string>
+#include <type_traits>
+
+#include "allocation-counter.h"
+
+using namespace model;
+using namespace http_handler;
+
+namespace {
+
+constexpr int DOGS_COUNT = 1'000;
+
+// Прежний ответ /game/state: дерево json::object, serialize и копирование строки в тело
+ApiHandler::StringResponse WriteStateWithDom(const Game& game, const app::Players& players,
+															const ApiHandler::StringRequest& req) {
+	json::object players_obj;
+	for (const app::Player& player : players.GetAllPlayers()) {
+		json::object player_info;
+		app::PlayerInfo info = player.GetInfo();
+		player_info["pos"] = {info.pos.x, info.pos.y};
+		player_info["speed"] = {info.speed.x, info.speed.y};
+		player_info["score"] = info.score;
+		switch (info.dir) {
+		case Direction::NORTH:
+			player_info["dir"] = "U";
+			break;
+		case Direction::SOUTH:
+			player_info["dir"] = "D";
+			break;
+		case Direction::WEST:
+			player_info["dir"] = "L";
+			break;
+		case Direction::EAST:
+			player_info["dir"] = "R";
+			break;
+		}
+		json::array bag;
+		for (TakenItem item : player.GetBag()) {
+			json::object bag_item;
+			bag_item["id"] = item.id;
+			bag_item["type"] = item.type;
+			bag.push_back(std::move(bag_item));
+		}
+		player_info["bag"] = std::move(bag);
+		players_obj[std::to_string(player.GetId())] = player_info;
+	}
+
+	json::object lost_objects;
+	int count = 0;
+	for (const model::GameSession& session : game.GetGameSessions()) {
+		for (const LostObject& loot : session.GetLostObjects()) {
+			json::object lost_obj;
+			lost_obj["type"] = loot.type;
+			lost_obj["pos"] = {loot.pos.x, loot.pos.y};
+			lost_objects[std::to_string(count++)] = std::move(lost_obj);
+		}
+	}
+
+	json::object obj;
+	obj["players"] = std::move(players_obj);
+	obj["lostObjects"] = std::move(lost_objects);
+	std::string json_str = json::serialize(obj);
+
+	ApiHandler::StringResponse response{http::status::ok, req.version()};
+	response.set(http::field::content_type, "application/json");
+	response.set(http::field::cache_control, "no-cache");
+	response.keep_alive(req.keep_alive());
+	response.body() = json_str;
+	response.prepare_payload();
+	return response;
+}
+
+// Копирует тело ответа любого типа в out, переиспользуя его ёмкость
+template <typename Response>
+void CopyBody(const Response& response, std::string& out) {
+	if constexpr (std::is_same_v<typename Response::body_type, SharedBufferBody>) {
+		out.assign(response.body().data);
+	} else if constexpr (std::is_same_v<typename Response::body_type, http::string_body>) {
+		out.assign(response.body());
+	} else {
+		out.clear();
+	}
+}
+
+} // namespace
+
+// Запуск: persistence_tests "[benchmark]"
+TEST_CASE("State response benchmark", "[.][benchmark]") {
+	Game game;
+	Map map{Map::Id{"map1"}, "Map"};
+	map.AddRoad({Road::HORIZONTAL, {0, 0}, 100});
+	map.AddRoad({Road::VERTICAL, {0, 0}, 100});
+	map.AddLootType({"key", "", "obj", std::nullopt, std::nullopt, 1.0, 10});
+	map.SetBagCapacity(4);
+	map.BuildRoadIndex();
+	game.AddMap(std::move(map));
+	game.SetPeriod(1.0);
+	game.SetProbability(0.0);
+
+	model::GameSession* session = game.AddGameSession(
+		 model::GameSession{&game.GetMaps().front(), game.GetPeriod(), game.GetProbability()});
+	app::Players players;
+	app::PlayerTokens tokens;
+	std::optional<app::Token> token;
+	for (int i = 0; i < DOGS_COUNT; ++i) {
+		Dog* dog = session->AddDog("dog" + std::to_string(i));
+		const double offset = i % 100 + 0.25;
+		if (i % 2 == 0) {
+			dog->SetPosition({offset, 0});
+			dog->SetSpeed({1.5, 0});
+		} else {
+			dog->SetPosition({0, offset});
+			dog->SetSpeed({0, -1.5});
+		}
+		session->AddLostObject({0, {(i * 7) % 100 + 0.5, 0}});
+		app::Token player_token = tokens.AddPlayer(players.Add(session, dog));
+		if (!token) {
+			token = player_token;
+		}
+	}
+	game.Tick(500);
+
+	StateSaver saver{game, std::nullopt, "", players, tokens};
+	app::StateView state_view{game, players};
+	ApiHandler api_handler{game, false, true, saver, players, tokens, state_view};
+	state_view.Publish();
+
+	ApiHandler::StringRequest req{http::verb::get, "/api/v1/game/state", 11};
+	req.set(http::field::authorization, "Bearer " + **token);
+	const EndPoint endpoint({req.target().data(), req.target().size()});
+
+	std::string body;
+	auto serve = [&] {
+		api_handler(endpoint, req, [&body](auto&& response) { CopyBody(response, body); });
+	};
+
+	serve();
+	{
+		const json::value state = json::parse(body);
+		const json::value dom_state = json::parse(WriteStateWithDom(game, players, req).body());
+		REQUIRE(state.as_object().at("players") == dom_state.as_object().at("players"));
+		// Трофеи теперь называются постоянными id, а не номерами по порядку
+		REQUIRE(state.as_object().at("lostObjects").as_object().size() ==
+				  dom_state.as_object().at("lostObjects").as_object().size());
+	}
+
+	// Строка body уже вмещает ответ, поэтому её заполнение не выделяет память
+	size_t dom_allocations =
+		 test_util::CountAllocations([&] { WriteStateWithDom(game, players, req); });
+	size_t handler_allocations = test_util::CountAllocations(serve);
+	WARN("allocations per response: json::object " << dom_allocations << ", ApiHandler "
+																 << handler_allocations);
+	CHECK(handler_allocations < dom_allocations / 100);
+
+	BENCHMARK("json::object + serialize") { return WriteStateWithDom(game, players, req); };
+	BENCHMARK("ApiHandler /game/state from the published snapshot") {
+		serve();
+		return body.size();
+	};
+	BENCHMARK("StateView::Publish after a tick") {
+		game.Tick(1);
+		state_view.Publish();
+		return state_view.Get();
+	};
+}
@@ -0,0 +1,79 @@
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <filesystem>
+#include <unistd.h>
+
+#include "../src/model_serialization.h"
+#include "../src/serialization.h"
+
+using namespace model;
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr int MAPS_COUNT = 16;
+constexpr int DOGS_PER_MAP = 25'000;
+
+Game MakeGame() {
+	Game game;
+	for (int i = 0; i < MAPS_COUNT; ++i) {
+		Map map{Map::Id{"map" + std::to_string(i)}, "Map"};
+		map.AddRoad({Road::HORIZONTAL, {0, 0}, 100});
+		map.AddLootType({});
+		map.BuildRoadIndex();
+		game.AddMap(std::move(map));
+	}
+	game.SetPeriod(1.0);
+	game.SetProbability(0.0);
+	return game;
+}
+
+} // namespace
+
+// Запуск: persistence_tests "[benchmark]"
+TEST_CASE("State restore benchmark", "[.][benchmark]") {
+	const fs::path dir =
+		 fs::temp_directory_path() / ("state-restore-benchmark-" + std::to_string(::getpid()));
+	fs::create_directories(dir);
+	const std::string segmented_file = (dir / "segmented").string();
+	const std::string single_file = (dir / "single").string();
+
+	{
+		Game game = MakeGame();
+		app::Players players;
+		app::PlayerTokens tokens;
+		for (const Map& map : game.GetMaps()) {
+			model::GameSession* session = game.AddGameSession(
+				 model::GameSession{&map, game.GetPeriod(), game.GetProbability()});
+			for (int i = 0; i < DOGS_PER_MAP; ++i) {
+				Dog* dog = session->AddDog("dog " + std::to_string(i));
+				dog->SetPosition({i % 100 * 1.0, 0});
+				tokens.AddPlayer(players.Add(session, dog));
+			}
+		}
+
+		serialization::IncrementalStateWriter writer{segmented_file, serialization::StateFormat::BINARY};
+		auto state = writer.Capture(game, players, tokens, 0);
+		writer.Write(*state);
+		serialization::SerializeState(single_file, game, players, tokens,
+												serialization::StateFormat::BINARY);
+	}
+
+	auto restore = [](const std::string& file) {
+		Game game = MakeGame();
+		app::Players players;
+		app::PlayerTokens tokens;
+		serialization::DeserializeState(file, game, players, tokens);
+		return players.GetAllPlayers().size();
+	};
+
+	BENCHMARK("restore 400k players from session files") {
+		return restore(segmented_file);
+	};
+
+	BENCHMARK("restore 400k players from a single file") {
+		return restore(single_file);
+	};
+
+	fs::remove_all(dir);
+}
@@ -1,8 +1,10 @@
 #include <boost/archive/text_iarchive.hpp>
 #include <boost/archive/text_oarchive.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
 #include <catch2/catch_test_macros.hpp>
 #include <sstream>
 
+#include "../src/binary_archive.h"
 #include "../src/model.h"
 #include "../src/model_serialization.h"
 
@@ -18,6 +20,41 @@ struct Fixture {
 	OutputArchive output_archive{strm};
 };
 
+serialization::StateRepr MakeState(int dogs_count) {
+	serialization::StateRepr state;
+	model::GameSessionRepr& session = state.game_state.sessions.emplace_back();
+	session.map_id = "map1";
+	for (int i = 0; i < dogs_count; ++i) {
+		Dog dog{"Dog " + std::to_string(i), static_cast<uint64_t>(i)};
+		dog.SetPosition({i * 0.25, i * 0.5});
+		dog.SetSpeed({1.5, -0.5});
+		dog.SetDirection(Direction::WEST);
+		dog.AddScore(i % 100);
+		dog.AddItem({i % 3, static_cast<size_t>(i)});
+		session.dogs.emplace_back(dog);
+
+		state.players_state.players.push_back({static_cast<uint64_t>(i), static_cast<uint64_t>(i), "map1"});
+		state.players_state.tokens.push_back({std::string(32, 'a' + i % 26), static_cast<uint64_t>(i)});
+	}
+	session.lost_objects.push_back({1, {2.5, 3.5}});
+	session.last_dog_id = dogs_count;
+	state.players_state.last_player_id = dogs_count;
+	return state;
+}
+
+std::string ToText(const serialization::StateRepr& state) {
+	std::stringstream strm;
+	OutputArchive{strm} << state;
+	return strm.str();
+}
+
+serialization::StateRepr FromText(const std::string& text) {
+	std::stringstream strm{text};
+	serialization::StateRepr state;
+	InputArchive{strm} >> state;
+	return state;
+}
+
 } // namespace
 
 SCENARIO_METHOD(Fixture, "Point serialization") {
@@ -71,3 +108,74 @@ SCENARIO_METHOD(Fixture, "Dog Serialization") {
 		}
 	}
 }
+
+SCENARIO("Binary state archive") {
+	GIVEN("a game state") {
+		const serialization::StateRepr state = MakeState(10);
+
+		WHEN("it is saved in the binary format") {
+			const std::string data = serialization::SaveBinaryState(state);
+
+			THEN("it is recognized and restored to the same state") {
+				REQUIRE(serialization::IsBinaryState(data));
+				serialization::StateRepr restored;
+				serialization::LoadBinaryState(data, restored);
+				CHECK(ToText(restored) == ToText(state));
+			}
+
+			THEN("it is more compact than the text archive") {
+				CHECK(data.size() < ToText(state).size());
+			}
+
+			THEN("a corrupted payload is rejected by the checksum") {
+				std::string corrupted = data;
+				corrupted.back() ^= 1;
+				serialization::StateRepr restored;
+				CHECK_THROWS(serialization::LoadBinaryState(corrupted, restored));
+			}
+
+			THEN("a truncated file is rejected") {
+				serialization::StateRepr restored;
+				CHECK_THROWS(
+					 serialization::LoadBinaryState(std::string_view(data).substr(0, data.size() - 1), restored));
+			}
+		}
+
+		WHEN("it is saved without a checksum") {
+			std::string data = serialization::SaveBinaryState(state, false);
+
+			THEN("it is restored without verification") {
+				serialization::StateRepr restored;
+				serialization::LoadBinaryState(data, restored);
+				CHECK(ToText(restored) == ToText(state));
+			}
+		}
+	}
+
+	GIVEN("a text archive") {
+		const std::string text = ToText(MakeState(1));
+
+		THEN("it is not taken for a binary one") {
+			CHECK_FALSE(serialization::IsBinaryState(text));
+		}
+	}
+}
+
+// Запуск: state_serialization_tests "[benchmark]" --benchmark-samples 5
+TEST_CASE("State serialization benchmark", "[.][benchmark]") {
+	constexpr int DOGS_COUNT = 1'000'000;
+	const serialization::StateRepr state = MakeState(DOGS_COUNT);
+
+	const std::string text = ToText(state);
+	const std::string binary = serialization::SaveBinaryState(state);
+	WARN("state size: text " << text.size() << " bytes, binary " << binary.size() << " bytes");
+
+	BENCHMARK("text save") { return ToText(state); };
+	BENCHMARK("binary save") { return serialization::SaveBinaryState(state); };
+	BENCHMARK("text load") { return FromText(text); };
+	BENCHMARK("binary load") {
+		serialization::StateRepr restored;
+		serialization::LoadBinaryState(binary, restored);
+		return restored;
+	};
+}
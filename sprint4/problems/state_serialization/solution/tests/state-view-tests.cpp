@@ -0,0 +1,100 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "../src/state_view.h"
+
+using namespace model;
+
+namespace {
+
+Game MakeGame() {
+	Game game;
+	Map map{Map::Id{"map1"}, "Map"};
+	map.AddRoad({Road::HORIZONTAL, {0, 0}, 10});
+	map.AddLootType({});
+	map.BuildRoadIndex();
+	game.AddMap(std::move(map));
+	game.SetPeriod(1.0);
+	game.SetProbability(0.0);
+	return game;
+}
+
+size_t Count(std::string_view text, std::string_view pattern) {
+	size_t count = 0;
+	for (size_t pos = text.find(pattern); pos != std::string_view::npos;
+		  pos = text.find(pattern, pos + 1)) {
+		++count;
+	}
+	return count;
+}
+
+} // namespace
+
+SCENARIO("State view between ticks") {
+	GIVEN("a session with two players and a published snapshot") {
+		Game game = MakeGame();
+		model::GameSession* session = game.AddGameSession(
+			 model::GameSession{&game.GetMaps().front(), game.GetPeriod(), game.GetProbability()});
+		app::Players players;
+		app::Player* first = players.Add(session, session->AddDog("first"));
+		app::Player* second = players.Add(session, session->AddDog("second"));
+		app::StateView state_view{game, players};
+		// После тика у сессии есть история изменений
+		REQUIRE(second->Move("U"));
+		game.Tick(100);
+		state_view.Publish();
+		auto old_session = state_view.Get()->FindSession(session);
+		REQUIRE(old_session);
+		REQUIRE(old_session->history);
+
+		WHEN("a player moves") {
+			REQUIRE(first->Move("R"));
+			state_view.UpdatePlayer(*first);
+			auto new_session = state_view.Get()->FindSession(session);
+			REQUIRE(new_session);
+
+			THEN("only the fragment of that player is rebuilt, the rest is shared") {
+				REQUIRE(new_session->players.size() == 2);
+				CHECK(*new_session->players[0].second != *old_session->players[0].second);
+				CHECK(new_session->players[1].second == old_session->players[1].second);
+				CHECK(Count(new_session->state_body, R"("dir":"R")") == 1);
+				CHECK(new_session->tick == old_session->tick);
+				CHECK(new_session->players_body == old_session->players_body);
+				CHECK(new_session->history == old_session->history);
+			}
+
+			THEN("readers of the previous snapshot still see it unchanged") {
+				CHECK(Count(old_session->state_body, R"("dir":"R")") == 0);
+			}
+		}
+
+		WHEN("a player joins a new session") {
+			model::GameSession* other = game.AddGameSession(
+				 model::GameSession{&game.GetMaps().front(), game.GetPeriod(), game.GetProbability()});
+			app::Player* player = players.Add(other, other->AddDog("other"));
+			auto world = state_view.Get();
+			state_view.UpdatePlayer(*player);
+
+			THEN("the session is added without touching the existing ones") {
+				CHECK_FALSE(world->FindSession(other));
+				auto new_session = state_view.Get()->FindSession(other);
+				REQUIRE(new_session);
+				CHECK(new_session->players.size() == 1);
+				CHECK(state_view.Get()->FindSession(session) == old_session);
+			}
+		}
+
+		WHEN("a player joins the session") {
+			app::Player* third = players.Add(session, session->AddDog("third"));
+			state_view.UpdatePlayer(*third);
+			auto new_session = state_view.Get()->FindSession(session);
+			REQUIRE(new_session);
+
+			THEN("the player appears in both bodies") {
+				CHECK(new_session->players.size() == 3);
+				CHECK(Count(*new_session->players_body, R"("name":)") == 3);
+				CHECK(Count(*new_session->players_body, R"("third")") == 1);
+				CHECK(Count(new_session->state_body, R"("pos":)") == 3);
+			}
+		}
+	}
+}
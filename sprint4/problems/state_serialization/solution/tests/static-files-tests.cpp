@@ -0,0 +1,301 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <brotli/decode.h>
+#include <zlib.h>
+
+#include <filesystem>
+#include <fstream>
+#include <unistd.h>
+
+#include "../src/compression.h"
+#include "../src/static_files.h"
+
+using namespace http_handler;
+using namespace std::chrono_literals;
+
+namespace {
+
+void WriteFile(const fs::path& path, const std::string& content) {
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+	out << content;
+}
+
+std::string Gunzip(const std::string& data) {
+	z_stream stream{};
+	REQUIRE(inflateInit2(&stream, 16 + MAX_WBITS) == Z_OK);
+	std::string out(1 << 20, '\0');
+	stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+	stream.avail_in = static_cast<uInt>(data.size());
+	stream.next_out = reinterpret_cast<Bytef*>(out.data());
+	stream.avail_out = static_cast<uInt>(out.size());
+	const int result = inflate(&stream, Z_FINISH);
+	out.resize(stream.total_out);
+	inflateEnd(&stream);
+	REQUIRE(result == Z_STREAM_END);
+	return out;
+}
+
+std::string Unbrotli(const std::string& data) {
+	std::string out(1 << 20, '\0');
+	size_t size = out.size();
+	REQUIRE(BrotliDecoderDecompress(data.size(), reinterpret_cast<const uint8_t*>(data.data()), &size,
+											  reinterpret_cast<uint8_t*>(out.data())) ==
+			  BROTLI_DECODER_RESULT_SUCCESS);
+	out.resize(size);
+	return out;
+}
+
+std::string MakeText() {
+	std::string text;
+	for (int i = 0; i < 200; ++i) {
+		text += "function f" + std::to_string(i) + "() { return " + std::to_string(i * i) + "; }\n";
+	}
+	return text;
+}
+
+} // namespace
+
+SCENARIO("Static file lookup") {
+	GIVEN("a static root with a few files") {
+		const fs::path dir =
+			 fs::temp_directory_path() / ("static-files-tests-" + std::to_string(::getpid()));
+		fs::create_directories(dir / "www" / "js");
+		WriteFile(dir / "www" / "index.html", "<html></html>");
+		WriteFile(dir / "www" / "js" / "app.js", std::string(100, 'a'));
+		WriteFile(dir / "www" / "big.bin", std::string(1000, 'b'));
+		WriteFile(dir / "secret.txt", "secret");
+
+		StaticFiles::Limits limits;
+		limits.max_cache_size = 150;
+		limits.max_file_size = 120;
+		limits.revalidate_period = 0ms;
+		StaticFiles files{dir / "www", limits};
+
+		WHEN("a small file is requested twice") {
+			auto first = files.Resolve("/js/app.js");
+			auto second = files.Resolve("/js/app.js");
+
+			THEN("it is loaded once and kept in memory") {
+				REQUIRE(first.status == StaticFiles::Status::OK);
+				CHECK(first.file->mime_type == "text/javascript");
+				REQUIRE(first.file->content);
+				CHECK(*first.file->content == std::string(100, 'a'));
+				CHECK(second.file == first.file);
+				CHECK(files.GetStats().misses == 1);
+				CHECK(files.GetStats().hits == 1);
+				CHECK(files.GetStats().cached_bytes == 100);
+			}
+		}
+
+		WHEN("a directory is requested") {
+			auto resolution = files.Resolve("/");
+
+			THEN("its index.html is served") {
+				REQUIRE(resolution.status == StaticFiles::Status::OK);
+				CHECK(resolution.file->mime_type == "text/html");
+			}
+		}
+
+		WHEN("a file larger than the per-file limit is requested") {
+			auto resolution = files.Resolve("/big.bin");
+
+			THEN("it is found but not loaded into memory") {
+				REQUIRE(resolution.status == StaticFiles::Status::OK);
+				CHECK(resolution.file->size == 1000);
+				CHECK_FALSE(resolution.file->content);
+				CHECK(resolution.file->path == dir / "www" / "big.bin");
+			}
+		}
+
+		WHEN("cached files exceed the cache size") {
+			files.Resolve("/js/app.js");
+			files.Resolve("/index.html");
+			files.Resolve("/js/app.js");
+			WriteFile(dir / "www" / "other.js", std::string(100, 'c'));
+			files.Resolve("/other.js");
+
+			THEN("the least recently used file is evicted") {
+				CHECK(files.GetStats().cached_bytes <= limits.max_cache_size);
+				const uint64_t misses = files.GetStats().misses;
+				files.Resolve("/other.js");
+				CHECK(files.GetStats().misses == misses);
+				files.Resolve("/index.html");
+				CHECK(files.GetStats().misses == misses + 1);
+			}
+		}
+
+		WHEN("many missing paths are requested") {
+			StaticFiles::Limits missing_limits = limits;
+			missing_limits.revalidate_period = 1h;
+			missing_limits.max_missing_paths = 4;
+			StaticFiles cache{dir / "www", missing_limits};
+			cache.Resolve("/js/app.js");
+			for (int i = 0; i < 100; ++i) {
+				CHECK(cache.Resolve("/missing" + std::to_string(i)).status ==
+						StaticFiles::Status::NOT_FOUND);
+			}
+
+			THEN("cached content stays in memory") {
+				CHECK(cache.GetStats().cached_bytes == 100);
+				const uint64_t misses = cache.GetStats().misses;
+				cache.Resolve("/js/app.js");
+				CHECK(cache.GetStats().misses == misses);
+			}
+
+			THEN("only the most recent missing paths are remembered") {
+				const uint64_t misses = cache.GetStats().misses;
+				cache.Resolve("/missing99");
+				CHECK(cache.GetStats().misses == misses);
+				cache.Resolve("/missing0");
+				CHECK(cache.GetStats().misses == misses + 1);
+			}
+		}
+
+		WHEN("a cached file changes on disk") {
+			auto before = files.Resolve("/index.html");
+			WriteFile(dir / "www" / "index.html", "<html>changed</html>");
+			auto after = files.Resolve("/index.html");
+
+			THEN("the new content and ETag are served") {
+				REQUIRE(after.status == StaticFiles::Status::OK);
+				CHECK(*after.file->content == "<html>changed</html>");
+				CHECK(after.file->etag != before.file->etag);
+			}
+		}
+
+		WHEN("paths outside the root or missing files are requested") {
+			THEN("they are reported") {
+				CHECK(files.Resolve("/../secret.txt").status == StaticFiles::Status::OUTSIDE_ROOT);
+				CHECK(files.Resolve("/missing.html").status == StaticFiles::Status::NOT_FOUND);
+				CHECK(files.Resolve("/js").status == StaticFiles::Status::NOT_FOUND);
+			}
+		}
+
+		fs::remove_all(dir);
+	}
+}
+
+SCENARIO("Compressed static files") {
+	GIVEN("a static root with text and image files") {
+		const fs::path dir =
+			 fs::temp_directory_path() / ("static-compression-tests-" + std::to_string(::getpid()));
+		fs::create_directories(dir / "js");
+		const std::string text = MakeText();
+		WriteFile(dir / "js" / "app.js", text);
+		WriteFile(dir / "small.css", "body {}");
+		WriteFile(dir / "image.png", text);
+		StaticFiles files{dir};
+
+		WHEN("the root is preloaded") {
+			CHECK(files.Preload() == 3);
+
+			THEN("files are in memory before the first request") {
+				CHECK(files.GetStats().misses == 3);
+				files.Resolve("/js/app.js");
+				CHECK(files.GetStats().misses == 3);
+			}
+		}
+
+		WHEN("a text file is loaded for the first time") {
+			auto resolution = files.Resolve("/js/app.js");
+			REQUIRE(resolution.status == StaticFiles::Status::OK);
+
+			THEN("it is served as is until it is compressed in the background") {
+				CHECK(resolution.file->compressible);
+				CHECK(resolution.file->encoded.empty());
+				files.WaitCompressed();
+				CHECK(files.Resolve("/js/app.js").file->encoded.size() == 2);
+				CHECK(files.GetStats().misses == 1);
+			}
+		}
+
+		WHEN("a text file is loaded") {
+			files.Resolve("/js/app.js");
+			files.WaitCompressed();
+			auto resolution = files.Resolve("/js/app.js");
+			REQUIRE(resolution.status == StaticFiles::Status::OK);
+			const StaticFile& file = *resolution.file;
+
+			THEN("it has smaller gzip and brotli variants with their own ETags") {
+				REQUIRE(file.encoded.size() == 2);
+				for (const EncodedContent& variant : file.encoded) {
+					CHECK(variant.data.size() < text.size());
+					CHECK(variant.etag != file.etag);
+					if (variant.encoding == ContentEncoding::GZIP) {
+						CHECK(Gunzip(variant.data) == text);
+					} else {
+						CHECK(Unbrotli(variant.data) == text);
+					}
+				}
+				CHECK(files.GetStats().cached_bytes == file.GetMemorySize());
+				CHECK(file.GetMemorySize() > text.size());
+			}
+
+			THEN("the variant is chosen by Accept-Encoding") {
+				CHECK_FALSE(ChooseEncoding("", file));
+				CHECK_FALSE(ChooseEncoding("identity", file));
+				CHECK_FALSE(ChooseEncoding("gzip;q=0, br;q=0", file));
+				CHECK(ChooseEncoding("gzip", file)->encoding == ContentEncoding::GZIP);
+				CHECK(ChooseEncoding("GZIP, deflate", file)->encoding == ContentEncoding::GZIP);
+				CHECK(ChooseEncoding("gzip, deflate, br", file)->encoding == ContentEncoding::BROTLI);
+				CHECK(ChooseEncoding("br;q=0.5, gzip", file)->encoding == ContentEncoding::GZIP);
+				CHECK(ChooseEncoding("*", file)->encoding == ContentEncoding::BROTLI);
+				CHECK(ChooseEncoding("br;q=0, *", file)->encoding == ContentEncoding::GZIP);
+			}
+		}
+
+		WHEN("small or already compressed files are loaded") {
+			THEN("they are served as is") {
+				CHECK_FALSE(files.Resolve("/small.css").file->compressible);
+				CHECK_FALSE(files.Resolve("/image.png").file->compressible);
+				files.WaitCompressed();
+				CHECK(files.Resolve("/small.css").file->encoded.empty());
+				CHECK(files.Resolve("/image.png").file->encoded.empty());
+			}
+		}
+
+		fs::remove_all(dir);
+	}
+}
+
+SCENARIO("HTTP dates") {
+	GIVEN("a time") {
+		const std::time_t time = 784111777;
+
+		THEN("it is formatted and parsed back") {
+			CHECK(FormatHttpDate(time) == "Sun, 06 Nov 1994 08:49:37 GMT");
+			CHECK(ParseHttpDate("Sun, 06 Nov 1994 08:49:37 GMT") == time);
+			CHECK_FALSE(ParseHttpDate("yesterday"));
+		}
+	}
+}
+
+SCENARIO("Entity tags in If-None-Match") {
+	GIVEN("an entity tag") {
+		const std::string etag = R"("abc")";
+
+		THEN("it is found in a list of tags") {
+			CHECK(MatchesETag(R"("abc")", etag));
+			CHECK(MatchesETag(R"("x", "abc")", etag));
+			CHECK(MatchesETag(R"("x",	"abc" , "y")", etag));
+			CHECK(MatchesETag("*", etag));
+		}
+
+		THEN("weak and strong tags match each other") {
+			CHECK(MatchesETag(R"(W/"abc")", etag));
+			CHECK(MatchesETag(R"("abc")", R"(W/"abc")"));
+		}
+
+		THEN("a tag inside another tag does not match") {
+			CHECK_FALSE(MatchesETag(R"("abc-gz")", etag));
+			CHECK_FALSE(MatchesETag(R"("x,"abc"")", etag));
+			CHECK_FALSE(MatchesETag(R"("a,bc")", etag));
+			CHECK_FALSE(MatchesETag("", etag));
+			CHECK_FALSE(MatchesETag("abc", etag));
+		}
+
+		THEN("commas inside a tag are part of it") {
+			CHECK(MatchesETag(R"("x", "a,b")", R"("a,b")"));
+		}
+	}
+}
@@ -0,0 +1,83 @@
+#include "../src/model.h"
+#include <catch2/catch_test_macros.hpp>
+
+using namespace model;
+
+SCENARIO("Tick changes history") {
+	GIVEN("A session with a resting dog, a running dog and a lost object") {
+		Map map{Map::Id{"map"}, "Map"};
+		map.AddRoad({Road::HORIZONTAL, {0, 0}, 10});
+		map.AddLootType({});
+		map.BuildRoadIndex();
+
+		model::GameSession session{&map, 1.0, 0.0};
+		Dog* resting = session.AddDog("resting");
+		Dog* running = session.AddDog("running");
+		running->SetPosition({8, 0});
+		session.AddLostObject({0, {9.5, 0}});
+		session.AddLostObject({0, {1, 0}});
+
+		WHEN("the first tick passes") {
+			session.Tick(100);
+
+			THEN("everything added before it is reported as changed in that tick") {
+				REQUIRE(session.GetTick() == 1);
+				REQUIRE(session.GetHistory().size() == 1);
+				const TickChanges& changes = *session.GetHistory().back();
+				CHECK(changes.tick == 1);
+				CHECK(changes.dogs.size() == 2);
+				CHECK(changes.added_loot == std::vector<uint64_t>{0, 1});
+				CHECK(changes.removed_loot.empty());
+			}
+		}
+
+		WHEN("the running dog picks up loot in a later tick") {
+			session.Tick(100);
+			running->SetSpeed({10, 0});
+			session.Tick(200);
+
+			THEN("only the running dog and the taken object are reported") {
+				const TickChanges& changes = *session.GetHistory().back();
+				CHECK(changes.tick == 2);
+				CHECK(changes.dogs == std::vector<uint64_t>{running->GetId()});
+				CHECK(changes.added_loot.empty());
+				CHECK(changes.removed_loot == std::vector<uint64_t>{0});
+				REQUIRE(running->GetBag().size() == 1);
+				CHECK(running->GetBag().front().id == 0);
+				CHECK(session.GetLostObjects().front().id == 1);
+			}
+		}
+
+		WHEN("more ticks pass than the history holds") {
+			for (size_t i = 0; i < model::GameSession::HISTORY_DEPTH + 10; ++i) {
+				session.Tick(1);
+			}
+
+			THEN("only the latest ticks are kept") {
+				CHECK(session.GetHistory().size() == model::GameSession::HISTORY_DEPTH);
+				CHECK(session.GetHistory().back()->tick == session.GetTick());
+				CHECK(session.GetHistory().front()->tick ==
+						session.GetTick() - model::GameSession::HISTORY_DEPTH + 1);
+			}
+		}
+
+		WHEN("nothing moves during ticks") {
+			session.Tick(100);
+			const uint64_t generation = session.GetGeneration();
+			session.Tick(100);
+			session.Tick(100);
+
+			THEN("the session generation stays the same") {
+				CHECK(session.GetGeneration() == generation);
+			}
+
+			AND_WHEN("a dog gets a command") {
+				resting->SetSpeed({0, 0});
+
+				THEN("the generation changes before the next tick") {
+					CHECK(session.GetGeneration() != generation);
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,114 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <numeric>
+#include <thread>
+#include <vector>
+
+#include "../src/ticker.h"
+
+using namespace std::chrono_literals;
+
+SCENARIO("Tick steps") {
+	GIVEN("a maximum step of 30 ms") {
+		std::vector<std::chrono::milliseconds> steps;
+		auto collect = [&steps](std::chrono::milliseconds step) { steps.push_back(step); };
+
+		WHEN("a delta shorter than the step is split") {
+			THEN("it is passed as one step") {
+				CHECK(ForEachTickStep(20ms, 30ms, collect) == 1);
+				CHECK(steps == std::vector{20ms});
+			}
+		}
+
+		WHEN("a long delta is split") {
+			const size_t count = ForEachTickStep(100ms, 30ms, collect);
+
+			THEN("the steps are nearly equal, bounded and add up to the delta") {
+				CHECK(count == 4);
+				CHECK(steps == std::vector{25ms, 25ms, 25ms, 25ms});
+				CHECK(std::accumulate(steps.begin(), steps.end(), 0ms) == 100ms);
+			}
+		}
+
+		WHEN("the delta does not divide evenly") {
+			ForEachTickStep(101ms, 30ms, collect);
+
+			THEN("the remainder goes to the first steps") {
+				CHECK(steps == std::vector{26ms, 25ms, 25ms, 25ms});
+			}
+		}
+
+		WHEN("no time has passed") {
+			THEN("there are no steps") {
+				CHECK(ForEachTickStep(0ms, 30ms, collect) == 0);
+				CHECK(steps.empty());
+			}
+		}
+	}
+}
+
+SCENARIO("Tick stats") {
+	GIVEN("empty stats") {
+		TickStats stats;
+
+		WHEN("ticks of different duration are added") {
+			stats.AddTick(300us, 10ms, 1);
+			stats.AddTick(1ms, 10ms, 1);
+			stats.AddTick(15ms, 10ms, 3);
+			stats.AddTick(2s, 10ms, 2);
+
+			THEN("they fall into histogram buckets and long ones count as overruns") {
+				CHECK(stats.GetTickCount() == 4);
+				CHECK(stats.GetStepCount() == 7);
+				CHECK(stats.GetOverrunCount() == 2);
+				CHECK(stats.GetMaxTime() == 2s);
+				CHECK(stats.GetBucketCount(0) == 1);
+				CHECK(stats.GetBucketCount(1) == 1);
+				CHECK(stats.GetBucketCount(TickStats::GetBucket(15ms)) == 1);
+				CHECK(stats.GetBucketCount(TickStats::BUCKET_COUNT - 1) == 1);
+			}
+		}
+	}
+}
+
+SCENARIO("Fixed step ticker") {
+	GIVEN("a ticker with a handler slower than its period") {
+		net::io_context ioc;
+		auto strand = net::make_strand(ioc);
+		std::vector<std::chrono::milliseconds> steps;
+		size_t tick_ends = 0;
+		std::shared_ptr<Ticker> ticker;
+		ticker = std::make_shared<Ticker>(
+			 strand, 10ms,
+			 [&](std::chrono::milliseconds step) {
+				 steps.push_back(step);
+				 if (steps.size() == 1) {
+					 std::this_thread::sleep_for(100ms);
+				 }
+				 if (steps.size() >= 20) {
+					 ioc.stop();
+				 }
+			 },
+			 Ticker::FixedStep{10ms, 50ms}, [&tick_ends] { ++tick_ends; });
+
+		WHEN("it runs") {
+			ticker->Start();
+			ioc.run();
+
+			THEN("no step is longer than the maximum and late time is accounted") {
+				for (auto step : steps) {
+					CHECK(step <= 10ms);
+				}
+				const TickStats& stats = ticker->GetStats();
+				CHECK(stats.GetOverrunCount() >= 1);
+				CHECK(stats.GetMissedDeadlineCount() >= 1);
+				CHECK(stats.GetDroppedTime() > 0ms);
+			}
+
+			THEN("the end of a tick is reported once for all its steps") {
+				CHECK(tick_ends == ticker->GetStats().GetTickCount());
+				CHECK(tick_ends < steps.size());
+			}
+		}
+	}
+}
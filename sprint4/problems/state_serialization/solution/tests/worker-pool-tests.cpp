@@ -0,0 +1,131 @@
+#include "../src/model.h"
+#include "../src/worker_pool.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+using namespace model;
+
+namespace {
+
+constexpr int SESSIONS_COUNT = 8;
+constexpr int DOGS_PER_SESSION = 50;
+
+// Сессии с одинаковым начальным состоянием. Вероятность 0 отключает случайную генерацию
+// трофеев, поэтому результат тика зависит только от этого состояния
+void AddSessions(Game& game) {
+	const Map* map = &game.GetMaps().front();
+	for (int s = 0; s < SESSIONS_COUNT; ++s) {
+		model::GameSession* session =
+			 game.AddGameSession(model::GameSession{map, game.GetPeriod(), game.GetProbability()});
+		for (int i = 0; i < DOGS_PER_SESSION; ++i) {
+			Dog* dog = session->AddDog("dog");
+			dog->SetPosition({static_cast<double>((i + s) % 40), 0});
+			dog->SetSpeed({i % 2 == 0 ? 3.0 : -3.0, 0});
+			session->AddLostObject({i % 2, {(i * 7 + s) % 40 + 0.5, 0}});
+		}
+	}
+}
+
+Game MakeGame() {
+	Game game;
+	Map map{Map::Id{"map1"}, "Map"};
+	map.AddRoad({Road::HORIZONTAL, {0, 0}, 40});
+	map.AddOffice({Office::Id{"o0"}, {0, 0}, {0, 0}});
+	map.AddOffice({Office::Id{"o1"}, {40, 0}, {0, 0}});
+	map.AddLootType({"key", "", "obj", std::nullopt, std::nullopt, 1.0, 10});
+	map.AddLootType({"wallet", "", "obj", std::nullopt, std::nullopt, 1.0, 30});
+	map.BuildRoadIndex();
+	game.AddMap(std::move(map));
+	game.SetPeriod(1.0);
+	game.SetProbability(0.0);
+	AddSessions(game);
+	return game;
+}
+
+} // namespace
+
+SCENARIO("Worker pool") {
+	GIVEN("a pool of four threads") {
+		util::WorkerPool pool{4};
+		REQUIRE(pool.GetThreadCount() == 4);
+
+		WHEN("a batch of tasks is run several times") {
+			constexpr size_t COUNT = 1000;
+			std::vector<std::atomic<int>> calls(COUNT);
+			for (int run = 0; run < 3; ++run) {
+				pool.Run(COUNT, [&calls](size_t index) { ++calls[index]; });
+			}
+
+			THEN("each index is run exactly once per batch") {
+				for (const auto& count : calls) {
+					CHECK(count == 3);
+				}
+			}
+		}
+
+		WHEN("a task throws") {
+			THEN("the exception reaches the caller, and the pool stays usable") {
+				CHECK_THROWS_AS(pool.Run(100,
+												 [](size_t index) {
+													 if (index == 42) {
+														 throw std::runtime_error("task failed");
+													 }
+												 }),
+									 std::runtime_error);
+
+				std::atomic<size_t> calls = 0;
+				pool.Run(100, [&calls](size_t) { ++calls; });
+				CHECK(calls == 100);
+			}
+		}
+
+		WHEN("there are no tasks") {
+			THEN("Run returns at once") {
+				pool.Run(0, [](size_t) { FAIL("no task expected"); });
+			}
+		}
+	}
+}
+
+SCENARIO("Parallel game tick") {
+	GIVEN("two games in the same state, one ticking its sessions on four threads") {
+		Game serial = MakeGame();
+		Game parallel = MakeGame();
+		parallel.SetTickThreads(4);
+
+		WHEN("both tick several times") {
+			for (int i = 0; i < 20; ++i) {
+				serial.Tick(250);
+				parallel.Tick(250);
+			}
+
+			THEN("dog positions, bags and scores are the same") {
+				const auto& serial_sessions = serial.GetGameSessions();
+				const auto& parallel_sessions = parallel.GetGameSessions();
+				REQUIRE(serial_sessions.size() == parallel_sessions.size());
+				uint64_t gathered = 0;
+				int score = 0;
+				for (size_t s = 0; s < serial_sessions.size(); ++s) {
+					const auto& expected = serial_sessions[s].GetDogs();
+					const auto& actual = parallel_sessions[s].GetDogs();
+					REQUIRE(expected.size() == actual.size());
+					for (size_t i = 0; i < expected.size(); ++i) {
+						CHECK(expected[i].GetPosition() == actual[i].GetPosition());
+						CHECK(expected[i].GetBag() == actual[i].GetBag());
+						CHECK(expected[i].GetScore() == actual[i].GetScore());
+						score += actual[i].GetScore();
+					}
+					CHECK(serial_sessions[s].GetLostObjects().size() ==
+							parallel_sessions[s].GetLostObjects().size());
+					gathered += parallel_sessions[s].GetGatherEventCount();
+				}
+				// Иначе сравнение не проверило бы сбор и сдачу трофеев
+				CHECK(gathered > 0);
+				CHECK(score > 0);
+			}
+		}
+	}
+}